@@ -10,7 +10,7 @@ def main():
     fps = 1000
 
     scene = p3g.Scene(p3g.color.BLACK, light=p3g.Vec3(0, 1, 0).normalize())
-    coin = p3g.Body.from_obj("assets/coin.obj", "coin")
+    coin = p3g.Body.from_obj("assets/coin.obj", "coin", ao_samples=64)
     scene.add_body(coin)
     camera = p3g.Camera(p3g.Vec3(-3, 0, 1), p3g.Vec3(1, 0, -0.3))
     renderer = p3g.Renderer(screen, camera, scene, clock)
@@ -23,10 +23,11 @@ def main():
     scene.add_body(cube)
     camera = p3g.Camera(p3g.Vec3(-2.8, 0, 0.9), p3g.Vec3(1, 0, -0.3))
     renderer = p3g.Renderer(screen, camera, scene, clock)
+    renderer.pacer = p3g.FramePacer(fps)
     run = True
 
     while run:
-        clock.tick(fps)
+        renderer.pacer.wait()
 
         for event in pygame.event.get():
             if event.type == pygame.QUIT:
@@ -35,7 +36,7 @@ def main():
             elif event.type == pygame.VIDEORESIZE:
                 renderer.resize()
 
-        camera.handle_movements(clock.get_fps())
+        camera.handle_movements(renderer.pacer.fps() or fps)
         cube.rotate_deg(1)
         renderer.render()
 
@@ -1,18 +1,203 @@
 #include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <stdlib.h>
 #include <Python.h>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
 #define min(X, Y) (((X) < (Y)) ? (X) : (Y))
 #define max(X, Y) (((X) > (Y)) ? (X) : (Y))
 
-static void draw_triangle(uint8_t* buffer,
-                          int bs_x, int bs_y, int bs_c,
-                          float* depth_buffer,
-                          int ds_x, int ds_y,
-                          float p1xf, float p1yf, float p1z,
-                          float p2xf, float p2yf, float p2z,
-                          float p3xf, float p3yf, float p3z,
-                          uint8_t R, uint8_t G, uint8_t B,
-                          int w, int h) {
+#define DIRTY_POS 1
+#define DIRTY_ROT 2
+
+#define DEPTH_TILE 8
+#define DEPTH_PLANE 1
+#define DEPTH_TWO_PLANES 2
+#define DEPTH_RAW 3
+
+#define FRAME_TILE 4
+
+#define FXAA_SEARCH_STEPS 8
+
+#define FOG_LINEAR 1
+#define FOG_EXP 2
+#define TONEMAP_CLAMP 1
+#define TONEMAP_REINHARD 2
+#define TONEMAP_ACES 3
+
+#define PERF_COUNTERS 4
+
+// Python objects, PyMem and raw allocations, bytes requested and native heap in use
+#define ALLOC_COUNTERS 5
+#define ALLOC_DOMAINS 3
+
+#ifdef __GNUC__
+#define ATOMIC_ADD(X, Y) __atomic_fetch_add(&(X), (Y), __ATOMIC_RELAXED)
+#else
+#define ATOMIC_ADD(X, Y) ((X) += (Y))
+#endif
+
+#define REPLAY_TRIANGLE 0
+#define REPLAY_SPANS 1
+#define REPLAY_DEPTH_TILES 2
+#define REPLAY_FRAME_TILES 3
+#define REPLAY_PACKED 4
+
+#define CMD_CLEAR 1
+#define CMD_CAMERA 2
+#define CMD_LIGHT 3
+#define CMD_DRAW 4
+#define CMD_SHADER 5
+// Ints of a command: op and three arguments
+#define COMMAND_SIZE 4
+// Camera as position, right, up, dir, tright, tup, tdir, af, f, q, znear, zfar, cx, cy
+#define CAMERA_PARAMS 22
+// Transform of an instance as position, angle and axis of the rotation
+#define TRANSFORM_PARAMS 7
+// State of the execution: camera, light direction and background color
+#define STATE_LIGHT CAMERA_PARAMS
+#define STATE_BACKGROUND (CAMERA_PARAMS + 3)
+
+#if defined(__GNUC__)
+// Pixels of a row processed at once by draw_triangle_simd, with the vector extensions of GCC and Clang
+#define SIMD_LANES 4
+typedef int32_t lanes_i __attribute__((vector_size(SIMD_LANES * sizeof(int32_t))));
+typedef float lanes_f __attribute__((vector_size(SIMD_LANES * sizeof(float))));
+#endif
+
+#define BVH_LEAF_SIZE 4
+#define BVH_STACK_SIZE 64
+
+typedef struct {
+    int32_t x0;
+    int32_t x1;
+    float a;
+    float b;
+    uint8_t R, G, B, pad;
+} Span;
+
+// Depth of a tile as a + b * x + c * y, the pixels with the bit set in mask use plane[1]
+typedef struct {
+    float plane[2][3];
+    uint64_t mask;
+    int32_t mode;
+    int32_t pad;
+} DepthTile;
+
+// 4x4 pixels, color and depth of a tile are two consecutive cache lines
+typedef struct {
+    uint8_t color[FRAME_TILE * FRAME_TILE][4];
+    float depth[FRAME_TILE * FRAME_TILE];
+} FrameTile;
+
+// Parameters of the fused post processing chain, modes are stored as floats
+typedef struct {
+    float fog_mode;
+    float fog_start;
+    float fog_end;
+    float fog_density;
+    float fog_color[3];
+    float q;
+    float znear;
+    float tonemap_mode;
+    float exposure;
+    float white;
+} PostParams;
+
+// Leaves have count >= 0 faces from start, an empty mesh is an empty leaf,
+// interior nodes have count = -1 and their children at start and start + 1
+typedef struct {
+    float min[3];
+    float max[3];
+    int32_t start;
+    int32_t count;
+} BVHNode;
+
+// Allocator of a Python memory domain wrapped by the counting hooks
+typedef struct {
+    PyMemAllocatorEx allocator;
+    int domain;
+} CountingAllocator;
+
+// Mesh drawn by the command buffers, in model space, occlusion is NULL or a factor per face
+typedef struct {
+    const double* vertices;
+    const int32_t* faces;
+    const uint8_t* colors;
+    const double* occlusion;
+    int64_t n_vertices;
+    int64_t n_faces;
+} CommandMesh;
+
+// Interpolants of a face given to the face shaders, normal is outward and unit,
+// intensity the default lighting including the baked occlusion
+typedef struct {
+    double normal[3];
+    double center[3];
+    double light[3];
+    double intensity;
+    int32_t face, mesh, instance;
+    uint8_t base[3];
+    uint8_t pad;
+} FaceShading;
+
+// Interpolants of a span of covered pixels of a row given to the span shaders.
+// weights are the barycentric weights of the vertices at the first pixel, linear
+// in screen space, and steps their increment per pixel, depths are the view
+// depths of the vertices for perspective correction, color the one of the face
+typedef struct {
+    double positions[9];
+    float weights[3];
+    float steps[3];
+    float depths[3];
+    int32_t x, y, count;
+    int32_t face, mesh, instance;
+    uint8_t color[3];
+    uint8_t pad;
+} SpanShading;
+
+// Shaders written in C or compiled to it, user is the pointer given with them:
+// a face shader can change the RGB color of the face, a span shader writes
+// count RGB colors, one per pixel of the span
+typedef void (*FaceShader)(const FaceShading* face, uint8_t* color, void* user);
+typedef void (*SpanShader)(const SpanShading* span, uint8_t* colors, void* user);
+
+// Shaders in use by a command buffer, colors holds the colors of a span
+typedef struct {
+    FaceShader face;
+    SpanShader span;
+    void* user;
+    uint8_t* colors;
+} ShaderHooks;
+
+// Triangle of a frame capture as submitted to the raster stage, value is the packed color
+typedef struct {
+    float p[9];
+    uint8_t R, G, B, pad;
+    uint16_t value;
+    uint16_t pad2;
+} CapturedTriangle;
+
+// Return the number of pixels written in the rows from y0 to y1 excluded
+static int draw_triangle_rows(uint8_t* buffer,
+                              int bs_x, int bs_y, int bs_c,
+                              float* depth_buffer,
+                              int ds_x, int ds_y,
+                              float p1xf, float p1yf, float p1z,
+                              float p2xf, float p2yf, float p2z,
+                              float p3xf, float p3yf, float p3z,
+                              uint8_t R, uint8_t G, uint8_t B,
+                              int w, int y0, int y1, int parity) {
 
     const int p1x = (int) p1xf;
     const int p2x = (int) p2xf;
@@ -23,10 +208,10 @@ static void draw_triangle(uint8_t* buffer,
 
     const int min_x = max(min(min(p1x, p2x), p3x), 0);
     const int max_x = min(max(max(p1x, p2x), p3x), w - 1);
-    const int min_y = max(min(min(p1y, p2y), p3y), 0);
-    const int max_y = min(max(max(p1y, p2y), p3y), h - 1);
+    const int min_y = max(min(min(p1y, p2y), p3y), y0);
+    const int max_y = min(max(max(p1y, p2y), p3y), y1 - 1);
 
-    if (min_x > max_x + 1 || min_y > max_y + 1) return;
+    if (min_x > max_x + 1 || min_y > max_y + 1) return 0;
 
     const int p1_p2_x_diff = p1x - p2x;
     const int p2_p3_x_diff = p2x - p3x;
@@ -40,7 +225,7 @@ static void draw_triangle(uint8_t* buffer,
 
     int area = p3_p1_y_diff * p2_p3_x_diff - p3_p1_x_diff * p2_p3_y_diff;
 
-    if (area == 0) return;
+    if (area == 0) return 0;
 
     const float inv_area = 1.0f / area;
 
@@ -50,10 +235,14 @@ static void draw_triangle(uint8_t* buffer,
     int s1;
     int s2;
     int s3;
+    int written = 0;
+
+    // With a parity only the pixels with (x + y) % 2 == parity are drawn
+    const int step = parity < 0 ? 1 : 2;
 
     for (int y = min_y; y <= max_y; y++)
     {
-        for (int x = min_x; x <= max_x; x++)
+        for (int x = parity < 0 ? min_x : min_x + ((min_x + y + parity) & 1); x <= max_x; x += step)
         {
             s1 = p1_p2_y_diff * x - p1_p2_x_diff * y + p2_p1_cross;
             s2 = p2_p3_y_diff * x - p2_p3_x_diff * y + p3_p2_cross;
@@ -71,94 +260,3332 @@ static void draw_triangle(uint8_t* buffer,
                     buffer[offset + bs_c] = G;
                     buffer[offset + bs_c + bs_c] = B;
                     depth_buffer[depth_offest] = depth;
+                    written++;
                 }
             }
         }
     }
+
+    return written;
 }
 
-static void fill_bg(uint8_t* buffer,
-                    int bs_x, int bs_y, int bs_c,
-                    uint8_t R, uint8_t G, uint8_t B,
-                    int w, int h) {
-    for (int y = 0; y < h; y++)
+// Return the number of pixels written
+static int draw_triangle(uint8_t* buffer,
+                         int bs_x, int bs_y, int bs_c,
+                         float* depth_buffer,
+                         int ds_x, int ds_y,
+                         float p1xf, float p1yf, float p1z,
+                         float p2xf, float p2yf, float p2z,
+                         float p3xf, float p3yf, float p3z,
+                         uint8_t R, uint8_t G, uint8_t B,
+                         int w, int h, int parity) {
+
+    return draw_triangle_rows(buffer, bs_x, bs_y, bs_c,
+                              depth_buffer, ds_x, ds_y,
+                              p1xf, p1yf, p1z,
+                              p2xf, p2yf, p2z,
+                              p3xf, p3yf, p3z,
+                              R, G, B, w, 0, h, parity);
+}
+
+#if defined(__GNUC__)
+static inline int all_zero(lanes_i mask) {
+    int any = 0;
+
+    for (int i = 0; i < SIMD_LANES; i++) any |= mask[i];
+
+    return any == 0;
+}
+
+static inline int all_set(lanes_i mask) {
+    int all = -1;
+
+    for (int i = 0; i < SIMD_LANES; i++) all &= mask[i];
+
+    return all == -1;
+}
+#endif
+
+// Same pixels as draw_triangle_rows, the edge functions and the depth of
+// SIMD_LANES pixels are computed at once. The lanes follow the axis along
+// which the depth buffer is contiguous, y for the pygame layout. Whole chunks
+// of a contiguous depth buffer are tested and written as vectors, and when all
+// their pixels pass on packed RGB rows the colors are written by one store of
+// SIMD_LANES pixels. The other chunks write the colors of their lanes one by
+// one, and test the depth one by one at the end of a row or on other layouts
+static int draw_triangle_simd(uint8_t* buffer,
+                              int bs_x, int bs_y, int bs_c,
+                              float* depth_buffer,
+                              int ds_x, int ds_y,
+                              float p1xf, float p1yf, float p1z,
+                              float p2xf, float p2yf, float p2z,
+                              float p3xf, float p3yf, float p3z,
+                              uint8_t R, uint8_t G, uint8_t B,
+                              int w, int y0, int y1, int parity) {
+#if defined(__GNUC__)
+    const int p1x = (int) p1xf;
+    const int p2x = (int) p2xf;
+    const int p3x = (int) p3xf;
+    const int p1y = (int) p1yf;
+    const int p2y = (int) p2yf;
+    const int p3y = (int) p3yf;
+
+    const int min_x = max(min(min(p1x, p2x), p3x), 0);
+    const int max_x = min(max(max(p1x, p2x), p3x), w - 1);
+    const int min_y = max(min(min(p1y, p2y), p3y), y0);
+    const int max_y = min(max(max(p1y, p2y), p3y), y1 - 1);
+
+    if (min_x > max_x + 1 || min_y > max_y + 1) return 0;
+
+    const int p1_p2_x_diff = p1x - p2x;
+    const int p2_p3_x_diff = p2x - p3x;
+    const int p3_p1_x_diff = p3x - p1x;
+    const int p1_p2_y_diff = p1y - p2y;
+    const int p2_p3_y_diff = p2y - p3y;
+    const int p3_p1_y_diff = p3y - p1y;
+    const int p2_p1_cross = p1_p2_x_diff * p2y - p1_p2_y_diff * p2x;
+    const int p3_p2_cross = p2_p3_x_diff * p3y - p2_p3_y_diff * p3x;
+    const int p1_p3_cross = p3_p1_x_diff * p1y - p3_p1_y_diff * p1x;
+
+    int area = p3_p1_y_diff * p2_p3_x_diff - p3_p1_x_diff * p2_p3_y_diff;
+
+    if (area == 0) return 0;
+
+    const float inv_area = 1.0f / area;
+
+    // u is the axis of the outer loop and v the one of the lanes
+    const int lanes_y = abs(ds_y) < abs(ds_x);
+    const int min_u = lanes_y ? min_x : min_y;
+    const int max_u = lanes_y ? max_x : max_y;
+    const int min_v = lanes_y ? min_y : min_x;
+    const int max_v = lanes_y ? max_y : max_x;
+    const int bs_u = lanes_y ? bs_x : bs_y;
+    const int bs_v = lanes_y ? bs_y : bs_x;
+    const int ds_u = (lanes_y ? ds_x : ds_y) / (int) sizeof(float);
+    const int ds_v = (lanes_y ? ds_y : ds_x) / (int) sizeof(float);
+
+    // edge functions as a_u * u + a_v * v + cross
+    const int e1_u = lanes_y ? p1_p2_y_diff : - p1_p2_x_diff;
+    const int e2_u = lanes_y ? p2_p3_y_diff : - p2_p3_x_diff;
+    const int e3_u = lanes_y ? p3_p1_y_diff : - p3_p1_x_diff;
+    const int e1_v = lanes_y ? - p1_p2_x_diff : p1_p2_y_diff;
+    const int e2_v = lanes_y ? - p2_p3_x_diff : p2_p3_y_diff;
+    const int e3_v = lanes_y ? - p3_p1_x_diff : p3_p1_y_diff;
+
+    lanes_i lane;
+    // RGB of SIMD_LANES pixels of packed rows
+    uint8_t color[3 * SIMD_LANES];
+    const int packed_rgb = bs_v == 3 && bs_c == 1;
+    int written = 0;
+
+    for (int i = 0; i < SIMD_LANES; i++)
     {
-        for (int x = 0; x < w; x++)
+        lane[i] = i;
+        color[3 * i] = R;
+        color[3 * i + 1] = G;
+        color[3 * i + 2] = B;
+    }
+
+    for (int u = min_u; u <= max_u; u++)
+    {
+        // the edge functions step by addition, SSE2 has no 32 bits vector product
+        lanes_i vs = min_v + lane;
+        lanes_i s1 = e1_v * vs + (e1_u * u + p2_p1_cross);
+        lanes_i s2 = e2_v * vs + (e2_u * u + p3_p2_cross);
+        lanes_i s3 = e3_v * vs + (e3_u * u + p1_p3_cross);
+
+        for (int v = min_v; v <= max_v; v += SIMD_LANES,
+             vs += SIMD_LANES, s1 += e1_v * SIMD_LANES, s2 += e2_v * SIMD_LANES, s3 += e3_v * SIMD_LANES)
         {
-            int offset = x * bs_x + y * bs_y;
-            buffer[offset] = R;
-            buffer[offset + bs_c] = G;
-            buffer[offset + bs_c + bs_c] = B;
+            lanes_i inside = ((s1 > 0) & (s2 > 0) & (s3 > 0)) | ((s1 <= 0) & (s2 <= 0) & (s3 <= 0));
+            inside &= vs <= max_v;
+
+            if (parity >= 0) inside &= ((vs + u) & 1) == parity;
+
+            if (all_zero(inside)) continue;
+
+            const lanes_f depth = (p1z * __builtin_convertvector(s2, lanes_f) +
+                                   p2z * __builtin_convertvector(s3, lanes_f) +
+                                   p3z * __builtin_convertvector(s1, lanes_f)) * inv_area;
+
+            const int base = u * ds_u + v * ds_v;
+
+            // whole chunks of a contiguous depth buffer are tested at once
+            if (ds_v == 1 && v + SIMD_LANES - 1 <= max_v)
+            {
+                lanes_f stored;
+                memcpy(&stored, depth_buffer + base, sizeof(stored));
+                const lanes_i closer = inside & (depth < stored);
+
+                if (all_zero(closer)) continue;
+
+                const lanes_i kept = (closer & (lanes_i) depth) | (~closer & (lanes_i) stored);
+                memcpy(depth_buffer + base, &kept, sizeof(kept));
+
+                if (packed_rgb && all_set(closer))
+                {
+                    memcpy(buffer + u * bs_u + v * bs_v, color, sizeof(color));
+                    written += SIMD_LANES;
+                    continue;
+                }
+
+                for (int i = 0; i < SIMD_LANES; i++)
+                {
+                    if (closer[i])
+                    {
+                        const int offset = u * bs_u + (v + i) * bs_v;
+                        buffer[offset] = R;
+                        buffer[offset + bs_c] = G;
+                        buffer[offset + bs_c + bs_c] = B;
+                        written++;
+                    }
+                }
+
+                continue;
+            }
+
+            for (int i = 0; i < SIMD_LANES; i++)
+            {
+                const int depth_offest = base + i * ds_v;
+
+                if (inside[i] && depth[i] < depth_buffer[depth_offest])
+                {
+                    const int offset = u * bs_u + (v + i) * bs_v;
+                    buffer[offset] = R;
+                    buffer[offset + bs_c] = G;
+                    buffer[offset + bs_c + bs_c] = B;
+                    depth_buffer[depth_offest] = depth[i];
+                    written++;
+                }
+            }
         }
     }
+
+    return written;
+#else
+    return draw_triangle_rows(buffer, bs_x, bs_y, bs_c,
+                              depth_buffer, ds_x, ds_y,
+                              p1xf, p1yf, p1z,
+                              p2xf, p2yf, p2z,
+                              p3xf, p3yf, p3z,
+                              R, G, B, w, y0, y1, parity);
+#endif
 }
 
-PyDoc_STRVAR(ext_rendering__doc__,
-"Low level drawing on the pygame buffer.");
+// Draw in order the triangles of 9 floats and 3 colors each on the rows
+// from y0 to y1 excluded, the threads drawing other bands of rows touch
+// different pixels
+static int draw_triangles(const float* points, const uint8_t* colors, int count,
+                          uint8_t* buffer, int bs_x, int bs_y, int bs_c,
+                          float* depth_buffer, int ds_x, int ds_y,
+                          int w, int parity, int y0, int y1) {
+    int written = 0;
 
-PyDoc_STRVAR(draw_triangle__doc__,
-"Draw a triangle on the pygame buffer.");
+    for (int i = 0; i < count; i++)
+    {
+        const float* p = points + 9 * i;
+        const uint8_t* c = colors + 3 * i;
 
-PyDoc_STRVAR(fill_bg__doc__,
-"Fill the background with its color.");
+        written += draw_triangle_simd(buffer, bs_x, bs_y, bs_c,
+                                      depth_buffer, ds_x, ds_y,
+                                      p[0], p[1], p[2],
+                                      p[3], p[4], p[5],
+                                      p[6], p[7], p[8],
+                                      c[0], c[1], c[2], w, y0, y1, parity);
+    }
 
-static PyObject* py_draw_triangle(PyObject* self, PyObject* args)
-{
-    unsigned long long buffer_ptr;
-    int bs_x, bs_y, bs_c;
-    unsigned long long depth_buffer_ptr;
-    int ds_x, ds_y;
-    float p1xf, p1yf, p1z;
-    float p2xf, p2yf, p2z;
-    float p3xf, p3yf, p3z;
-    uint8_t R, G, B;
-    int w, h;
+    return written;
+}
 
-	if (!PyArg_ParseTuple(args, "KiiiKiifffffffffbbbii:draw_triangle",
-                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
-                          &depth_buffer_ptr, &ds_x, &ds_y,
-                          &p1xf, &p1yf, &p1z,
-                          &p2xf, &p2yf, &p2z,
-                          &p3xf, &p3yf, &p3z,
-                          &R, &G, &B, &w, &h))
-		return NULL;
+static void draw_triangle_id(int32_t* ids, float* depth_buffer,
+                             float p1xf, float p1yf, float p1z,
+                             float p2xf, float p2yf, float p2z,
+                             float p3xf, float p3yf, float p3z,
+                             int32_t id, int w, int h) {
 
-    uint8_t* buffer = (uint8_t*) buffer_ptr;
-    float* depth_buffer = (float*) depth_buffer_ptr;
+    const int p1x = (int) p1xf;
+    const int p2x = (int) p2xf;
+    const int p3x = (int) p3xf;
+    const int p1y = (int) p1yf;
+    const int p2y = (int) p2yf;
+    const int p3y = (int) p3yf;
 
-	draw_triangle(buffer, bs_x, bs_y, bs_c,
-                  depth_buffer, ds_x, ds_y,
-                  p1xf, p1yf, p1z,
-                  p2xf, p2yf, p2z,
-                  p3xf, p3yf, p3z,
-                  R, G, B, w, h);
+    const int min_x = max(min(min(p1x, p2x), p3x), 0);
+    const int max_x = min(max(max(p1x, p2x), p3x), w - 1);
+    const int min_y = max(min(min(p1y, p2y), p3y), 0);
+    const int max_y = min(max(max(p1y, p2y), p3y), h - 1);
 
-	Py_RETURN_NONE;
+    if (min_x > max_x + 1 || min_y > max_y + 1) return;
+
+    const int p1_p2_x_diff = p1x - p2x;
+    const int p2_p3_x_diff = p2x - p3x;
+    const int p3_p1_x_diff = p3x - p1x;
+    const int p1_p2_y_diff = p1y - p2y;
+    const int p2_p3_y_diff = p2y - p3y;
+    const int p3_p1_y_diff = p3y - p1y;
+    const int p2_p1_cross = p1_p2_x_diff * p2y - p1_p2_y_diff * p2x;
+    const int p3_p2_cross = p2_p3_x_diff * p3y - p2_p3_y_diff * p3x;
+    const int p1_p3_cross = p3_p1_x_diff * p1y - p3_p1_y_diff * p1x;
+
+    int area = p3_p1_y_diff * p2_p3_x_diff - p3_p1_x_diff * p2_p3_y_diff;
+
+    if (area == 0) return;
+
+    const float inv_area = 1.0f / area;
+
+    for (int y = min_y; y <= max_y; y++)
+    {
+        for (int x = min_x; x <= max_x; x++)
+        {
+            const int s1 = p1_p2_y_diff * x - p1_p2_x_diff * y + p2_p1_cross;
+            const int s2 = p2_p3_y_diff * x - p2_p3_x_diff * y + p3_p2_cross;
+            const int s3 = p3_p1_y_diff * x - p3_p1_x_diff * y + p1_p3_cross;
+
+            if (((s1 > 0) && (s2 > 0) && (s3 > 0)) || ((s1 <= 0) && (s2 <= 0) && (s3 <= 0)))
+            {
+                const float depth = (p1z * s2 + p2z * s3 + p3z * s1) * inv_area;
+                const int offset = x + y * w;
+
+                if (depth < depth_buffer[offset])
+                {
+                    ids[offset] = id;
+                    depth_buffer[offset] = depth;
+                }
+            }
+        }
+    }
 }
 
-static PyObject* py_fill_bg(PyObject* self, PyObject* args)
-{
-    unsigned long long buffer_ptr;
-    int bs_x, bs_y, bs_c;
-    uint8_t R, G, B;
-    int w, h;
+// Keep the part of a polygon in view space where a * x + b * y + c * z + d >= 0
+static int clip_view_polygon(float (*polygon)[3], int n, const float plane[4], float (*out)[3]) {
+    int count = 0;
 
-	if (!PyArg_ParseTuple(args, "Kiiibbbii:draw_triangle",
-                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
-                          &R, &G, &B, &w, &h))
-		return NULL;
+    for (int k = 0; k < n; k++)
+    {
+        const float* p = polygon[k];
+        const float* q = polygon[(k + 1) % n];
+        const float dp = plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] + plane[3];
+        const float dq = plane[0] * q[0] + plane[1] * q[1] + plane[2] * q[2] + plane[3];
 
-    uint8_t* buffer = (uint8_t*) buffer_ptr;
+        if (dp >= 0)
+        {
+            out[count][0] = p[0];
+            out[count][1] = p[1];
+            out[count][2] = p[2];
+            count++;
+        }
 
-	fill_bg(buffer, bs_x, bs_y, bs_c,
-            R, G, B, w, h);
+        if ((dp >= 0) != (dq >= 0))
+        {
+            const float t = dp / (dp - dq);
+            out[count][0] = p[0] + t * (q[0] - p[0]);
+            out[count][1] = p[1] + t * (q[1] - p[1]);
+            out[count][2] = p[2] + t * (q[2] - p[2]);
+            count++;
+        }
+    }
 
-	Py_RETURN_NONE;
+    return count;
+}
+
+static void raster_ids(const float* vertices, const int32_t* faces,
+                       const int32_t* face_ids, int n_faces,
+                       const float* eye, const float* dir,
+                       const float* up, const float* right,
+                       float f, float znear, float zfar,
+                       int w, int h, int32_t* ids, float* depth_buffer) {
+    for (int i = 0; i < w * h; i++)
+    {
+        ids[i] = 0;
+        depth_buffer[i] = zfar;
+    }
+
+    for (int i = 0; i < n_faces; i++)
+    {
+        const float* v[3] = {vertices + faces[i * 3] * 3,
+                             vertices + faces[i * 3 + 1] * 3,
+                             vertices + faces[i * 3 + 2] * 3};
+        float p[3][3];
+
+        // Same back face test of the renderer, normals point inside
+        const float e1[3] = {v[2][0] - v[0][0], v[2][1] - v[0][1], v[2][2] - v[0][2]};
+        const float e2[3] = {v[1][0] - v[0][0], v[1][1] - v[0][1], v[1][2] - v[0][2]};
+        const float n[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                            e1[2] * e2[0] - e1[0] * e2[2],
+                            e1[0] * e2[1] - e1[1] * e2[0]};
+
+        if ((v[0][0] - eye[0]) * n[0] + (v[0][1] - eye[1]) * n[1] +
+            (v[0][2] - eye[2]) * n[2] <= 0)
+            continue;
+
+        for (int k = 0; k < 3; k++)
+        {
+            const float d[3] = {v[k][0] - eye[0], v[k][1] - eye[1], v[k][2] - eye[2]};
+            p[k][0] = d[0] * right[0] + d[1] * right[1] + d[2] * right[2];
+            p[k][1] = d[0] * up[0] + d[1] * up[1] + d[2] * up[2];
+            p[k][2] = d[0] * dir[0] + d[1] * dir[1] + d[2] * dir[2];
+        }
+
+        // The set must be conservative, so the faces crossing the near plane are
+        // clipped rather than skipped, and also clipped to a band twice as large
+        // as the view to keep the pixel coordinates in range. The faces beyond
+        // zfar are left to the depth test.
+        const float planes[5][4] = {{0.0f, 0.0f, 1.0f, - znear},
+                                    {- f, 0.0f, 2.0f, 0.0f}, {f, 0.0f, 2.0f, 0.0f},
+                                    {0.0f, - f, 2.0f, 0.0f}, {0.0f, f, 2.0f, 0.0f}};
+        float polygon[8][3];
+        float clipped[8][3];
+        int count = 3;
+
+        memcpy(polygon, p, sizeof(p));
+
+        for (int k = 0; k < 5 && count >= 3; k++)
+        {
+            count = clip_view_polygon(polygon, count, planes[k], clipped);
+            memcpy(polygon, clipped, count * sizeof(polygon[0]));
+        }
+
+        for (int k = 0; k < count; k++)
+        {
+            const float z = polygon[k][2];
+            polygon[k][0] = (f * polygon[k][0] / z + 1.0f) / 2.0f * w;
+            polygon[k][1] = (- f * polygon[k][1] / z + 1.0f) / 2.0f * h;
+        }
+
+        for (int k = 1; k + 1 < count; k++)
+            draw_triangle_id(ids, depth_buffer,
+                             polygon[0][0], polygon[0][1], polygon[0][2],
+                             polygon[k][0], polygon[k][1], polygon[k][2],
+                             polygon[k + 1][0], polygon[k + 1][1], polygon[k + 1][2],
+                             face_ids[i], w, h);
+    }
+}
+
+static long long floor_div(long long a, long long b) {
+    long long q = a / b;
+    if ((a % b != 0) && ((a < 0) != (b < 0))) q--;
+    return q;
+}
+
+static long long ceil_div(long long a, long long b) {
+    return - floor_div(- a, b);
+}
+
+// Pixels x of a row where the edge function A * x + C is > 0 (positive) or <= 0
+static void edge_interval(long long A, long long C, int positive, long long* lo, long long* hi) {
+    if (A == 0)
+    {
+        if ((positive && C <= 0) || (!positive && C > 0)) *hi = *lo - 1;
+    }
+    else if ((A > 0) == (positive != 0))
+    {
+        const long long bound = positive ? floor_div(- C, A) + 1 : ceil_div(C, - A);
+        *lo = bound > *lo ? bound : *lo;
+    }
+    else
+    {
+        const long long bound = positive ? ceil_div(C, - A) - 1 : floor_div(- C, A);
+        *hi = bound < *hi ? bound : *hi;
+    }
+}
+
+static void insert_span(Span* row, int32_t* count, Span* scratch, Span span) {
+    int n = 0;
+
+    for (int i = 0; i < *count; i++)
+    {
+        Span s = row[i];
+
+        if (s.x1 <= span.x0 || s.x0 >= span.x1)
+        {
+            if (s.x0 >= span.x1 && span.x0 < span.x1)
+            {
+                scratch[n++] = span;
+                span.x0 = span.x1;
+            }
+            scratch[n++] = s;
+            continue;
+        }
+
+        if (s.x0 < span.x0)
+        {
+            Span left = s;
+            left.x1 = span.x0;
+            scratch[n++] = left;
+        }
+        else if (span.x0 < s.x0)
+        {
+            Span gap = span;
+            gap.x1 = s.x0;
+            scratch[n++] = gap;
+        }
+
+        // The new span wins where it is strictly nearer, the difference is linear in x
+        const int o0 = max(s.x0, span.x0);
+        const int o1 = min(s.x1, span.x1);
+        const float da = span.a - s.a;
+        const float db = span.b - s.b;
+        int split = o1;
+        int new_first = da < 0.0f;
+
+        if (db != 0.0f)
+        {
+            const float cross = fminf(fmaxf(- da / db, (float) o0 - 1.0f), (float) o1 + 1.0f);
+            split = db > 0.0f ? (int) ceilf(cross) : (int) floorf(cross) + 1;
+            split = min(max(split, o0), o1);
+            new_first = db > 0.0f;
+        }
+
+        Span first = new_first ? span : s;
+        Span second = new_first ? s : span;
+        first.x0 = o0;
+        first.x1 = split;
+        second.x0 = split;
+        second.x1 = o1;
+
+        if (first.x0 < first.x1) scratch[n++] = first;
+        if (second.x0 < second.x1) scratch[n++] = second;
+
+        if (s.x1 > span.x1)
+        {
+            Span right = s;
+            right.x0 = span.x1;
+            scratch[n++] = right;
+        }
+
+        span.x0 = o1;
+    }
+
+    if (span.x0 < span.x1) scratch[n++] = span;
+
+    for (int i = 0; i < n; i++)
+        row[i] = scratch[i];
+
+    *count = n;
+}
+
+static void span_triangle(Span* spans, int32_t* counts, Span* scratch,
+                          float p1xf, float p1yf, float p1z,
+                          float p2xf, float p2yf, float p2z,
+                          float p3xf, float p3yf, float p3z,
+                          uint8_t R, uint8_t G, uint8_t B,
+                          int w, int h) {
+
+    const int p1x = (int) p1xf;
+    const int p2x = (int) p2xf;
+    const int p3x = (int) p3xf;
+    const int p1y = (int) p1yf;
+    const int p2y = (int) p2yf;
+    const int p3y = (int) p3yf;
+
+    const int min_x = max(min(min(p1x, p2x), p3x), 0);
+    const int max_x = min(max(max(p1x, p2x), p3x), w - 1);
+    const int min_y = max(min(min(p1y, p2y), p3y), 0);
+    const int max_y = min(max(max(p1y, p2y), p3y), h - 1);
+
+    if (min_x > max_x + 1 || min_y > max_y + 1) return;
+
+    const int p1_p2_x_diff = p1x - p2x;
+    const int p2_p3_x_diff = p2x - p3x;
+    const int p3_p1_x_diff = p3x - p1x;
+    const int p1_p2_y_diff = p1y - p2y;
+    const int p2_p3_y_diff = p2y - p3y;
+    const int p3_p1_y_diff = p3y - p1y;
+    const int p2_p1_cross = p1_p2_x_diff * p2y - p1_p2_y_diff * p2x;
+    const int p3_p2_cross = p2_p3_x_diff * p3y - p2_p3_y_diff * p3x;
+    const int p1_p3_cross = p3_p1_x_diff * p1y - p3_p1_y_diff * p1x;
+
+    int area = p3_p1_y_diff * p2_p3_x_diff - p3_p1_x_diff * p2_p3_y_diff;
+
+    if (area == 0) return;
+
+    const float inv_area = 1.0f / area;
+    // Same depth of draw_triangle written as the plane a + b * x of each row
+    const float b = (p1z * p2_p3_y_diff + p2z * p3_p1_y_diff + p3z * p1_p2_y_diff) * inv_area;
+
+    for (int y = min_y; y <= max_y; y++)
+    {
+        const long long c1 = - (long long) p1_p2_x_diff * y + p2_p1_cross;
+        const long long c2 = - (long long) p2_p3_x_diff * y + p3_p2_cross;
+        const long long c3 = - (long long) p3_p1_x_diff * y + p1_p3_cross;
+        const float a = (p1z * c2 + p2z * c3 + p3z * c1) * inv_area;
+
+        for (int positive = 1; positive >= 0; positive--)
+        {
+            long long lo = min_x;
+            long long hi = max_x;
+
+            edge_interval(p1_p2_y_diff, c1, positive, &lo, &hi);
+            edge_interval(p2_p3_y_diff, c2, positive, &lo, &hi);
+            edge_interval(p3_p1_y_diff, c3, positive, &lo, &hi);
+
+            if (lo > hi) continue;
+
+            Span span = {(int32_t) lo, (int32_t) hi + 1, a, b, R, G, B, 0};
+            insert_span(spans + y * w, counts + y, scratch, span);
+        }
+    }
+}
+
+static void resolve_spans(const Span* spans, int32_t* counts,
+                          uint8_t* buffer, int bs_x, int bs_y, int bs_c,
+                          float* depth_buffer, int ds_x, int ds_y,
+                          int w, int h) {
+    for (int y = 0; y < h; y++)
+    {
+        const Span* row = spans + y * w;
+
+        for (int i = 0; i < counts[y]; i++)
+        {
+            const Span span = row[i];
+
+            for (int x = span.x0; x < span.x1; x++)
+            {
+                const float depth = span.a + span.b * x;
+                const int depth_offset = (x * ds_x + y * ds_y) / sizeof(float);
+
+                if (depth < depth_buffer[depth_offset])
+                {
+                    const int offset = x * bs_x + y * bs_y;
+                    buffer[offset] = span.R;
+                    buffer[offset + bs_c] = span.G;
+                    buffer[offset + bs_c + bs_c] = span.B;
+                    depth_buffer[depth_offset] = depth;
+                }
+            }
+        }
+
+        counts[y] = 0;
+    }
+}
+
+static inline float tile_depth(const DepthTile* tile, const float* raw, int i, int x, int y) {
+    if (tile->mode == DEPTH_RAW) return raw[i];
+
+    const float* plane = tile->plane[(tile->mode == DEPTH_TWO_PLANES) && ((tile->mask >> i) & 1)];
+
+    return plane[0] + plane[1] * x + plane[2] * y;
+}
+
+static void expand_tile(DepthTile* tile, float* raw, int tx, int ty) {
+    if (tile->mode == DEPTH_RAW) return;
+
+    for (int i = 0; i < DEPTH_TILE * DEPTH_TILE; i++)
+        raw[i] = tile_depth(tile, raw, i, tx * DEPTH_TILE + i % DEPTH_TILE, ty * DEPTH_TILE + i / DEPTH_TILE);
+
+    tile->mode = DEPTH_RAW;
+}
+
+static void clear_depth_tiles(DepthTile* tiles, int n, float zfar) {
+    const DepthTile clear = {{{zfar, 0.0f, 0.0f}, {zfar, 0.0f, 0.0f}}, 0, DEPTH_PLANE, 0};
+
+    for (int t = 0; t < n; t++)
+        tiles[t] = clear;
+}
+
+static void draw_triangle_tiles(uint8_t* buffer,
+                                int bs_x, int bs_y, int bs_c,
+                                DepthTile* tiles, float* raw, int tiles_x,
+                                float p1xf, float p1yf, float p1z,
+                                float p2xf, float p2yf, float p2z,
+                                float p3xf, float p3yf, float p3z,
+                                uint8_t R, uint8_t G, uint8_t B,
+                                int w, int h) {
+
+    const int p1x = (int) p1xf;
+    const int p2x = (int) p2xf;
+    const int p3x = (int) p3xf;
+    const int p1y = (int) p1yf;
+    const int p2y = (int) p2yf;
+    const int p3y = (int) p3yf;
+
+    const int min_x = max(min(min(p1x, p2x), p3x), 0);
+    const int max_x = min(max(max(p1x, p2x), p3x), w - 1);
+    const int min_y = max(min(min(p1y, p2y), p3y), 0);
+    const int max_y = min(max(max(p1y, p2y), p3y), h - 1);
+
+    if (min_x > max_x || min_y > max_y) return;
+
+    const int p1_p2_x_diff = p1x - p2x;
+    const int p2_p3_x_diff = p2x - p3x;
+    const int p3_p1_x_diff = p3x - p1x;
+    const int p1_p2_y_diff = p1y - p2y;
+    const int p2_p3_y_diff = p2y - p3y;
+    const int p3_p1_y_diff = p3y - p1y;
+    const int p2_p1_cross = p1_p2_x_diff * p2y - p1_p2_y_diff * p2x;
+    const int p3_p2_cross = p2_p3_x_diff * p3y - p2_p3_y_diff * p3x;
+    const int p1_p3_cross = p3_p1_x_diff * p1y - p3_p1_y_diff * p1x;
+
+    int area = p3_p1_y_diff * p2_p3_x_diff - p3_p1_x_diff * p2_p3_y_diff;
+
+    if (area == 0) return;
+
+    const float inv_area = 1.0f / area;
+    // Same depth of draw_triangle written as a plane, so it can be stored in the tiles
+    const float plane[3] = {
+        (p1z * p3_p2_cross + p2z * p1_p3_cross + p3z * p2_p1_cross) * inv_area,
+        (p1z * p2_p3_y_diff + p2z * p3_p1_y_diff + p3z * p1_p2_y_diff) * inv_area,
+        - (p1z * p2_p3_x_diff + p2z * p3_p1_x_diff + p3z * p1_p2_x_diff) * inv_area
+    };
+
+    for (int ty = min_y / DEPTH_TILE; ty <= max_y / DEPTH_TILE; ty++)
+    {
+        for (int tx = min_x / DEPTH_TILE; tx <= max_x / DEPTH_TILE; tx++)
+        {
+            DepthTile* tile = tiles + ty * tiles_x + tx;
+            float* tile_raw = raw + (ty * tiles_x + tx) * DEPTH_TILE * DEPTH_TILE;
+            uint64_t valid = 0;
+            uint64_t pass = 0;
+
+            for (int i = 0; i < DEPTH_TILE * DEPTH_TILE; i++)
+            {
+                const int x = tx * DEPTH_TILE + i % DEPTH_TILE;
+                const int y = ty * DEPTH_TILE + i / DEPTH_TILE;
+
+                if (x >= w || y >= h) continue;
+
+                valid |= (uint64_t) 1 << i;
+
+                if (x < min_x || x > max_x || y < min_y || y > max_y) continue;
+
+                const int s1 = p1_p2_y_diff * x - p1_p2_x_diff * y + p2_p1_cross;
+                const int s2 = p2_p3_y_diff * x - p2_p3_x_diff * y + p3_p2_cross;
+                const int s3 = p3_p1_y_diff * x - p3_p1_x_diff * y + p1_p3_cross;
+
+                if (((s1 > 0) && (s2 > 0) && (s3 > 0)) || ((s1 <= 0) && (s2 <= 0) && (s3 <= 0)))
+                {
+                    const float depth = plane[0] + plane[1] * x + plane[2] * y;
+
+                    if (depth < tile_depth(tile, tile_raw, i, x, y))
+                    {
+                        const int offset = x * bs_x + y * bs_y;
+                        buffer[offset] = R;
+                        buffer[offset + bs_c] = G;
+                        buffer[offset + bs_c + bs_c] = B;
+                        pass |= (uint64_t) 1 << i;
+                    }
+                }
+            }
+
+            if (!pass) continue;
+
+            const uint64_t first = valid & ~tile->mask;
+            const uint64_t second = valid & tile->mask;
+
+            if ((valid & ~pass) == 0)
+            {
+                // The triangle covers the whole tile
+                memcpy(tile->plane[0], plane, sizeof(plane));
+                tile->mask = 0;
+                tile->mode = DEPTH_PLANE;
+            }
+            else if (tile->mode == DEPTH_PLANE)
+            {
+                memcpy(tile->plane[1], plane, sizeof(plane));
+                tile->mask = pass;
+                tile->mode = DEPTH_TWO_PLANES;
+            }
+            else if (tile->mode == DEPTH_TWO_PLANES && (first & ~pass) == 0)
+            {
+                memcpy(tile->plane[0], plane, sizeof(plane));
+                tile->mask = second & ~pass;
+            }
+            else if (tile->mode == DEPTH_TWO_PLANES && (second & ~pass) == 0)
+            {
+                memcpy(tile->plane[1], plane, sizeof(plane));
+                tile->mask = pass;
+            }
+            else
+            {
+                expand_tile(tile, tile_raw, tx, ty);
+
+                for (int i = 0; i < DEPTH_TILE * DEPTH_TILE; i++)
+                {
+                    if ((pass >> i) & 1)
+                        tile_raw[i] = plane[0] + plane[1] * (tx * DEPTH_TILE + i % DEPTH_TILE) +
+                                      plane[2] * (ty * DEPTH_TILE + i / DEPTH_TILE);
+                }
+            }
+        }
+    }
+}
+
+// Copy between the tiles and a flat depth buffer, for the tiles overlapping a rectangle
+static void copy_depth_tiles(DepthTile* tiles, float* raw, int tiles_x,
+                             float* depth_buffer, int ds_x, int ds_y,
+                             int x0, int y0, int x1, int y1,
+                             int w, int h, int store) {
+    x0 = max(x0, 0);
+    y0 = max(y0, 0);
+    x1 = min(x1, w - 1);
+    y1 = min(y1, h - 1);
+
+    for (int ty = y0 / DEPTH_TILE; ty <= y1 / DEPTH_TILE && y0 <= y1; ty++)
+    {
+        for (int tx = x0 / DEPTH_TILE; tx <= x1 / DEPTH_TILE && x0 <= x1; tx++)
+        {
+            DepthTile* tile = tiles + ty * tiles_x + tx;
+            float* tile_raw = raw + (ty * tiles_x + tx) * DEPTH_TILE * DEPTH_TILE;
+
+            if (store) tile->mode = DEPTH_RAW;
+
+            for (int i = 0; i < DEPTH_TILE * DEPTH_TILE; i++)
+            {
+                const int x = tx * DEPTH_TILE + i % DEPTH_TILE;
+                const int y = ty * DEPTH_TILE + i / DEPTH_TILE;
+
+                if (x >= w || y >= h) continue;
+
+                float* pixel = depth_buffer + (x * ds_x + y * ds_y) / sizeof(float);
+
+                if (store) tile_raw[i] = *pixel;
+                else *pixel = tile_depth(tile, tile_raw, i, x, y);
+            }
+        }
+    }
+}
+
+static void clear_frame_tiles(FrameTile* tiles, int n, uint8_t R, uint8_t G, uint8_t B, float zfar) {
+    FrameTile clear;
+
+    for (int i = 0; i < FRAME_TILE * FRAME_TILE; i++)
+    {
+        clear.color[i][0] = R;
+        clear.color[i][1] = G;
+        clear.color[i][2] = B;
+        clear.color[i][3] = 0;
+        clear.depth[i] = zfar;
+    }
+
+    for (int t = 0; t < n; t++)
+        tiles[t] = clear;
+}
+
+static void draw_triangle_frame(FrameTile* tiles, int tiles_x,
+                                float p1xf, float p1yf, float p1z,
+                                float p2xf, float p2yf, float p2z,
+                                float p3xf, float p3yf, float p3z,
+                                uint8_t R, uint8_t G, uint8_t B,
+                                int w, int h) {
+
+    const int p1x = (int) p1xf;
+    const int p2x = (int) p2xf;
+    const int p3x = (int) p3xf;
+    const int p1y = (int) p1yf;
+    const int p2y = (int) p2yf;
+    const int p3y = (int) p3yf;
+
+    const int min_x = max(min(min(p1x, p2x), p3x), 0);
+    const int max_x = min(max(max(p1x, p2x), p3x), w - 1);
+    const int min_y = max(min(min(p1y, p2y), p3y), 0);
+    const int max_y = min(max(max(p1y, p2y), p3y), h - 1);
+
+    if (min_x > max_x || min_y > max_y) return;
+
+    const int p1_p2_x_diff = p1x - p2x;
+    const int p2_p3_x_diff = p2x - p3x;
+    const int p3_p1_x_diff = p3x - p1x;
+    const int p1_p2_y_diff = p1y - p2y;
+    const int p2_p3_y_diff = p2y - p3y;
+    const int p3_p1_y_diff = p3y - p1y;
+    const int p2_p1_cross = p1_p2_x_diff * p2y - p1_p2_y_diff * p2x;
+    const int p3_p2_cross = p2_p3_x_diff * p3y - p2_p3_y_diff * p3x;
+    const int p1_p3_cross = p3_p1_x_diff * p1y - p3_p1_y_diff * p1x;
+
+    int area = p3_p1_y_diff * p2_p3_x_diff - p3_p1_x_diff * p2_p3_y_diff;
+
+    if (area == 0) return;
+
+    const float inv_area = 1.0f / area;
+
+    // Walk the tiles so each one is loaded once, the pixels inside are in the same lines
+    for (int ty = min_y / FRAME_TILE; ty <= max_y / FRAME_TILE; ty++)
+    {
+        const int y0 = max(ty * FRAME_TILE, min_y);
+        const int y1 = min(ty * FRAME_TILE + FRAME_TILE - 1, max_y);
+
+        for (int tx = min_x / FRAME_TILE; tx <= max_x / FRAME_TILE; tx++)
+        {
+            FrameTile* tile = tiles + ty * tiles_x + tx;
+            const int x0 = max(tx * FRAME_TILE, min_x);
+            const int x1 = min(tx * FRAME_TILE + FRAME_TILE - 1, max_x);
+
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    const int s1 = p1_p2_y_diff * x - p1_p2_x_diff * y + p2_p1_cross;
+                    const int s2 = p2_p3_y_diff * x - p2_p3_x_diff * y + p3_p2_cross;
+                    const int s3 = p3_p1_y_diff * x - p3_p1_x_diff * y + p1_p3_cross;
+
+                    if (((s1 > 0) && (s2 > 0) && (s3 > 0)) || ((s1 <= 0) && (s2 <= 0) && (s3 <= 0)))
+                    {
+                        const float depth = (p1z * s2 + p2z * s3 + p3z * s1) * inv_area;
+                        const int i = (y % FRAME_TILE) * FRAME_TILE + x % FRAME_TILE;
+
+                        if (depth < tile->depth[i])
+                        {
+                            tile->color[i][0] = R;
+                            tile->color[i][1] = G;
+                            tile->color[i][2] = B;
+                            tile->depth[i] = depth;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Copy a tile from or to the pixels of the linear buffers from lx0, ly0 to
+// lx1, ly1 inclusive inside it, pixels and depth point to its first pixel
+static void copy_frame_tile_part(FrameTile* tile,
+                                 uint8_t* pixels, int bs_x, int bs_y, int bs_c,
+                                 float* depth, int ds_x, int ds_y,
+                                 int lx0, int ly0, int lx1, int ly1, int store) {
+    for (int lx = lx0; lx <= lx1; lx++)
+    {
+        for (int ly = ly0; ly <= ly1; ly++)
+        {
+            const int i = ly * FRAME_TILE + lx;
+            uint8_t* pixel = pixels + lx * bs_x + ly * bs_y;
+            float* pixel_depth = depth + lx * ds_x + ly * ds_y;
+
+            if (store)
+            {
+                tile->color[i][0] = pixel[0];
+                tile->color[i][1] = pixel[bs_c];
+                tile->color[i][2] = pixel[bs_c + bs_c];
+                tile->depth[i] = *pixel_depth;
+            }
+            else
+            {
+                pixel[0] = tile->color[i][0];
+                pixel[bs_c] = tile->color[i][1];
+                pixel[bs_c + bs_c] = tile->color[i][2];
+                *pixel_depth = tile->depth[i];
+            }
+        }
+    }
+}
+
+// Whole tile of the pygame layout, a column of the tile is 4 packed RGB
+// pixels and 4 contiguous depths, the depths are transposed as 4 vectors
+static inline void load_frame_tile(const FrameTile* tile, uint8_t* pixels, int bs_x,
+                                   float* depth, int ds_x) {
+    // RGBX pixels stored 4 bytes at a time, each one overwriting the X of
+    // the previous one, the last one of the column is stored as 3 bytes
+    for (int lx = 0; lx < FRAME_TILE; lx++)
+    {
+        uint8_t* column = pixels + lx * bs_x;
+
+        for (int ly = 0; ly < FRAME_TILE - 1; ly++)
+            memcpy(column + 3 * ly, tile->color[ly * FRAME_TILE + lx], 4);
+
+        memcpy(column + 3 * (FRAME_TILE - 1), tile->color[(FRAME_TILE - 1) * FRAME_TILE + lx], 3);
+    }
+
+#if defined(__GNUC__)
+    lanes_f rows[FRAME_TILE];
+    memcpy(rows, tile->depth, sizeof(rows));
+
+    for (int lx = 0; lx < FRAME_TILE; lx++)
+    {
+        const lanes_f column = {rows[0][lx], rows[1][lx], rows[2][lx], rows[3][lx]};
+        memcpy(depth + lx * ds_x, &column, sizeof(column));
+    }
+#else
+    for (int lx = 0; lx < FRAME_TILE; lx++)
+        for (int ly = 0; ly < FRAME_TILE; ly++)
+            depth[lx * ds_x + ly] = tile->depth[ly * FRAME_TILE + lx];
+#endif
+}
+
+static inline void store_frame_tile(FrameTile* tile, const uint8_t* pixels, int bs_x,
+                                    const float* depth, int ds_x) {
+    for (int lx = 0; lx < FRAME_TILE; lx++)
+    {
+        const uint8_t* column = pixels + lx * bs_x;
+
+        for (int ly = 0; ly < FRAME_TILE; ly++)
+        {
+            uint8_t* color = tile->color[ly * FRAME_TILE + lx];
+            color[0] = column[3 * ly];
+            color[1] = column[3 * ly + 1];
+            color[2] = column[3 * ly + 2];
+        }
+    }
+
+#if defined(__GNUC__)
+    lanes_f columns[FRAME_TILE];
+
+    for (int lx = 0; lx < FRAME_TILE; lx++)
+        memcpy(&columns[lx], depth + lx * ds_x, sizeof(columns[lx]));
+
+    for (int ly = 0; ly < FRAME_TILE; ly++)
+    {
+        const lanes_f row = {columns[0][ly], columns[1][ly], columns[2][ly], columns[3][ly]};
+        memcpy(tile->depth + ly * FRAME_TILE, &row, sizeof(row));
+    }
+#else
+    for (int lx = 0; lx < FRAME_TILE; lx++)
+        for (int ly = 0; ly < FRAME_TILE; ly++)
+            tile->depth[ly * FRAME_TILE + lx] = depth[lx * ds_x + ly];
+#endif
+}
+
+// Copy between the tiles and the linear color and depth buffers, inside a rectangle
+static void copy_frame_tiles(FrameTile* tiles, int tiles_x,
+                             uint8_t* buffer, int bs_x, int bs_y, int bs_c,
+                             float* depth_buffer, int ds_x, int ds_y,
+                             int x0, int y0, int x1, int y1,
+                             int w, int h, int store) {
+    x0 = max(x0, 0);
+    y0 = max(y0, 0);
+    x1 = min(x1, w - 1);
+    y1 = min(y1, h - 1);
+
+    if (x0 > x1 || y0 > y1) return;
+
+    ds_x /= (int) sizeof(float);
+    ds_y /= (int) sizeof(float);
+
+    // the whole tiles of the pygame layout take the unrolled copies
+    const int packed = bs_c == 1 && bs_y == 3 && ds_y == 1;
+
+    for (int ty = y0 / FRAME_TILE; ty <= y1 / FRAME_TILE; ty++)
+    {
+        const int top = ty * FRAME_TILE;
+        const int ly0 = max(y0 - top, 0);
+        const int ly1 = min(y1 - top, FRAME_TILE - 1);
+        FrameTile* row = tiles + ty * tiles_x;
+
+        for (int tx = x0 / FRAME_TILE; tx <= x1 / FRAME_TILE; tx++)
+        {
+            const int left = tx * FRAME_TILE;
+            const int lx0 = max(x0 - left, 0);
+            const int lx1 = min(x1 - left, FRAME_TILE - 1);
+            uint8_t* pixels = buffer + left * bs_x + top * bs_y;
+            float* depth = depth_buffer + left * ds_x + top * ds_y;
+
+            if (packed && lx0 == 0 && ly0 == 0 &&
+                lx1 == FRAME_TILE - 1 && ly1 == FRAME_TILE - 1)
+            {
+                if (store)
+                    store_frame_tile(row + tx, pixels, bs_x, depth, ds_x);
+                else
+                    load_frame_tile(row + tx, pixels, bs_x, depth, ds_x);
+            }
+            else
+            {
+                copy_frame_tile_part(row + tx, pixels, bs_x, bs_y, bs_c, depth, ds_x, ds_y,
+                                     lx0, ly0, lx1, ly1, store);
+            }
+        }
+    }
+}
+
+// Same as draw_triangle on a target of 1 byte palette indices or 2 bytes RGB565 values
+static void draw_triangle_packed(uint8_t* target, int ts_x, int ts_y, int bpp,
+                                 float* depth_buffer, int ds_x, int ds_y,
+                                 float p1xf, float p1yf, float p1z,
+                                 float p2xf, float p2yf, float p2z,
+                                 float p3xf, float p3yf, float p3z,
+                                 uint16_t value, int w, int h) {
+
+    const int p1x = (int) p1xf;
+    const int p2x = (int) p2xf;
+    const int p3x = (int) p3xf;
+    const int p1y = (int) p1yf;
+    const int p2y = (int) p2yf;
+    const int p3y = (int) p3yf;
+
+    const int min_x = max(min(min(p1x, p2x), p3x), 0);
+    const int max_x = min(max(max(p1x, p2x), p3x), w - 1);
+    const int min_y = max(min(min(p1y, p2y), p3y), 0);
+    const int max_y = min(max(max(p1y, p2y), p3y), h - 1);
+
+    if (min_x > max_x + 1 || min_y > max_y + 1) return;
+
+    const int p1_p2_x_diff = p1x - p2x;
+    const int p2_p3_x_diff = p2x - p3x;
+    const int p3_p1_x_diff = p3x - p1x;
+    const int p1_p2_y_diff = p1y - p2y;
+    const int p2_p3_y_diff = p2y - p3y;
+    const int p3_p1_y_diff = p3y - p1y;
+    const int p2_p1_cross = p1_p2_x_diff * p2y - p1_p2_y_diff * p2x;
+    const int p3_p2_cross = p2_p3_x_diff * p3y - p2_p3_y_diff * p3x;
+    const int p1_p3_cross = p3_p1_x_diff * p1y - p3_p1_y_diff * p1x;
+
+    int area = p3_p1_y_diff * p2_p3_x_diff - p3_p1_x_diff * p2_p3_y_diff;
+
+    if (area == 0) return;
+
+    const float inv_area = 1.0f / area;
+
+    for (int y = min_y; y <= max_y; y++)
+    {
+        for (int x = min_x; x <= max_x; x++)
+        {
+            const int s1 = p1_p2_y_diff * x - p1_p2_x_diff * y + p2_p1_cross;
+            const int s2 = p2_p3_y_diff * x - p2_p3_x_diff * y + p3_p2_cross;
+            const int s3 = p3_p1_y_diff * x - p3_p1_x_diff * y + p1_p3_cross;
+
+            if (((s1 > 0) && (s2 > 0) && (s3 > 0)) || ((s1 <= 0) && (s2 <= 0) && (s3 <= 0)))
+            {
+                const float depth = (p1z * s2 + p2z * s3 + p3z * s1) * inv_area;
+                const int depth_offset = (x * ds_x + y * ds_y) / sizeof(float);
+
+                if (depth < depth_buffer[depth_offset])
+                {
+                    uint8_t* pixel = target + x * ts_x + y * ts_y;
+
+                    if (bpp == 1) *pixel = (uint8_t) value;
+                    else *(uint16_t*) pixel = value;
+
+                    depth_buffer[depth_offset] = depth;
+                }
+            }
+        }
+    }
+}
+
+// Expand a rectangle of a packed target on the pygame buffer, with the palette if given
+static void expand_packed(const uint8_t* target, int ts_x, int ts_y, int bpp,
+                          const uint8_t* palette,
+                          uint8_t* buffer, int bs_x, int bs_y, int bs_c,
+                          int x0, int y0, int x1, int y1, int w, int h) {
+    x0 = max(x0, 0);
+    y0 = max(y0, 0);
+    x1 = min(x1, w - 1);
+    y1 = min(y1, h - 1);
+
+    for (int x = x0; x <= x1; x++)
+    {
+        for (int y = y0; y <= y1; y++)
+        {
+            const uint8_t* pixel = target + x * ts_x + y * ts_y;
+            uint8_t* out = buffer + x * bs_x + y * bs_y;
+
+            if (bpp == 1)
+            {
+                const uint8_t* color = palette + 3 * *pixel;
+                out[0] = color[0];
+                out[bs_c] = color[1];
+                out[bs_c + bs_c] = color[2];
+            }
+            else
+            {
+                const uint16_t value = *(const uint16_t*) pixel;
+                const uint8_t r = value >> 11;
+                const uint8_t g = (value >> 5) & 63;
+                const uint8_t b = value & 31;
+                out[0] = (r << 3) | (r >> 2);
+                out[bs_c] = (g << 2) | (g >> 4);
+                out[bs_c + bs_c] = (b << 3) | (b >> 2);
+            }
+        }
+    }
+}
+
+static inline float pixel_luma(const uint8_t* pixel, int s_c) {
+    return (0.299f * pixel[0] + 0.587f * pixel[s_c] + 0.114f * pixel[s_c + s_c]) / 255.0f;
+}
+
+// Luma of the rows y0 - FXAA_SEARCH_STEPS to y1 + FXAA_SEARCH_STEPS excluded and of
+// the columns as far out of the buffer, clamped to its edges, one column of rows
+// values after the other, so that fxaa reads it without testing the bounds
+static void fxaa_luma(const uint8_t* src, int s_x, int s_y, int s_c,
+                      float* luma, int rows, int w, int h, int y0, int y1) {
+    const int top = max(y0 - FXAA_SEARCH_STEPS, 0) - y0 + FXAA_SEARCH_STEPS;
+    const int bottom = min(y1 + FXAA_SEARCH_STEPS, h) - y0 + FXAA_SEARCH_STEPS;
+
+    for (int x = 0; x < w; x++)
+    {
+        const uint8_t* column = src + x * s_x + (y0 - FXAA_SEARCH_STEPS) * s_y;
+        float* out = luma + (x + FXAA_SEARCH_STEPS) * rows;
+
+        for (int i = top; i < bottom; i++)
+            out[i] = pixel_luma(column + i * s_y, s_c);
+
+        for (int i = 0; i < top; i++)
+            out[i] = out[top];
+
+        for (int i = bottom; i < rows; i++)
+            out[i] = out[bottom - 1];
+    }
+
+    for (int x = 0; x < FXAA_SEARCH_STEPS; x++)
+    {
+        memcpy(luma + x * rows, luma + FXAA_SEARCH_STEPS * rows, rows * sizeof(float));
+        memcpy(luma + (w + FXAA_SEARCH_STEPS + x) * rows,
+               luma + (w + FXAA_SEARCH_STEPS - 1) * rows, rows * sizeof(float));
+    }
+}
+
+// FXAA on the rows from y0 to y1 excluded, reading a copy of the buffer in src.
+// The luma of the band is computed once, then each column is tested for contrast
+// in a loop without branches and only the pixels on an edge are searched and
+// blended. Returns -1 if the luma cannot be allocated.
+static int fxaa(const uint8_t* src, int s_x, int s_y, int s_c,
+                uint8_t* dst, int d_x, int d_y, int d_c,
+                float threshold, float threshold_min, float subpixel,
+                int w, int h, int y0, int y1) {
+    const int rows = y1 - y0 + 2 * FXAA_SEARCH_STEPS;
+    float* luma = PyMem_RawMalloc(((size_t) (w + 2 * FXAA_SEARCH_STEPS) * rows + rows) * sizeof(float));
+
+    if (luma == NULL) return -1;
+
+    // edge flag then index of the edge pixels of a column
+    int32_t* edges = (int32_t*) (luma + (size_t) (w + 2 * FXAA_SEARCH_STEPS) * rows);
+    fxaa_luma(src, s_x, s_y, s_c, luma, rows, w, h, y0, y1);
+
+    for (int x = 0; x < w; x++)
+    {
+        // luma of the pixel (x, y0), of the pixel (x + dx, y0 + dy) at dx * rows + dy
+        const float* center = luma + (x + FXAA_SEARCH_STEPS) * rows + FXAA_SEARCH_STEPS;
+        const float* west = center - rows;
+        const float* east = center + rows;
+        int count = 0;
+
+        for (int i = 0; i < y1 - y0; i++)
+        {
+            const float l_max = max(max(max(center[i - 1], center[i + 1]), max(west[i], east[i])), center[i]);
+            const float l_min = min(min(min(center[i - 1], center[i + 1]), min(west[i], east[i])), center[i]);
+            edges[i] = l_max - l_min >= max(threshold_min, l_max * threshold);
+        }
+
+        for (int i = 0; i < y1 - y0; i++)
+        {
+            const int edge = edges[i];
+            edges[count] = i;
+            count += edge;
+        }
+
+        for (int k = 0; k < count; k++)
+        {
+            const int i = edges[k];
+            const int y = y0 + i;
+            const float* l = center + i;
+            const float lm = l[0];
+            const float ln = l[- 1];
+            const float ls = l[1];
+            const float lw = l[- rows];
+            const float le = l[rows];
+            const float l_max = fmaxf(fmaxf(fmaxf(ln, ls), fmaxf(lw, le)), lm);
+            const float l_min = fminf(fminf(fminf(ln, ls), fminf(lw, le)), lm);
+            const float range = l_max - l_min;
+
+            const float lnw = l[- rows - 1];
+            const float lne = l[rows - 1];
+            const float lsw = l[- rows + 1];
+            const float lse = l[rows + 1];
+
+            const float edge_vert = fabsf(0.25f * lnw - 0.5f * ln + 0.25f * lne) +
+                                    fabsf(0.5f * lw - lm + 0.5f * le) +
+                                    fabsf(0.25f * lsw - 0.5f * ls + 0.25f * lse);
+            const float edge_horz = fabsf(0.25f * lnw - 0.5f * lw + 0.25f * lsw) +
+                                    fabsf(0.5f * ln - lm + 0.5f * ls) +
+                                    fabsf(0.25f * lne - 0.5f * le + 0.25f * lse);
+            const int horizontal = edge_horz >= edge_vert;
+
+            // Neighbour across the edge and step along it, as offsets in the luma
+            const float l1 = horizontal ? ln : lw;
+            const float l2 = horizontal ? ls : le;
+            const float grad1 = fabsf(l1 - lm);
+            const float grad2 = fabsf(l2 - lm);
+            const int negative = grad1 >= grad2;
+            const int nx = horizontal ? 0 : (negative ? -1 : 1);
+            const int ny = horizontal ? (negative ? -1 : 1) : 0;
+            const int across = nx * rows + ny;
+            const int along = horizontal ? rows : 1;
+            const float l_local = 0.5f * ((negative ? l1 : l2) + lm);
+            const float grad_scaled = 0.25f * fmaxf(grad1, grad2);
+
+            // Walk both ends of the edge on the boundary between the two rows of pixels
+            float end1 = 0.0f, end2 = 0.0f;
+            int dist1 = FXAA_SEARCH_STEPS, dist2 = FXAA_SEARCH_STEPS;
+
+            for (int s = 1; s <= FXAA_SEARCH_STEPS; s++)
+            {
+                end1 = 0.5f * (l[- s * along] + l[- s * along + across]) - l_local;
+
+                if (fabsf(end1) >= grad_scaled)
+                {
+                    dist1 = s;
+                    break;
+                }
+            }
+
+            for (int s = 1; s <= FXAA_SEARCH_STEPS; s++)
+            {
+                end2 = 0.5f * (l[s * along] + l[s * along + across]) - l_local;
+
+                if (fabsf(end2) >= grad_scaled)
+                {
+                    dist2 = s;
+                    break;
+                }
+            }
+
+            const float length = (float) (dist1 + dist2);
+            const float end = dist1 < dist2 ? end1 : end2;
+            float blend = 0.0f;
+
+            if ((end < 0.0f) != (lm < l_local))
+                blend = 0.5f - (float) min(dist1, dist2) / length;
+
+            const float average = (2.0f * (ln + ls + lw + le) + lnw + lne + lsw + lse) / 12.0f;
+            float sub = fminf(fabsf(average - lm) / range, 1.0f);
+            sub = (- 2.0f * sub + 3.0f) * sub * sub;
+            blend = fmaxf(blend, sub * sub * subpixel);
+
+            const uint8_t* pixel = src + x * s_x + y * s_y;
+            const uint8_t* other = src + min(max(x + nx, 0), w - 1) * s_x + min(max(y + ny, 0), h - 1) * s_y;
+            uint8_t* out = dst + x * d_x + y * d_y;
+
+            for (int c = 0; c < 3; c++)
+                out[c * d_c] = (uint8_t) (pixel[c * s_c] + blend * (other[c * s_c] - pixel[c * s_c]) + 0.5f);
+        }
+    }
+
+    PyMem_RawFree(luma);
+
+    return 0;
+}
+
+// Fill the pixels with (x + y) % 2 != parity, not drawn this frame, from the previous frame
+static void reconstruct_checker(uint8_t* buffer, int bs_x, int bs_y, int bs_c,
+                                float* depth_buffer, int ds_x, int ds_y,
+                                const uint8_t* prev, int ps_x, int ps_y, int ps_c,
+                                const float* prev_depth, int pds_x, int pds_y,
+                                const float* reproject,
+                                float af, float f, float q, float znear, float zfar,
+                                float tolerance, int parity, int w, int h) {
+    for (int x = 0; x < w; x++)
+    {
+        for (int y = (x + parity + 1) & 1; y < h; y += 2)
+        {
+            const int xl = x > 0 ? x - 1 : x + 1;
+            const int xr = x < w - 1 ? x + 1 : x - 1;
+            const int yu = y > 0 ? y - 1 : y + 1;
+            const int yd = y < h - 1 ? y + 1 : y - 1;
+            const uint8_t* left = buffer + xl * bs_x + y * bs_y;
+            const uint8_t* right = buffer + xr * bs_x + y * bs_y;
+            const uint8_t* up = buffer + x * bs_x + yu * bs_y;
+            const uint8_t* down = buffer + x * bs_x + yd * bs_y;
+            const float depth = fminf(fminf(depth_buffer[(xl * ds_x + y * ds_y) / sizeof(float)],
+                                            depth_buffer[(xr * ds_x + y * ds_y) / sizeof(float)]),
+                                      fminf(depth_buffer[(x * ds_x + yu * ds_y) / sizeof(float)],
+                                            depth_buffer[(x * ds_x + yd * ds_y) / sizeof(float)]));
+            uint8_t* out = buffer + x * bs_x + y * bs_y;
+            depth_buffer[(x * ds_x + y * ds_y) / sizeof(float)] = depth;
+
+            if (prev && depth < zfar)
+            {
+                // Back to view space with the depth of the nearest neighbour, then to the previous view
+                const float z = depth / q + znear;
+                const float vx = (2.0f * x / w - 1.0f) * z / af;
+                const float vy = - (2.0f * y / h - 1.0f) * z / f;
+                const float px = reproject[0] * vx + reproject[1] * vy + reproject[2] * z + reproject[3];
+                const float py = reproject[4] * vx + reproject[5] * vy + reproject[6] * z + reproject[7];
+                const float pz = reproject[8] * vx + reproject[9] * vy + reproject[10] * z + reproject[11];
+
+                if (pz > znear)
+                {
+                    const int sx = (int) floorf((af * px / pz + 1.0f) / 2.0f * w + 0.5f);
+                    const int sy = (int) floorf((- f * py / pz + 1.0f) / 2.0f * h + 0.5f);
+                    const float expected = q * (pz - znear);
+
+                    if (sx >= 0 && sx < w && sy >= 0 && sy < h &&
+                        fabsf(prev_depth[(sx * pds_x + sy * pds_y) / sizeof(float)] - expected) <= tolerance * expected)
+                    {
+                        const uint8_t* color = prev + sx * ps_x + sy * ps_y;
+                        out[0] = color[0];
+                        out[bs_c] = color[ps_c];
+                        out[bs_c + bs_c] = color[ps_c + ps_c];
+                        continue;
+                    }
+                }
+            }
+
+            // Average the pair of neighbours with the smaller difference, along the edge
+            int dh = 0, dv = 0;
+
+            for (int c = 0; c < 3; c++)
+            {
+                dh += abs(left[c * bs_c] - right[c * bs_c]);
+                dv += abs(up[c * bs_c] - down[c * bs_c]);
+            }
+
+            const uint8_t* a = dh <= dv ? left : up;
+            const uint8_t* b = dh <= dv ? right : down;
+
+            for (int c = 0; c < 3; c++)
+                out[c * bs_c] = (uint8_t) ((a[c * bs_c] + b[c * bs_c] + 1) / 2);
+        }
+    }
+}
+
+static inline float tonemap(float x, int mode, float white) {
+    if (mode == TONEMAP_REINHARD) x = x * (1.0f + x / (white * white)) / (1.0f + x);
+    else if (mode == TONEMAP_ACES) x = x * (2.51f * x + 0.03f) / (x * (2.43f * x + 0.59f) + 0.14f);
+
+    return fminf(fmaxf(x, 0.0f), 1.0f);
+}
+
+// Trilinear lookup in a n x n x n RGB table indexed as [r][g][b], the color is in [0, 1]
+static void grade(const uint8_t* lut, int n, float* color) {
+    float t[3];
+    int i0[3], i1[3];
+
+    for (int c = 0; c < 3; c++)
+    {
+        const float p = color[c] * (n - 1);
+        i0[c] = min((int) p, n - 2);
+        i1[c] = i0[c] + 1;
+        t[c] = p - i0[c];
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+        float value = 0.0f;
+
+        for (int corner = 0; corner < 8; corner++)
+        {
+            const int r = corner & 1 ? i1[0] : i0[0];
+            const int g = corner & 2 ? i1[1] : i0[1];
+            const int b = corner & 4 ? i1[2] : i0[2];
+            const float weight = (corner & 1 ? t[0] : 1.0f - t[0]) *
+                                 (corner & 2 ? t[1] : 1.0f - t[1]) *
+                                 (corner & 4 ? t[2] : 1.0f - t[2]);
+            value += weight * lut[((r * n + g) * n + b) * 3 + c];
+        }
+
+        color[c] = value / 255.0f;
+    }
+}
+
+// Fog, tonemap and color grading in a single pass on the rows from y0 to y1 excluded
+static void post_chain(uint8_t* buffer, int bs_x, int bs_y, int bs_c,
+                       const float* depth_buffer, int ds_x, int ds_y,
+                       const PostParams* params, const uint8_t* lut, int lut_size,
+                       int w, int h, int y0, int y1) {
+    const int fog_mode = (int) params->fog_mode;
+    const int tonemap_mode = (int) params->tonemap_mode;
+
+    for (int x = 0; x < w; x++)
+    {
+        for (int y = y0; y < min(y1, h); y++)
+        {
+            uint8_t* pixel = buffer + x * bs_x + y * bs_y;
+            float color[3] = {pixel[0] / 255.0f, pixel[bs_c] / 255.0f, pixel[bs_c + bs_c] / 255.0f};
+
+            if (fog_mode)
+            {
+                const float z = depth_buffer[(x * ds_x + y * ds_y) / sizeof(float)] / params->q + params->znear;
+                float fog;
+
+                if (fog_mode == FOG_EXP) fog = 1.0f - expf(- params->fog_density * fmaxf(z - params->fog_start, 0.0f));
+                else fog = (z - params->fog_start) / (params->fog_end - params->fog_start);
+
+                fog = fminf(fmaxf(fog, 0.0f), 1.0f);
+
+                for (int c = 0; c < 3; c++)
+                    color[c] += fog * (params->fog_color[c] / 255.0f - color[c]);
+            }
+
+            if (tonemap_mode)
+            {
+                for (int c = 0; c < 3; c++)
+                    color[c] = tonemap(color[c] * params->exposure, tonemap_mode, params->white);
+            }
+
+            if (lut) grade(lut, lut_size, color);
+
+            for (int c = 0; c < 3; c++)
+                pixel[c * bs_c] = (uint8_t) (color[c] * 255.0f + 0.5f);
+        }
+    }
+}
+
+// Same as draw_triangle, also writing object id, view depth, normal and motion of the face
+static void draw_triangle_gbuffer(uint8_t* buffer, int bs_x, int bs_y, int bs_c,
+                                  float* depth_buffer, int ds_x, int ds_y,
+                                  int32_t* ids, int is_x, int is_y,
+                                  float* linear, int ls_x, int ls_y,
+                                  float* normals, int ns_x, int ns_y, int ns_c,
+                                  float* motion, int ms_x, int ms_y, int ms_c,
+                                  int32_t id, const float* normal, const float* vertex_motion,
+                                  float q, float znear,
+                                  float p1xf, float p1yf, float p1z,
+                                  float p2xf, float p2yf, float p2z,
+                                  float p3xf, float p3yf, float p3z,
+                                  uint8_t R, uint8_t G, uint8_t B,
+                                  int w, int h) {
+
+    const int p1x = (int) p1xf;
+    const int p2x = (int) p2xf;
+    const int p3x = (int) p3xf;
+    const int p1y = (int) p1yf;
+    const int p2y = (int) p2yf;
+    const int p3y = (int) p3yf;
+
+    const int min_x = max(min(min(p1x, p2x), p3x), 0);
+    const int max_x = min(max(max(p1x, p2x), p3x), w - 1);
+    const int min_y = max(min(min(p1y, p2y), p3y), 0);
+    const int max_y = min(max(max(p1y, p2y), p3y), h - 1);
+
+    if (min_x > max_x + 1 || min_y > max_y + 1) return;
+
+    const int p1_p2_x_diff = p1x - p2x;
+    const int p2_p3_x_diff = p2x - p3x;
+    const int p3_p1_x_diff = p3x - p1x;
+    const int p1_p2_y_diff = p1y - p2y;
+    const int p2_p3_y_diff = p2y - p3y;
+    const int p3_p1_y_diff = p3y - p1y;
+    const int p2_p1_cross = p1_p2_x_diff * p2y - p1_p2_y_diff * p2x;
+    const int p3_p2_cross = p2_p3_x_diff * p3y - p2_p3_y_diff * p3x;
+    const int p1_p3_cross = p3_p1_x_diff * p1y - p3_p1_y_diff * p1x;
+
+    int area = p3_p1_y_diff * p2_p3_x_diff - p3_p1_x_diff * p2_p3_y_diff;
+
+    if (area == 0) return;
+
+    const float inv_area = 1.0f / area;
+
+    // The depth buffer is linear in screen space, the view depth is not: 1 / z
+    // is, and the view depth and the motion are interpolated with it
+    const float inv_z1 = 1.0f / (p1z / q + znear);
+    const float inv_z2 = 1.0f / (p2z / q + znear);
+    const float inv_z3 = 1.0f / (p3z / q + znear);
+
+    for (int y = min_y; y <= max_y; y++)
+    {
+        for (int x = min_x; x <= max_x; x++)
+        {
+            const int s1 = p1_p2_y_diff * x - p1_p2_x_diff * y + p2_p1_cross;
+            const int s2 = p2_p3_y_diff * x - p2_p3_x_diff * y + p3_p2_cross;
+            const int s3 = p3_p1_y_diff * x - p3_p1_x_diff * y + p1_p3_cross;
+
+            if (((s1 > 0) && (s2 > 0) && (s3 > 0)) || ((s1 <= 0) && (s2 <= 0) && (s3 <= 0)))
+            {
+                const float depth = (p1z * s2 + p2z * s3 + p3z * s1) * inv_area;
+                const int depth_offset = (x * ds_x + y * ds_y) / sizeof(float);
+
+                if (depth < depth_buffer[depth_offset])
+                {
+                    const int offset = x * bs_x + y * bs_y;
+                    buffer[offset] = R;
+                    buffer[offset + bs_c] = G;
+                    buffer[offset + bs_c + bs_c] = B;
+                    depth_buffer[depth_offset] = depth;
+
+                    // weights of the vertices corrected for the perspective
+                    const float w1 = s2 * inv_z1;
+                    const float w2 = s3 * inv_z2;
+                    const float w3 = s1 * inv_z3;
+                    const float inv_sum = 1.0f / (w1 + w2 + w3);
+
+                    ids[(x * is_x + y * is_y) / sizeof(int32_t)] = id;
+                    linear[(x * ls_x + y * ls_y) / sizeof(float)] = area * inv_sum;
+
+                    float* n = normals + (x * ns_x + y * ns_y) / sizeof(float);
+                    float* m = motion + (x * ms_x + y * ms_y) / sizeof(float);
+
+                    for (int c = 0; c < 3; c++)
+                        n[c * ns_c / sizeof(float)] = normal[c];
+
+                    for (int c = 0; c < 2; c++)
+                        m[c * ms_c / sizeof(float)] = (vertex_motion[c] * w1 + vertex_motion[2 + c] * w2 +
+                                                       vertex_motion[4 + c] * w3) * inv_sum;
+                }
+            }
+        }
+    }
+}
+
+static void fill_bg(uint8_t* buffer,
+                    int bs_x, int bs_y, int bs_c,
+                    uint8_t R, uint8_t G, uint8_t B,
+                    int w, int h) {
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            int offset = x * bs_x + y * bs_y;
+            buffer[offset] = R;
+            buffer[offset + bs_c] = G;
+            buffer[offset + bs_c + bs_c] = B;
+        }
+    }
+}
+
+static void draw_sprite(uint8_t* buffer,
+                        int bs_x, int bs_y, int bs_c,
+                        float* depth_buffer,
+                        int ds_x, int ds_y,
+                        const uint8_t* sprite,
+                        int ss_x, int ss_y, int ss_c,
+                        const float* sprite_depth,
+                        int sds_x, int sds_y,
+                        int sw, int sh, float empty,
+                        float x0, float y0, float size, float depth_offset,
+                        int w, int h) {
+
+    const int min_x = max((int) x0, 0);
+    const int max_x = min((int) (x0 + size), w - 1);
+    const int min_y = max((int) y0, 0);
+    const int max_y = min((int) (y0 + size), h - 1);
+    const float scale_x = sw / size;
+    const float scale_y = sh / size;
+
+    for (int y = min_y; y <= max_y; y++)
+    {
+        const int sy = min((int) ((y - y0) * scale_y), sh - 1);
+
+        for (int x = min_x; x <= max_x; x++)
+        {
+            const int sx = min((int) ((x - x0) * scale_x), sw - 1);
+            const float sprite_z = sprite_depth[(sx * sds_x + sy * sds_y) / sizeof(float)];
+
+            if (sprite_z >= empty) continue;
+
+            const float depth = sprite_z + depth_offset;
+            const int depth_offest = (x * ds_x + y * ds_y) / sizeof(float);
+
+            if (depth < depth_buffer[depth_offest])
+            {
+                const int offset = x * bs_x + y * bs_y;
+                const int sprite_offset = sx * ss_x + sy * ss_y;
+                buffer[offset] = sprite[sprite_offset];
+                buffer[offset + bs_c] = sprite[sprite_offset + ss_c];
+                buffer[offset + bs_c + bs_c] = sprite[sprite_offset + ss_c + ss_c];
+                depth_buffer[depth_offest] = depth;
+            }
+        }
+    }
+}
+
+static void build_hiz(const float* src, int s_x, int s_y, int sw, int sh,
+                      float* dst, int dw, int dh) {
+    for (int x = 0; x < dw; x++)
+    {
+        const int x0 = min(2 * x, sw - 1);
+        const int x1 = min(2 * x + 1, sw - 1);
+
+        for (int y = 0; y < dh; y++)
+        {
+            const int y0 = min(2 * y, sh - 1);
+            const int y1 = min(2 * y + 1, sh - 1);
+            const float a = src[(x0 * s_x + y0 * s_y) / sizeof(float)];
+            const float b = src[(x1 * s_x + y0 * s_y) / sizeof(float)];
+            const float c = src[(x0 * s_x + y1 * s_y) / sizeof(float)];
+            const float d = src[(x1 * s_x + y1 * s_y) / sizeof(float)];
+
+            dst[x * dh + y] = max(max(a, b), max(c, d));
+        }
+    }
+}
+
+static void set_transforms(const int64_t* handles, int n,
+                           const double* positions, const double* rotations,
+                           double* scene_positions, double* scene_rotations,
+                           uint8_t* dirty) {
+    for (int i = 0; i < n; i++)
+    {
+        const int64_t handle = handles[i];
+
+        if (positions)
+        {
+            scene_positions[handle * 3] = positions[i * 3];
+            scene_positions[handle * 3 + 1] = positions[i * 3 + 1];
+            scene_positions[handle * 3 + 2] = positions[i * 3 + 2];
+            dirty[handle] |= DIRTY_POS;
+        }
+
+        if (rotations)
+        {
+            scene_rotations[handle * 4] = rotations[i * 4];
+            scene_rotations[handle * 4 + 1] = rotations[i * 4 + 1];
+            scene_rotations[handle * 4 + 2] = rotations[i * 4 + 2];
+            scene_rotations[handle * 4 + 3] = rotations[i * 4 + 3];
+            dirty[handle] |= DIRTY_ROT;
+        }
+    }
+}
+
+static void triangle_centroid(const float* vertices, const int32_t* faces,
+                              int32_t tri, float* centroid) {
+    const float* a = vertices + faces[tri * 3] * 3;
+    const float* b = vertices + faces[tri * 3 + 1] * 3;
+    const float* c = vertices + faces[tri * 3 + 2] * 3;
+
+    for (int k = 0; k < 3; k++)
+        centroid[k] = (a[k] + b[k] + c[k]) / 3.0f;
+}
+
+static int build_bvh(const float* vertices, const int32_t* faces, int n_faces,
+                     BVHNode* nodes, int32_t* indices) {
+    int stack[BVH_STACK_SIZE];
+    int depths[BVH_STACK_SIZE];
+    int top = 0;
+    int n_nodes = 1;
+    float centroid[3];
+
+    for (int i = 0; i < n_faces; i++)
+        indices[i] = i;
+
+    nodes[0].start = 0;
+    nodes[0].count = n_faces;
+    stack[top] = 0;
+    depths[top++] = 0;
+
+    while (top > 0)
+    {
+        BVHNode* node = nodes + stack[--top];
+        const int depth = depths[top];
+        const int start = node->start;
+        const int count = node->count;
+        float cmin[3] = {INFINITY, INFINITY, INFINITY};
+        float cmax[3] = {-INFINITY, -INFINITY, -INFINITY};
+
+        for (int k = 0; k < 3; k++)
+        {
+            node->min[k] = INFINITY;
+            node->max[k] = -INFINITY;
+        }
+
+        for (int i = start; i < start + count; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                const float* v = vertices + faces[indices[i] * 3 + j] * 3;
+
+                for (int k = 0; k < 3; k++)
+                {
+                    node->min[k] = min(node->min[k], v[k]);
+                    node->max[k] = max(node->max[k], v[k]);
+                }
+            }
+
+            triangle_centroid(vertices, faces, indices[i], centroid);
+
+            for (int k = 0; k < 3; k++)
+            {
+                cmin[k] = min(cmin[k], centroid[k]);
+                cmax[k] = max(cmax[k], centroid[k]);
+            }
+        }
+
+        // The traversal stack holds at most depth + 1 nodes
+        if (count <= BVH_LEAF_SIZE || depth + 2 >= BVH_STACK_SIZE) continue;
+
+        int axis = 0;
+        if (cmax[1] - cmin[1] > cmax[axis] - cmin[axis]) axis = 1;
+        if (cmax[2] - cmin[2] > cmax[axis] - cmin[axis]) axis = 2;
+
+        const float split = (cmin[axis] + cmax[axis]) / 2.0f;
+        int left = start;
+
+        for (int i = start; i < start + count; i++)
+        {
+            triangle_centroid(vertices, faces, indices[i], centroid);
+
+            if (centroid[axis] < split)
+            {
+                const int32_t tmp = indices[i];
+                indices[i] = indices[left];
+                indices[left] = tmp;
+                left++;
+            }
+        }
+
+        left -= start;
+        if (left == 0 || left == count) left = count / 2;
+
+        nodes[n_nodes].start = start;
+        nodes[n_nodes].count = left;
+        nodes[n_nodes + 1].start = start + left;
+        nodes[n_nodes + 1].count = count - left;
+        node->start = n_nodes;
+        node->count = -1;
+        stack[top] = n_nodes;
+        depths[top++] = depth + 1;
+        stack[top] = n_nodes + 1;
+        depths[top++] = depth + 1;
+        n_nodes += 2;
+    }
+
+    return n_nodes;
+}
+
+static int ray_box(const float* origin, const float* inv_dir,
+                   const BVHNode* node, float t_max) {
+    float t_near = 0.0f;
+    float t_far = t_max;
+
+    for (int k = 0; k < 3; k++)
+    {
+        float t1 = (node->min[k] - origin[k]) * inv_dir[k];
+        float t2 = (node->max[k] - origin[k]) * inv_dir[k];
+
+        t_near = max(t_near, min(t1, t2));
+        t_far = min(t_far, max(t1, t2));
+    }
+
+    return t_near <= t_far;
+}
+
+static int ray_triangle(const float* origin, const float* dir,
+                        const float* a, const float* b, const float* c,
+                        float t_min, float t_max) {
+    const float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    const float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    const float p[3] = {dir[1] * e2[2] - dir[2] * e2[1],
+                        dir[2] * e2[0] - dir[0] * e2[2],
+                        dir[0] * e2[1] - dir[1] * e2[0]};
+    const float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+
+    if (fabsf(det) < 1e-12f) return 0;
+
+    const float inv_det = 1.0f / det;
+    const float s[3] = {origin[0] - a[0], origin[1] - a[1], origin[2] - a[2]};
+    const float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+
+    if (u < 0.0f || u > 1.0f) return 0;
+
+    const float q[3] = {s[1] * e1[2] - s[2] * e1[1],
+                        s[2] * e1[0] - s[0] * e1[2],
+                        s[0] * e1[1] - s[1] * e1[0]};
+    const float v = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * inv_det;
+
+    if (v < 0.0f || u + v > 1.0f) return 0;
+
+    const float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+
+    return t > t_min && t < t_max;
+}
+
+static int ray_occluded(const float* vertices, const int32_t* faces,
+                        const BVHNode* nodes, const int32_t* indices,
+                        const float* origin, const float* dir, float t_max) {
+    const float inv_dir[3] = {1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2]};
+    int stack[BVH_STACK_SIZE];
+    int top = 0;
+
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        const BVHNode* node = nodes + stack[--top];
+
+        if (!ray_box(origin, inv_dir, node, t_max)) continue;
+
+        if (node->count >= 0)
+        {
+            for (int i = node->start; i < node->start + node->count; i++)
+            {
+                const int32_t* face = faces + indices[i] * 3;
+
+                if (ray_triangle(origin, dir,
+                                 vertices + face[0] * 3,
+                                 vertices + face[1] * 3,
+                                 vertices + face[2] * 3,
+                                 0.0f, t_max))
+                    return 1;
+            }
+        }
+        else
+        {
+            stack[top++] = node->start;
+            stack[top++] = node->start + 1;
+        }
+    }
+
+    return 0;
+}
+
+static void bake_ao(const float* vertices, const float* normals,
+                    const int32_t* faces, const BVHNode* nodes,
+                    const int32_t* indices,
+                    int samples, float distance, float bias,
+                    int start, int stop, float* ao) {
+    const float golden = 0.61803398875f;
+
+    for (int i = start; i < stop; i++)
+    {
+        const float* n = normals + i * 3;
+        const float origin[3] = {vertices[i * 3] + n[0] * bias,
+                                 vertices[i * 3 + 1] + n[1] * bias,
+                                 vertices[i * 3 + 2] + n[2] * bias};
+
+        // Tangent frame around the normal
+        float t[3];
+        if (fabsf(n[0]) > 0.9f) { t[0] = 0.0f; t[1] = 1.0f; t[2] = 0.0f; }
+        else { t[0] = 1.0f; t[1] = 0.0f; t[2] = 0.0f; }
+
+        float b[3] = {n[1] * t[2] - n[2] * t[1],
+                      n[2] * t[0] - n[0] * t[2],
+                      n[0] * t[1] - n[1] * t[0]};
+        const float b_len = sqrtf(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+        b[0] /= b_len; b[1] /= b_len; b[2] /= b_len;
+        t[0] = b[1] * n[2] - b[2] * n[1];
+        t[1] = b[2] * n[0] - b[0] * n[2];
+        t[2] = b[0] * n[1] - b[1] * n[0];
+
+        // Cosine weighted hemisphere with a per vertex rotation of the pattern
+        const float offset = (float) ((i * 2654435761u) & 0xffff) / 65536.0f;
+        int hits = 0;
+
+        for (int k = 0; k < samples; k++)
+        {
+            const float u1 = (k + 0.5f) / samples;
+            float u2 = k * golden + offset;
+            u2 -= floorf(u2);
+
+            const float r = sqrtf(u1);
+            const float phi = 6.28318530718f * u2;
+            const float x = r * cosf(phi);
+            const float y = r * sinf(phi);
+            const float z = sqrtf(1.0f - u1);
+            const float dir[3] = {x * t[0] + y * b[0] + z * n[0],
+                                  x * t[1] + y * b[1] + z * n[1],
+                                  x * t[2] + y * b[2] + z * n[2]};
+
+            hits += ray_occluded(vertices, faces, nodes, indices,
+                                 origin, dir, distance);
+        }
+
+        ao[i] = 1.0f - (float) hits / samples;
+    }
+}
+
+// Draw captured triangles with a kernel, the targets and their strides depend on it:
+// REPLAY_TRIANGLE    buffer, depth             bs_x, bs_y, bs_c, ds_x, ds_y, parity
+// REPLAY_SPANS       spans, counts, scratch,   bs_x, bs_y, bs_c, ds_x, ds_y
+//                    buffer, depth
+// REPLAY_DEPTH_TILES buffer, tiles, raw        bs_x, bs_y, bs_c, tiles_x
+// REPLAY_FRAME_TILES tiles                     tiles_x
+// REPLAY_PACKED      target, depth             ts_x, ts_y, bpp, ds_x, ds_y
+static void replay_triangles(int kernel, const CapturedTriangle* triangles, int count,
+                             const uint64_t* targets, const int32_t* params, int w, int h) {
+    for (int i = 0; i < count; i++)
+    {
+        const CapturedTriangle* t = triangles + i;
+
+        switch (kernel)
+        {
+            case REPLAY_TRIANGLE:
+                draw_triangle((uint8_t*) targets[0], params[0], params[1], params[2],
+                              (float*) targets[1], params[3], params[4],
+                              t->p[0], t->p[1], t->p[2], t->p[3], t->p[4],
+                              t->p[5], t->p[6], t->p[7], t->p[8],
+                              t->R, t->G, t->B, w, h, params[5]);
+                break;
+            case REPLAY_SPANS:
+                span_triangle((Span*) targets[0], (int32_t*) targets[1], (Span*) targets[2],
+                              t->p[0], t->p[1], t->p[2], t->p[3], t->p[4],
+                              t->p[5], t->p[6], t->p[7], t->p[8],
+                              t->R, t->G, t->B, w, h);
+                break;
+            case REPLAY_DEPTH_TILES:
+                draw_triangle_tiles((uint8_t*) targets[0], params[0], params[1], params[2],
+                                    (DepthTile*) targets[1], (float*) targets[2], params[3],
+                                    t->p[0], t->p[1], t->p[2], t->p[3], t->p[4],
+                                    t->p[5], t->p[6], t->p[7], t->p[8],
+                                    t->R, t->G, t->B, w, h);
+                break;
+            case REPLAY_FRAME_TILES:
+                draw_triangle_frame((FrameTile*) targets[0], params[0],
+                                    t->p[0], t->p[1], t->p[2], t->p[3], t->p[4],
+                                    t->p[5], t->p[6], t->p[7], t->p[8],
+                                    t->R, t->G, t->B, w, h);
+                break;
+            case REPLAY_PACKED:
+                draw_triangle_packed((uint8_t*) targets[0], params[0], params[1], params[2],
+                                     (float*) targets[1], params[3], params[4],
+                                     t->p[0], t->p[1], t->p[2], t->p[3], t->p[4],
+                                     t->p[5], t->p[6], t->p[7], t->p[8],
+                                     t->value, w, h);
+                break;
+        }
+    }
+
+    // The spans are written to the buffers at the end of the frame
+    if (kernel == REPLAY_SPANS)
+        resolve_spans((const Span*) targets[0], (int32_t*) targets[1],
+                      (uint8_t*) targets[3], params[0], params[1], params[2],
+                      (float*) targets[4], params[3], params[4], w, h);
+}
+
+// Same pixels as draw_triangle, the colors are given by a span shader called on
+// each run of covered pixels of a row before their depth test
+static int draw_triangle_shaded(uint8_t* buffer,
+                                int bs_x, int bs_y, int bs_c,
+                                float* depth_buffer,
+                                int ds_x, int ds_y,
+                                float p1xf, float p1yf, float p1z,
+                                float p2xf, float p2yf, float p2z,
+                                float p3xf, float p3yf, float p3z,
+                                SpanShading* span, const ShaderHooks* hooks,
+                                int w, int h, int parity) {
+
+    const int p1x = (int) p1xf;
+    const int p2x = (int) p2xf;
+    const int p3x = (int) p3xf;
+    const int p1y = (int) p1yf;
+    const int p2y = (int) p2yf;
+    const int p3y = (int) p3yf;
+
+    const int min_x = max(min(min(p1x, p2x), p3x), 0);
+    const int max_x = min(max(max(p1x, p2x), p3x), w - 1);
+    const int min_y = max(min(min(p1y, p2y), p3y), 0);
+    const int max_y = min(max(max(p1y, p2y), p3y), h - 1);
+
+    if (min_x > max_x + 1 || min_y > max_y + 1) return 0;
+
+    const int p1_p2_x_diff = p1x - p2x;
+    const int p2_p3_x_diff = p2x - p3x;
+    const int p3_p1_x_diff = p3x - p1x;
+    const int p1_p2_y_diff = p1y - p2y;
+    const int p2_p3_y_diff = p2y - p3y;
+    const int p3_p1_y_diff = p3y - p1y;
+    const int p2_p1_cross = p1_p2_x_diff * p2y - p1_p2_y_diff * p2x;
+    const int p3_p2_cross = p2_p3_x_diff * p3y - p2_p3_y_diff * p3x;
+    const int p1_p3_cross = p3_p1_x_diff * p1y - p3_p1_y_diff * p1x;
+
+    int area = p3_p1_y_diff * p2_p3_x_diff - p3_p1_x_diff * p2_p3_y_diff;
+
+    if (area == 0) return 0;
+
+    const float inv_area = 1.0f / area;
+    int written = 0;
+
+    span->steps[0] = p2_p3_y_diff * inv_area;
+    span->steps[1] = p3_p1_y_diff * inv_area;
+    span->steps[2] = p1_p2_y_diff * inv_area;
+
+    for (int y = min_y; y <= max_y; y++)
+    {
+        int start = -1;
+
+        // one past the last pixel closes the last run
+        for (int x = min_x; x <= max_x + 1; x++)
+        {
+            const int s1 = p1_p2_y_diff * x - p1_p2_x_diff * y + p2_p1_cross;
+            const int s2 = p2_p3_y_diff * x - p2_p3_x_diff * y + p3_p2_cross;
+            const int s3 = p3_p1_y_diff * x - p3_p1_x_diff * y + p1_p3_cross;
+            const int covered = x <= max_x &&
+                (((s1 > 0) && (s2 > 0) && (s3 > 0)) || ((s1 <= 0) && (s2 <= 0) && (s3 <= 0)));
+
+            if (covered && start < 0) start = x;
+
+            if (covered || start < 0) continue;
+
+            const int t1 = p1_p2_y_diff * start - p1_p2_x_diff * y + p2_p1_cross;
+            const int t2 = p2_p3_y_diff * start - p2_p3_x_diff * y + p3_p2_cross;
+            const int t3 = p3_p1_y_diff * start - p3_p1_x_diff * y + p1_p3_cross;
+
+            span->x = start;
+            span->y = y;
+            span->count = x - start;
+            span->weights[0] = t2 * inv_area;
+            span->weights[1] = t3 * inv_area;
+            span->weights[2] = t1 * inv_area;
+            hooks->span(span, hooks->colors, hooks->user);
+
+            for (int px = start; px < x; px++)
+            {
+                if (parity >= 0 && ((px + y) & 1) != parity) continue;
+
+                const int r1 = p1_p2_y_diff * px - p1_p2_x_diff * y + p2_p1_cross;
+                const int r2 = p2_p3_y_diff * px - p2_p3_x_diff * y + p3_p2_cross;
+                const int r3 = p3_p1_y_diff * px - p3_p1_x_diff * y + p1_p3_cross;
+                const float depth = (p1z * r2 + p2z * r3 + p3z * r1) * inv_area;
+                const int depth_offest = (px * ds_x + y * ds_y) / sizeof(float);
+
+                if (depth < depth_buffer[depth_offest])
+                {
+                    const uint8_t* color = hooks->colors + 3 * (px - start);
+                    const int offset = px * bs_x + y * bs_y;
+                    buffer[offset] = color[0];
+                    buffer[offset + bs_c] = color[1];
+                    buffer[offset + bs_c + bs_c] = color[2];
+                    depth_buffer[depth_offest] = depth;
+                    written++;
+                }
+            }
+
+            start = -1;
+        }
+    }
+
+    return written;
+}
+
+// Draw an instance of a mesh as Renderer.draw_body does: the vertices are
+// rotated like math3d.rotate and moved, the faces facing the camera are shaded
+// with the light and the ones inside the screen and the depth range drawn,
+// through the shaders of hooks if set.
+// scratch holds 6 doubles per vertex, totals receives triangles and pixels
+static void draw_mesh(const CommandMesh* mesh, int mesh_index, int instance,
+                      const double* transform, const double* state,
+                      double* scratch, const ShaderHooks* hooks,
+                      uint8_t* buffer, int bs_x, int bs_y, int bs_c,
+                      float* depth_buffer, int ds_x, int ds_y,
+                      int w, int h, int parity, int64_t* totals) {
+    const double* camera = state;
+    const double* light = state + STATE_LIGHT;
+    const double* pos = transform;
+    double axis[3] = {transform[4], transform[5], transform[6]};
+    const double norm = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+    if (norm > 0)
+    {
+        axis[0] /= norm;
+        axis[1] /= norm;
+        axis[2] /= norm;
+    }
+
+    // rotate computes q^-1 v q, the transpose of the matrix of q v q^-1
+    const double qw = cos(transform[3] / 2);
+    const double qx = axis[0] * sin(transform[3] / 2);
+    const double qy = axis[1] * sin(transform[3] / 2);
+    const double qz = axis[2] * sin(transform[3] / 2);
+    const double m[9] = {
+        1 - 2 * (qy * qy + qz * qz), 2 * (qx * qy + qw * qz), 2 * (qx * qz - qw * qy),
+        2 * (qx * qy - qw * qz), 1 - 2 * (qx * qx + qz * qz), 2 * (qy * qz + qw * qx),
+        2 * (qx * qz + qw * qy), 2 * (qy * qz - qw * qx), 1 - 2 * (qx * qx + qy * qy)
+    };
+
+    // world coordinates are kept for the faces, screen coordinates for the raster
+    double* world = scratch;
+    double* screen = scratch + 3 * mesh->n_vertices;
+
+    for (int64_t i = 0; i < mesh->n_vertices; i++)
+    {
+        const double* v = mesh->vertices + 3 * i;
+        double* p = world + 3 * i;
+
+        for (int k = 0; k < 3; k++)
+            p[k] = m[3 * k] * v[0] + m[3 * k + 1] * v[1] + m[3 * k + 2] * v[2] + pos[k];
+
+        const double vx = p[0] * camera[3] + p[1] * camera[4] + p[2] * camera[5] - camera[12];
+        const double vy = p[0] * camera[6] + p[1] * camera[7] + p[2] * camera[8] - camera[13];
+        const double vz = p[0] * camera[9] + p[1] * camera[10] + p[2] * camera[11] - camera[14];
+        double x = camera[15] * vx;
+        double y = camera[16] * vy;
+
+        if (vz != 0)
+        {
+            x /= vz;
+            y /= vz;
+        }
+
+        screen[3 * i] = (x + 1) / 2 * w - camera[20];
+        screen[3 * i + 1] = (- y + 1) / 2 * h - camera[21];
+        screen[3 * i + 2] = camera[17] * (vz - camera[18]);
+    }
+
+    const double znear = camera[18];
+    const double zfar = camera[19];
+
+    for (int64_t i = 0; i < mesh->n_faces; i++)
+    {
+        const int32_t* face = mesh->faces + 3 * i;
+        const double* v0 = world + 3 * face[0];
+        const double* v1 = world + 3 * face[1];
+        const double* v2 = world + 3 * face[2];
+        const double a[3] = {v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2]};
+        const double b[3] = {v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2]};
+        // inward normal as Body.compute_normals
+        double n[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+
+        if ((v0[0] - camera[0]) * n[0] + (v0[1] - camera[1]) * n[1] + (v0[2] - camera[2]) * n[2] <= 0)
+            continue;
+
+        const double* p1 = screen + 3 * face[0];
+        const double* p2 = screen + 3 * face[1];
+        const double* p3 = screen + 3 * face[2];
+
+        if ((p1[0] > w && p2[0] > w && p3[0] > w) || (p1[0] < 0 && p2[0] < 0 && p3[0] < 0) ||
+            (p1[1] > h && p2[1] > h && p3[1] > h) || (p1[1] < 0 && p2[1] < 0 && p3[1] < 0) ||
+            p1[2] < znear || p2[2] < znear || p3[2] < znear ||
+            p1[2] > zfar || p2[2] > zfar || p3[2] > zfar)
+            continue;
+
+        const double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+        double intensity = (n[0] * light[0] + n[1] * light[1] + n[2] * light[2]) / 2 + 0.5;
+
+        if (mesh->occlusion) intensity *= mesh->occlusion[i];
+
+        uint8_t color[3];
+
+        for (int k = 0; k < 3; k++)
+            color[k] = (uint8_t) fmin(fmax(mesh->colors[3 * i + k] * intensity, 0), 255);
+
+        totals[0]++;
+
+        if (hooks->face)
+        {
+            FaceShading shading = {
+                {- n[0], - n[1], - n[2]},
+                {(v0[0] + v1[0] + v2[0]) / 3, (v0[1] + v1[1] + v2[1]) / 3, (v0[2] + v1[2] + v2[2]) / 3},
+                {light[0], light[1], light[2]},
+                intensity, (int32_t) i, mesh_index, instance,
+                {mesh->colors[3 * i], mesh->colors[3 * i + 1], mesh->colors[3 * i + 2]}, 0
+            };
+            hooks->face(&shading, color, hooks->user);
+        }
+
+        if (hooks->span)
+        {
+            SpanShading span;
+
+            for (int k = 0; k < 3; k++)
+            {
+                span.positions[k] = v0[k];
+                span.positions[3 + k] = v1[k];
+                span.positions[6 + k] = v2[k];
+                span.color[k] = color[k];
+            }
+
+            // screen depth is q * (z - znear)
+            span.depths[0] = p1[2] / camera[17] + znear;
+            span.depths[1] = p2[2] / camera[17] + znear;
+            span.depths[2] = p3[2] / camera[17] + znear;
+            span.face = (int32_t) i;
+            span.mesh = mesh_index;
+            span.instance = instance;
+            span.pad = 0;
+
+            totals[1] += draw_triangle_shaded(buffer, bs_x, bs_y, bs_c,
+                                              depth_buffer, ds_x, ds_y,
+                                              p1[0], p1[1], p1[2],
+                                              p2[0], p2[1], p2[2],
+                                              p3[0], p3[1], p3[2],
+                                              &span, hooks, w, h, parity);
+            continue;
+        }
+
+        totals[1] += draw_triangle(buffer, bs_x, bs_y, bs_c,
+                                   depth_buffer, ds_x, ds_y,
+                                   p1[0], p1[1], p1[2],
+                                   p2[0], p2[1], p2[2],
+                                   p3[0], p3[1], p3[2],
+                                   color[0], color[1], color[2], w, h, parity);
+    }
+}
+
+// Execute a recorded command buffer, the arguments of the commands are:
+// CMD_CLEAR   offset of the background color in constants or -1 for the state one
+// CMD_CAMERA  offset of the camera in constants
+// CMD_LIGHT   offset of the light direction in constants
+// CMD_DRAW    mesh, offset of the transforms in constants, number of instances
+// CMD_SHADER  index of the face shader, span shader and user pointer in shaders or -1
+// span_colors holds 3 bytes per pixel of a row for the span shaders
+static void execute_commands(const int32_t* commands, int count, const double* constants,
+                             const CommandMesh* meshes, const uint64_t* shaders,
+                             double* state, double* scratch, uint8_t* span_colors,
+                             uint8_t* buffer, int bs_x, int bs_y, int bs_c,
+                             float* depth_buffer, int ds_x, int ds_y,
+                             int w, int h, int parity, int64_t* totals) {
+    ShaderHooks hooks = {NULL, NULL, NULL, span_colors};
+
+    for (int i = 0; i < count; i++)
+    {
+        const int32_t* command = commands + COMMAND_SIZE * i;
+
+        switch (command[0])
+        {
+            case CMD_CLEAR:
+            {
+                const double* color = command[1] < 0 ? state + STATE_BACKGROUND : constants + command[1];
+                fill_bg(buffer, bs_x, bs_y, bs_c,
+                        (uint8_t) color[0], (uint8_t) color[1], (uint8_t) color[2], w, h);
+
+                for (int y = 0; y < h; y++)
+                    for (int x = 0; x < w; x++)
+                        depth_buffer[(x * ds_x + y * ds_y) / sizeof(float)] = (float) state[19];
+                break;
+            }
+            case CMD_CAMERA:
+                memcpy(state, constants + command[1], CAMERA_PARAMS * sizeof(double));
+                break;
+            case CMD_LIGHT:
+                memcpy(state + STATE_LIGHT, constants + command[1], 3 * sizeof(double));
+                break;
+            case CMD_DRAW:
+                for (int k = 0; k < command[3]; k++)
+                    draw_mesh(meshes + command[1], command[1], k,
+                              constants + command[2] + TRANSFORM_PARAMS * k,
+                              state, scratch, &hooks,
+                              buffer, bs_x, bs_y, bs_c,
+                              depth_buffer, ds_x, ds_y,
+                              w, h, parity, totals);
+                break;
+            case CMD_SHADER:
+                hooks.face = NULL;
+                hooks.span = NULL;
+                hooks.user = NULL;
+
+                if (command[1] >= 0)
+                {
+                    hooks.face = (FaceShader) (uintptr_t) shaders[3 * command[1]];
+                    hooks.span = (SpanShader) (uintptr_t) shaders[3 * command[1] + 1];
+                    hooks.user = (void*) (uintptr_t) shaders[3 * command[1] + 2];
+                }
+                break;
+        }
+    }
+}
+
+#ifdef __linux__
+// Cycles, instructions, last level cache misses and branch misses
+static const uint64_t perf_configs[PERF_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+#endif
+
+// Open the counters of the calling thread in user space, -1 for the unavailable ones
+static void perf_open(int32_t* fds) {
+    for (int i = 0; i < PERF_COUNTERS; i++)
+    {
+        fds[i] = -1;
+
+#ifdef __linux__
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = perf_configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        fds[i] = (int32_t) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+}
+
+// Current values of the counters, -1 for the unavailable ones
+static void perf_read(const int32_t* fds, int64_t* values) {
+    for (int i = 0; i < PERF_COUNTERS; i++)
+    {
+        values[i] = -1;
+
+#ifdef __linux__
+        uint64_t value;
+
+        if (fds[i] >= 0 && read(fds[i], &value, sizeof(value)) == sizeof(value))
+            values[i] = (int64_t) value;
+#endif
+    }
+}
+
+static void perf_close(int32_t* fds) {
+    for (int i = 0; i < PERF_COUNTERS; i++)
+    {
+#ifdef __linux__
+        if (fds[i] >= 0)
+            close(fds[i]);
+#endif
+
+        fds[i] = -1;
+    }
+}
+
+static CountingAllocator counting_allocators[ALLOC_DOMAINS];
+static uint64_t alloc_calls[ALLOC_DOMAINS];
+static uint64_t alloc_bytes;
+// Number of callers of alloc_hooks_install not yet matched by alloc_hooks_remove
+static int alloc_users = 0;
+
+// The raw domain can be used without the GIL, so the counters are atomic
+static void count_alloc(int domain, size_t size) {
+    ATOMIC_ADD(alloc_calls[domain], 1);
+    ATOMIC_ADD(alloc_bytes, size);
+}
+
+static void* counting_malloc(void* ctx, size_t size) {
+    CountingAllocator* counting = (CountingAllocator*) ctx;
+    count_alloc(counting->domain, size);
+
+    return counting->allocator.malloc(counting->allocator.ctx, size);
+}
+
+static void* counting_calloc(void* ctx, size_t nelem, size_t elsize) {
+    CountingAllocator* counting = (CountingAllocator*) ctx;
+    count_alloc(counting->domain, nelem * elsize);
+
+    return counting->allocator.calloc(counting->allocator.ctx, nelem, elsize);
+}
+
+static void* counting_realloc(void* ctx, void* ptr, size_t new_size) {
+    CountingAllocator* counting = (CountingAllocator*) ctx;
+    count_alloc(counting->domain, new_size);
+
+    return counting->allocator.realloc(counting->allocator.ctx, ptr, new_size);
+}
+
+static void counting_free(void* ctx, void* ptr) {
+    CountingAllocator* counting = (CountingAllocator*) ctx;
+    counting->allocator.free(counting->allocator.ctx, ptr);
+}
+
+static const PyMemAllocatorDomain alloc_domains[ALLOC_DOMAINS] = {
+    PYMEM_DOMAIN_OBJ, PYMEM_DOMAIN_MEM, PYMEM_DOMAIN_RAW
+};
+
+// Wrap the allocators of the three Python memory domains, memory allocated before
+// or after the hooks is freed by the same underlying allocator. The hooks are
+// shared, installed by the first caller and removed with the last one
+static void alloc_hooks_install(void) {
+    if (alloc_users++ > 0) return;
+
+    for (int i = 0; i < ALLOC_DOMAINS; i++)
+    {
+        PyMem_GetAllocator(alloc_domains[i], &counting_allocators[i].allocator);
+        counting_allocators[i].domain = i;
+
+        PyMemAllocatorEx hook = {&counting_allocators[i], counting_malloc,
+                                 counting_calloc, counting_realloc, counting_free};
+        PyMem_SetAllocator(alloc_domains[i], &hook);
+    }
+}
+
+static void alloc_hooks_remove(void) {
+    if (alloc_users == 0 || --alloc_users > 0) return;
+
+    for (int i = 0; i < ALLOC_DOMAINS; i++)
+        PyMem_SetAllocator(alloc_domains[i], &counting_allocators[i].allocator);
+}
+
+// Allocations counted so far and bytes in use on the native heap, -1 if unknown
+static void alloc_counts(int64_t* values) {
+    for (int i = 0; i < ALLOC_DOMAINS; i++)
+        values[i] = (int64_t) alloc_calls[i];
+
+    values[ALLOC_DOMAINS] = (int64_t) alloc_bytes;
+    values[ALLOC_DOMAINS + 1] = -1;
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    values[ALLOC_DOMAINS + 1] = (int64_t) (info.uordblks + info.hblkhd);
+#endif
+}
+
+PyDoc_STRVAR(ext_rendering__doc__,
+"Low level drawing on the pygame buffer.");
+
+PyDoc_STRVAR(draw_triangle__doc__,
+"Draw a triangle on the pygame buffer, only on the pixels with (x + y) % 2 == parity if given.\n"
+"Return the number of pixels written.");
+
+PyDoc_STRVAR(draw_triangle_simd__doc__,
+"Draw a triangle on the pygame buffer computing several pixels of a row at once, return the number of pixels written.");
+
+PyDoc_STRVAR(draw_triangles__doc__,
+"Draw in order a batch of triangles on a band of rows of the pygame buffer, return the number of pixels written.");
+
+PyDoc_STRVAR(execute_commands__doc__,
+"Execute a recorded command buffer on the pygame buffer in a single call.");
+
+PyDoc_STRVAR(fill_bg__doc__,
+"Fill the background with its color.");
+
+PyDoc_STRVAR(build_bvh__doc__,
+"Build the bounding volume hierarchy of a triangle mesh, returns the number of nodes.\n"
+"The nodes must have room for max(2 * n_faces - 1, 1) entries.");
+
+PyDoc_STRVAR(bake_ao__doc__,
+"Compute the ambient occlusion of a range of vertices casting hemisphere rays.");
+
+PyDoc_STRVAR(span_triangle__doc__,
+"Insert the spans of a triangle in the span buffer, keeping only the nearest parts.");
+
+PyDoc_STRVAR(resolve_spans__doc__,
+"Write the spans of the span buffer on the pygame buffer and on the depth buffer, then empty it.");
+
+PyDoc_STRVAR(clear_depth_tiles__doc__,
+"Set all the tiles of a compressed depth buffer to a single plane at zfar.");
+
+PyDoc_STRVAR(draw_triangle_tiles__doc__,
+"Draw a triangle testing and writing its depth on a compressed depth buffer.");
+
+PyDoc_STRVAR(copy_depth_tiles__doc__,
+"Copy the tiles of a compressed depth buffer overlapping a rectangle to a flat depth buffer, or back if store.");
+
+PyDoc_STRVAR(clear_frame_tiles__doc__,
+"Fill all the tiles of a tiled framebuffer with the background color and zfar.");
+
+PyDoc_STRVAR(draw_triangle_frame__doc__,
+"Draw a triangle on a tiled framebuffer.");
+
+PyDoc_STRVAR(copy_frame_tiles__doc__,
+"Copy a rectangle of a tiled framebuffer to the pygame buffer and the depth buffer, or back if store.");
+
+PyDoc_STRVAR(draw_triangle_packed__doc__,
+"Draw a triangle on a target of 8 bits palette indices or 16 bits RGB565 values.");
+
+PyDoc_STRVAR(expand_packed__doc__,
+"Expand a rectangle of a packed target on the pygame buffer.");
+
+PyDoc_STRVAR(fxaa__doc__,
+"Antialias a range of rows of the pygame buffer reading an unmodified copy of it.");
+
+PyDoc_STRVAR(reconstruct_checker__doc__,
+"Fill the pixels skipped by a checkerboard frame reprojecting the previous frame, or from the neighbours.");
+
+PyDoc_STRVAR(post_chain__doc__,
+"Apply fog, tonemapping and color grading to a range of rows of the pygame buffer in a single pass.");
+
+PyDoc_STRVAR(draw_triangle_gbuffer__doc__,
+"Draw a triangle on the pygame buffer and on the object id, linear depth, normal and motion channels.");
+
+PyDoc_STRVAR(raster_ids__doc__,
+"Rasterize a triangle mesh from a point of view writing the id of the visible faces.");
+
+PyDoc_STRVAR(replay_triangles__doc__,
+"Draw the triangles of a frame capture with one of the raster kernels, without the GIL.");
+
+PyDoc_STRVAR(alloc_hooks_install__doc__,
+"Count the allocations of the Python memory domains, the hooks are shared by every caller.");
+
+PyDoc_STRVAR(alloc_hooks_remove__doc__,
+"Release the hooks of a call to alloc_hooks_install, the allocators are restored after the last one.");
+
+PyDoc_STRVAR(alloc_counts__doc__,
+"Read the allocations of the Python objects, PyMem and raw domains, the bytes requested and the native heap in use.");
+
+PyDoc_STRVAR(perf_open__doc__,
+"Open the hardware counters of the calling thread, the descriptors of the unavailable ones are -1.");
+
+PyDoc_STRVAR(perf_read__doc__,
+"Read the hardware counters, -1 for the unavailable ones.");
+
+PyDoc_STRVAR(perf_close__doc__,
+"Close the hardware counters.");
+
+PyDoc_STRVAR(draw_sprite__doc__,
+"Draw a scaled sprite with its own depth on the pygame buffer.");
+
+PyDoc_STRVAR(build_hiz__doc__,
+"Build the next level of a depth pyramid keeping the farthest depth of each 2x2 block.");
+
+PyDoc_STRVAR(set_transforms__doc__,
+"Copy positions and rotations of many bodies in the scene arrays and mark them dirty.");
+
+static PyObject* py_draw_triangle(PyObject* self, PyObject* args)
+{
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    unsigned long long depth_buffer_ptr;
+    int ds_x, ds_y;
+    float p1xf, p1yf, p1z;
+    float p2xf, p2yf, p2z;
+    float p3xf, p3yf, p3z;
+    uint8_t R, G, B;
+    int w, h;
+    int parity = -1;
+
+	if (!PyArg_ParseTuple(args, "KiiiKiifffffffffbbbii|i:draw_triangle",
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &depth_buffer_ptr, &ds_x, &ds_y,
+                          &p1xf, &p1yf, &p1z,
+                          &p2xf, &p2yf, &p2z,
+                          &p3xf, &p3yf, &p3z,
+                          &R, &G, &B, &w, &h, &parity))
+		return NULL;
+
+    uint8_t* buffer = (uint8_t*) buffer_ptr;
+    float* depth_buffer = (float*) depth_buffer_ptr;
+
+	int written = draw_triangle(buffer, bs_x, bs_y, bs_c,
+                  depth_buffer, ds_x, ds_y,
+                  p1xf, p1yf, p1z,
+                  p2xf, p2yf, p2z,
+                  p3xf, p3yf, p3z,
+                  R, G, B, w, h, parity);
+
+	return PyLong_FromLong(written);
+}
+
+static PyObject* py_draw_triangle_simd(PyObject* self, PyObject* args)
+{
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    unsigned long long depth_buffer_ptr;
+    int ds_x, ds_y;
+    float p1xf, p1yf, p1z;
+    float p2xf, p2yf, p2z;
+    float p3xf, p3yf, p3z;
+    uint8_t R, G, B;
+    int w, h;
+    int parity = -1;
+
+    if (!PyArg_ParseTuple(args, "KiiiKiifffffffffbbbii|i:draw_triangle_simd",
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &depth_buffer_ptr, &ds_x, &ds_y,
+                          &p1xf, &p1yf, &p1z,
+                          &p2xf, &p2yf, &p2z,
+                          &p3xf, &p3yf, &p3z,
+                          &R, &G, &B, &w, &h, &parity))
+        return NULL;
+
+    int written = draw_triangle_simd((uint8_t*) buffer_ptr, bs_x, bs_y, bs_c,
+                                     (float*) depth_buffer_ptr, ds_x, ds_y,
+                                     p1xf, p1yf, p1z,
+                                     p2xf, p2yf, p2z,
+                                     p3xf, p3yf, p3z,
+                                     R, G, B, w, 0, h, parity);
+
+    return PyLong_FromLong(written);
+}
+
+static PyObject* py_draw_triangles(PyObject* self, PyObject* args)
+{
+    unsigned long long points_ptr, colors_ptr;
+    int count;
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    unsigned long long depth_buffer_ptr;
+    int ds_x, ds_y;
+    int w, parity, y0, y1;
+    int written;
+
+    if (!PyArg_ParseTuple(args, "KKiKiiiKiiiiii:draw_triangles",
+                          &points_ptr, &colors_ptr, &count,
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &depth_buffer_ptr, &ds_x, &ds_y,
+                          &w, &parity, &y0, &y1))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    written = draw_triangles((const float*) points_ptr, (const uint8_t*) colors_ptr, count,
+                             (uint8_t*) buffer_ptr, bs_x, bs_y, bs_c,
+                             (float*) depth_buffer_ptr, ds_x, ds_y,
+                             w, parity, y0, y1);
+    Py_END_ALLOW_THREADS
+
+    return PyLong_FromLong(written);
+}
+
+static PyObject* py_execute_commands(PyObject* self, PyObject* args)
+{
+    unsigned long long commands_ptr;
+    int count;
+    unsigned long long constants_ptr, meshes_ptr, shaders_ptr;
+    unsigned long long state_ptr, scratch_ptr, span_colors_ptr;
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    unsigned long long depth_buffer_ptr;
+    int ds_x, ds_y;
+    int w, h, parity;
+    unsigned long long totals_ptr;
+
+    if (!PyArg_ParseTuple(args, "KiKKKKKKKiiiKiiiiiK:execute_commands",
+                          &commands_ptr, &count,
+                          &constants_ptr, &meshes_ptr, &shaders_ptr,
+                          &state_ptr, &scratch_ptr, &span_colors_ptr,
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &depth_buffer_ptr, &ds_x, &ds_y,
+                          &w, &h, &parity, &totals_ptr))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    execute_commands((const int32_t*) commands_ptr, count, (const double*) constants_ptr,
+                     (const CommandMesh*) meshes_ptr, (const uint64_t*) shaders_ptr,
+                     (double*) state_ptr, (double*) scratch_ptr, (uint8_t*) span_colors_ptr,
+                     (uint8_t*) buffer_ptr, bs_x, bs_y, bs_c,
+                     (float*) depth_buffer_ptr, ds_x, ds_y,
+                     w, h, parity, (int64_t*) totals_ptr);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_fill_bg(PyObject* self, PyObject* args)
+{
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    uint8_t R, G, B;
+    int w, h;
+
+	if (!PyArg_ParseTuple(args, "Kiiibbbii:draw_triangle",
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &R, &G, &B, &w, &h))
+		return NULL;
+
+    uint8_t* buffer = (uint8_t*) buffer_ptr;
+
+	fill_bg(buffer, bs_x, bs_y, bs_c,
+            R, G, B, w, h);
+
+	Py_RETURN_NONE;
+}
+
+static PyObject* py_span_triangle(PyObject* self, PyObject* args)
+{
+    unsigned long long spans_ptr, counts_ptr, scratch_ptr;
+    float p1xf, p1yf, p1z;
+    float p2xf, p2yf, p2z;
+    float p3xf, p3yf, p3z;
+    uint8_t R, G, B;
+    int w, h;
+
+    if (!PyArg_ParseTuple(args, "KKKfffffffffbbbii:span_triangle",
+                          &spans_ptr, &counts_ptr, &scratch_ptr,
+                          &p1xf, &p1yf, &p1z,
+                          &p2xf, &p2yf, &p2z,
+                          &p3xf, &p3yf, &p3z,
+                          &R, &G, &B, &w, &h))
+        return NULL;
+
+    span_triangle((Span*) spans_ptr, (int32_t*) counts_ptr, (Span*) scratch_ptr,
+                  p1xf, p1yf, p1z,
+                  p2xf, p2yf, p2z,
+                  p3xf, p3yf, p3z,
+                  R, G, B, w, h);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_resolve_spans(PyObject* self, PyObject* args)
+{
+    unsigned long long spans_ptr, counts_ptr;
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    unsigned long long depth_buffer_ptr;
+    int ds_x, ds_y;
+    int w, h;
+
+    if (!PyArg_ParseTuple(args, "KKKiiiKiiii:resolve_spans",
+                          &spans_ptr, &counts_ptr,
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &depth_buffer_ptr, &ds_x, &ds_y,
+                          &w, &h))
+        return NULL;
+
+    resolve_spans((const Span*) spans_ptr, (int32_t*) counts_ptr,
+                  (uint8_t*) buffer_ptr, bs_x, bs_y, bs_c,
+                  (float*) depth_buffer_ptr, ds_x, ds_y, w, h);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_clear_depth_tiles(PyObject* self, PyObject* args)
+{
+    unsigned long long tiles_ptr;
+    int n;
+    float zfar;
+
+    if (!PyArg_ParseTuple(args, "Kif:clear_depth_tiles", &tiles_ptr, &n, &zfar))
+        return NULL;
+
+    clear_depth_tiles((DepthTile*) tiles_ptr, n, zfar);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_draw_triangle_tiles(PyObject* self, PyObject* args)
+{
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    unsigned long long tiles_ptr, raw_ptr;
+    int tiles_x;
+    float p1xf, p1yf, p1z;
+    float p2xf, p2yf, p2z;
+    float p3xf, p3yf, p3z;
+    uint8_t R, G, B;
+    int w, h;
+
+    if (!PyArg_ParseTuple(args, "KiiiKKifffffffffbbbii:draw_triangle_tiles",
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &tiles_ptr, &raw_ptr, &tiles_x,
+                          &p1xf, &p1yf, &p1z,
+                          &p2xf, &p2yf, &p2z,
+                          &p3xf, &p3yf, &p3z,
+                          &R, &G, &B, &w, &h))
+        return NULL;
+
+    draw_triangle_tiles((uint8_t*) buffer_ptr, bs_x, bs_y, bs_c,
+                        (DepthTile*) tiles_ptr, (float*) raw_ptr, tiles_x,
+                        p1xf, p1yf, p1z,
+                        p2xf, p2yf, p2z,
+                        p3xf, p3yf, p3z,
+                        R, G, B, w, h);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_copy_depth_tiles(PyObject* self, PyObject* args)
+{
+    unsigned long long tiles_ptr, raw_ptr;
+    int tiles_x;
+    unsigned long long depth_buffer_ptr;
+    int ds_x, ds_y;
+    int x0, y0, x1, y1;
+    int w, h;
+    int store;
+
+    if (!PyArg_ParseTuple(args, "KKiKiiiiiiiip:copy_depth_tiles",
+                          &tiles_ptr, &raw_ptr, &tiles_x,
+                          &depth_buffer_ptr, &ds_x, &ds_y,
+                          &x0, &y0, &x1, &y1, &w, &h, &store))
+        return NULL;
+
+    copy_depth_tiles((DepthTile*) tiles_ptr, (float*) raw_ptr, tiles_x,
+                     (float*) depth_buffer_ptr, ds_x, ds_y,
+                     x0, y0, x1, y1, w, h, store);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_clear_frame_tiles(PyObject* self, PyObject* args)
+{
+    unsigned long long tiles_ptr;
+    int n;
+    uint8_t R, G, B;
+    float zfar;
+
+    if (!PyArg_ParseTuple(args, "Kibbbf:clear_frame_tiles", &tiles_ptr, &n, &R, &G, &B, &zfar))
+        return NULL;
+
+    clear_frame_tiles((FrameTile*) tiles_ptr, n, R, G, B, zfar);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_draw_triangle_frame(PyObject* self, PyObject* args)
+{
+    unsigned long long tiles_ptr;
+    int tiles_x;
+    float p1xf, p1yf, p1z;
+    float p2xf, p2yf, p2z;
+    float p3xf, p3yf, p3z;
+    uint8_t R, G, B;
+    int w, h;
+
+    if (!PyArg_ParseTuple(args, "Kifffffffffbbbii:draw_triangle_frame",
+                          &tiles_ptr, &tiles_x,
+                          &p1xf, &p1yf, &p1z,
+                          &p2xf, &p2yf, &p2z,
+                          &p3xf, &p3yf, &p3z,
+                          &R, &G, &B, &w, &h))
+        return NULL;
+
+    draw_triangle_frame((FrameTile*) tiles_ptr, tiles_x,
+                        p1xf, p1yf, p1z,
+                        p2xf, p2yf, p2z,
+                        p3xf, p3yf, p3z,
+                        R, G, B, w, h);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_copy_frame_tiles(PyObject* self, PyObject* args)
+{
+    unsigned long long tiles_ptr;
+    int tiles_x;
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    unsigned long long depth_buffer_ptr;
+    int ds_x, ds_y;
+    int x0, y0, x1, y1;
+    int w, h;
+    int store;
+
+    if (!PyArg_ParseTuple(args, "KiKiiiKiiiiiiiip:copy_frame_tiles",
+                          &tiles_ptr, &tiles_x,
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &depth_buffer_ptr, &ds_x, &ds_y,
+                          &x0, &y0, &x1, &y1, &w, &h, &store))
+        return NULL;
+
+    copy_frame_tiles((FrameTile*) tiles_ptr, tiles_x,
+                     (uint8_t*) buffer_ptr, bs_x, bs_y, bs_c,
+                     (float*) depth_buffer_ptr, ds_x, ds_y,
+                     x0, y0, x1, y1, w, h, store);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_draw_triangle_packed(PyObject* self, PyObject* args)
+{
+    unsigned long long target_ptr;
+    int ts_x, ts_y, bpp;
+    unsigned long long depth_buffer_ptr;
+    int ds_x, ds_y;
+    float p1xf, p1yf, p1z;
+    float p2xf, p2yf, p2z;
+    float p3xf, p3yf, p3z;
+    uint16_t value;
+    int w, h;
+
+    if (!PyArg_ParseTuple(args, "KiiiKiifffffffffHii:draw_triangle_packed",
+                          &target_ptr, &ts_x, &ts_y, &bpp,
+                          &depth_buffer_ptr, &ds_x, &ds_y,
+                          &p1xf, &p1yf, &p1z,
+                          &p2xf, &p2yf, &p2z,
+                          &p3xf, &p3yf, &p3z,
+                          &value, &w, &h))
+        return NULL;
+
+    draw_triangle_packed((uint8_t*) target_ptr, ts_x, ts_y, bpp,
+                         (float*) depth_buffer_ptr, ds_x, ds_y,
+                         p1xf, p1yf, p1z,
+                         p2xf, p2yf, p2z,
+                         p3xf, p3yf, p3z,
+                         value, w, h);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_expand_packed(PyObject* self, PyObject* args)
+{
+    unsigned long long target_ptr;
+    int ts_x, ts_y, bpp;
+    unsigned long long palette_ptr;
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    int x0, y0, x1, y1;
+    int w, h;
+
+    if (!PyArg_ParseTuple(args, "KiiiKKiiiiiiiii:expand_packed",
+                          &target_ptr, &ts_x, &ts_y, &bpp, &palette_ptr,
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &x0, &y0, &x1, &y1, &w, &h))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    expand_packed((const uint8_t*) target_ptr, ts_x, ts_y, bpp,
+                  (const uint8_t*) palette_ptr,
+                  (uint8_t*) buffer_ptr, bs_x, bs_y, bs_c,
+                  x0, y0, x1, y1, w, h);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_fxaa(PyObject* self, PyObject* args)
+{
+    unsigned long long src_ptr;
+    int s_x, s_y, s_c;
+    unsigned long long dst_ptr;
+    int d_x, d_y, d_c;
+    float threshold, threshold_min, subpixel;
+    int w, h, y0, y1;
+
+    if (!PyArg_ParseTuple(args, "KiiiKiiifffiiii:fxaa",
+                          &src_ptr, &s_x, &s_y, &s_c,
+                          &dst_ptr, &d_x, &d_y, &d_c,
+                          &threshold, &threshold_min, &subpixel,
+                          &w, &h, &y0, &y1))
+        return NULL;
+
+    int status;
+
+    Py_BEGIN_ALLOW_THREADS
+    status = fxaa((const uint8_t*) src_ptr, s_x, s_y, s_c,
+                  (uint8_t*) dst_ptr, d_x, d_y, d_c,
+                  threshold, threshold_min, subpixel,
+                  w, h, y0, y1);
+    Py_END_ALLOW_THREADS
+
+    if (status < 0) return PyErr_NoMemory();
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_reconstruct_checker(PyObject* self, PyObject* args)
+{
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    unsigned long long depth_buffer_ptr;
+    int ds_x, ds_y;
+    unsigned long long prev_ptr;
+    int ps_x, ps_y, ps_c;
+    unsigned long long prev_depth_ptr;
+    int pds_x, pds_y;
+    unsigned long long reproject_ptr;
+    float af, f, q, znear, zfar, tolerance;
+    int parity, w, h;
+
+    if (!PyArg_ParseTuple(args, "KiiiKiiKiiiKiiKffffffiii:reconstruct_checker",
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &depth_buffer_ptr, &ds_x, &ds_y,
+                          &prev_ptr, &ps_x, &ps_y, &ps_c,
+                          &prev_depth_ptr, &pds_x, &pds_y,
+                          &reproject_ptr,
+                          &af, &f, &q, &znear, &zfar, &tolerance,
+                          &parity, &w, &h))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    reconstruct_checker((uint8_t*) buffer_ptr, bs_x, bs_y, bs_c,
+                        (float*) depth_buffer_ptr, ds_x, ds_y,
+                        (const uint8_t*) prev_ptr, ps_x, ps_y, ps_c,
+                        (const float*) prev_depth_ptr, pds_x, pds_y,
+                        (const float*) reproject_ptr,
+                        af, f, q, znear, zfar, tolerance, parity, w, h);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_post_chain(PyObject* self, PyObject* args)
+{
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    unsigned long long depth_buffer_ptr;
+    int ds_x, ds_y;
+    unsigned long long params_ptr, lut_ptr;
+    int lut_size;
+    int w, h, y0, y1;
+
+    if (!PyArg_ParseTuple(args, "KiiiKiiKKiiiii:post_chain",
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &depth_buffer_ptr, &ds_x, &ds_y,
+                          &params_ptr, &lut_ptr, &lut_size,
+                          &w, &h, &y0, &y1))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    post_chain((uint8_t*) buffer_ptr, bs_x, bs_y, bs_c,
+               (const float*) depth_buffer_ptr, ds_x, ds_y,
+               (const PostParams*) params_ptr, (const uint8_t*) lut_ptr, lut_size,
+               w, h, y0, y1);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_draw_triangle_gbuffer(PyObject* self, PyObject* args)
+{
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    unsigned long long depth_buffer_ptr;
+    int ds_x, ds_y;
+    unsigned long long ids_ptr;
+    int is_x, is_y;
+    unsigned long long linear_ptr;
+    int ls_x, ls_y;
+    unsigned long long normals_ptr;
+    int ns_x, ns_y, ns_c;
+    unsigned long long motion_ptr;
+    int ms_x, ms_y, ms_c;
+    int id;
+    float normal[3];
+    float vertex_motion[6];
+    float q, znear;
+    float p1xf, p1yf, p1z;
+    float p2xf, p2yf, p2z;
+    float p3xf, p3yf, p3z;
+    uint8_t R, G, B;
+    int w, h;
+
+    if (!PyArg_ParseTuple(args, "KiiiKiiKiiKiiKiiiKiiii(fff)(ffffff)fffffffffffbbbii:draw_triangle_gbuffer",
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &depth_buffer_ptr, &ds_x, &ds_y,
+                          &ids_ptr, &is_x, &is_y,
+                          &linear_ptr, &ls_x, &ls_y,
+                          &normals_ptr, &ns_x, &ns_y, &ns_c,
+                          &motion_ptr, &ms_x, &ms_y, &ms_c,
+                          &id, &normal[0], &normal[1], &normal[2],
+                          &vertex_motion[0], &vertex_motion[1], &vertex_motion[2],
+                          &vertex_motion[3], &vertex_motion[4], &vertex_motion[5],
+                          &q, &znear,
+                          &p1xf, &p1yf, &p1z,
+                          &p2xf, &p2yf, &p2z,
+                          &p3xf, &p3yf, &p3z,
+                          &R, &G, &B, &w, &h))
+        return NULL;
+
+    draw_triangle_gbuffer((uint8_t*) buffer_ptr, bs_x, bs_y, bs_c,
+                          (float*) depth_buffer_ptr, ds_x, ds_y,
+                          (int32_t*) ids_ptr, is_x, is_y,
+                          (float*) linear_ptr, ls_x, ls_y,
+                          (float*) normals_ptr, ns_x, ns_y, ns_c,
+                          (float*) motion_ptr, ms_x, ms_y, ms_c,
+                          id, normal, vertex_motion, q, znear,
+                          p1xf, p1yf, p1z,
+                          p2xf, p2yf, p2z,
+                          p3xf, p3yf, p3z,
+                          R, G, B, w, h);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_raster_ids(PyObject* self, PyObject* args)
+{
+    unsigned long long vertices_ptr, faces_ptr, face_ids_ptr;
+    int n_faces;
+    float eye[3], dir[3], up[3], right[3];
+    float f, znear, zfar;
+    int w, h;
+    unsigned long long ids_ptr, depth_buffer_ptr;
+
+    if (!PyArg_ParseTuple(args, "KKKi(fff)(fff)(fff)(fff)fffiiKK:raster_ids",
+                          &vertices_ptr, &faces_ptr, &face_ids_ptr, &n_faces,
+                          &eye[0], &eye[1], &eye[2],
+                          &dir[0], &dir[1], &dir[2],
+                          &up[0], &up[1], &up[2],
+                          &right[0], &right[1], &right[2],
+                          &f, &znear, &zfar, &w, &h,
+                          &ids_ptr, &depth_buffer_ptr))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    raster_ids((const float*) vertices_ptr, (const int32_t*) faces_ptr,
+               (const int32_t*) face_ids_ptr, n_faces,
+               eye, dir, up, right, f, znear, zfar, w, h,
+               (int32_t*) ids_ptr, (float*) depth_buffer_ptr);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_draw_sprite(PyObject* self, PyObject* args)
+{
+    unsigned long long buffer_ptr;
+    int bs_x, bs_y, bs_c;
+    unsigned long long depth_buffer_ptr;
+    int ds_x, ds_y;
+    unsigned long long sprite_ptr;
+    int ss_x, ss_y, ss_c;
+    unsigned long long sprite_depth_ptr;
+    int sds_x, sds_y;
+    int sw, sh;
+    float empty, x0, y0, size, depth_offset;
+    int w, h;
+
+    if (!PyArg_ParseTuple(args, "KiiiKiiKiiiKiiiifffffii:draw_sprite",
+                          &buffer_ptr, &bs_x, &bs_y, &bs_c,
+                          &depth_buffer_ptr, &ds_x, &ds_y,
+                          &sprite_ptr, &ss_x, &ss_y, &ss_c,
+                          &sprite_depth_ptr, &sds_x, &sds_y,
+                          &sw, &sh, &empty,
+                          &x0, &y0, &size, &depth_offset,
+                          &w, &h))
+        return NULL;
+
+    draw_sprite((uint8_t*) buffer_ptr, bs_x, bs_y, bs_c,
+                (float*) depth_buffer_ptr, ds_x, ds_y,
+                (const uint8_t*) sprite_ptr, ss_x, ss_y, ss_c,
+                (const float*) sprite_depth_ptr, sds_x, sds_y,
+                sw, sh, empty, x0, y0, size, depth_offset, w, h);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_build_hiz(PyObject* self, PyObject* args)
+{
+    unsigned long long src_ptr;
+    int s_x, s_y, sw, sh;
+    unsigned long long dst_ptr;
+    int dw, dh;
+
+    if (!PyArg_ParseTuple(args, "KiiiiKii:build_hiz",
+                          &src_ptr, &s_x, &s_y, &sw, &sh,
+                          &dst_ptr, &dw, &dh))
+        return NULL;
+
+    build_hiz((const float*) src_ptr, s_x, s_y, sw, sh, (float*) dst_ptr, dw, dh);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_set_transforms(PyObject* self, PyObject* args)
+{
+    unsigned long long handles_ptr;
+    int n;
+    unsigned long long positions_ptr, rotations_ptr;
+    unsigned long long scene_positions_ptr, scene_rotations_ptr;
+    unsigned long long dirty_ptr;
+
+    if (!PyArg_ParseTuple(args, "KiKKKKK:set_transforms",
+                          &handles_ptr, &n,
+                          &positions_ptr, &rotations_ptr,
+                          &scene_positions_ptr, &scene_rotations_ptr,
+                          &dirty_ptr))
+        return NULL;
+
+    set_transforms((const int64_t*) handles_ptr, n,
+                   (const double*) positions_ptr, (const double*) rotations_ptr,
+                   (double*) scene_positions_ptr, (double*) scene_rotations_ptr,
+                   (uint8_t*) dirty_ptr);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_build_bvh(PyObject* self, PyObject* args)
+{
+    unsigned long long vertices_ptr, faces_ptr;
+    int n_faces;
+    unsigned long long nodes_ptr, indices_ptr;
+
+    if (!PyArg_ParseTuple(args, "KKiKK:build_bvh",
+                          &vertices_ptr, &faces_ptr, &n_faces,
+                          &nodes_ptr, &indices_ptr))
+        return NULL;
+
+    int n_nodes = build_bvh((const float*) vertices_ptr, (const int32_t*) faces_ptr,
+                            n_faces, (BVHNode*) nodes_ptr, (int32_t*) indices_ptr);
+
+    return PyLong_FromLong(n_nodes);
+}
+
+static PyObject* py_replay_triangles(PyObject* self, PyObject* args)
+{
+    int kernel;
+    unsigned long long triangles_ptr;
+    int count;
+    unsigned long long targets_ptr;
+    unsigned long long params_ptr;
+    int w, h;
+
+    if (!PyArg_ParseTuple(args, "iKiKKii:replay_triangles",
+                          &kernel, &triangles_ptr, &count,
+                          &targets_ptr, &params_ptr, &w, &h))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    replay_triangles(kernel, (const CapturedTriangle*) triangles_ptr, count,
+                     (const uint64_t*) targets_ptr, (const int32_t*) params_ptr, w, h);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_alloc_hooks_install(PyObject* self, PyObject* args)
+{
+    alloc_hooks_install();
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_alloc_hooks_remove(PyObject* self, PyObject* args)
+{
+    alloc_hooks_remove();
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_alloc_counts(PyObject* self, PyObject* args)
+{
+    unsigned long long values_ptr;
+
+    if (!PyArg_ParseTuple(args, "K:alloc_counts", &values_ptr))
+        return NULL;
+
+    alloc_counts((int64_t*) values_ptr);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_perf_open(PyObject* self, PyObject* args)
+{
+    unsigned long long fds_ptr;
+
+    if (!PyArg_ParseTuple(args, "K:perf_open", &fds_ptr))
+        return NULL;
+
+    perf_open((int32_t*) fds_ptr);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_perf_read(PyObject* self, PyObject* args)
+{
+    unsigned long long fds_ptr;
+    unsigned long long values_ptr;
+
+    if (!PyArg_ParseTuple(args, "KK:perf_read", &fds_ptr, &values_ptr))
+        return NULL;
+
+    perf_read((const int32_t*) fds_ptr, (int64_t*) values_ptr);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_perf_close(PyObject* self, PyObject* args)
+{
+    unsigned long long fds_ptr;
+
+    if (!PyArg_ParseTuple(args, "K:perf_close", &fds_ptr))
+        return NULL;
+
+    perf_close((int32_t*) fds_ptr);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_bake_ao(PyObject* self, PyObject* args)
+{
+    unsigned long long vertices_ptr, normals_ptr, faces_ptr;
+    unsigned long long nodes_ptr, indices_ptr;
+    int samples;
+    float distance, bias;
+    int start, stop;
+    unsigned long long ao_ptr;
+
+    if (!PyArg_ParseTuple(args, "KKKKKiffiiK:bake_ao",
+                          &vertices_ptr, &normals_ptr, &faces_ptr,
+                          &nodes_ptr, &indices_ptr,
+                          &samples, &distance, &bias,
+                          &start, &stop, &ao_ptr))
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    bake_ao((const float*) vertices_ptr, (const float*) normals_ptr,
+            (const int32_t*) faces_ptr, (const BVHNode*) nodes_ptr,
+            (const int32_t*) indices_ptr,
+            samples, distance, bias, start, stop, (float*) ao_ptr);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
 }
 
 static PyMethodDef ext_rendering_methods[] = {
 	{"draw_triangle",  py_draw_triangle, METH_VARARGS, draw_triangle__doc__},
+    {"draw_triangle_simd",  py_draw_triangle_simd, METH_VARARGS, draw_triangle_simd__doc__},
+    {"draw_triangles",  py_draw_triangles, METH_VARARGS, draw_triangles__doc__},
+    {"execute_commands",  py_execute_commands, METH_VARARGS, execute_commands__doc__},
     {"fill_bg",  py_fill_bg, METH_VARARGS, fill_bg__doc__},
+    {"span_triangle",  py_span_triangle, METH_VARARGS, span_triangle__doc__},
+    {"resolve_spans",  py_resolve_spans, METH_VARARGS, resolve_spans__doc__},
+    {"clear_depth_tiles",  py_clear_depth_tiles, METH_VARARGS, clear_depth_tiles__doc__},
+    {"draw_triangle_tiles",  py_draw_triangle_tiles, METH_VARARGS, draw_triangle_tiles__doc__},
+    {"copy_depth_tiles",  py_copy_depth_tiles, METH_VARARGS, copy_depth_tiles__doc__},
+    {"clear_frame_tiles",  py_clear_frame_tiles, METH_VARARGS, clear_frame_tiles__doc__},
+    {"draw_triangle_frame",  py_draw_triangle_frame, METH_VARARGS, draw_triangle_frame__doc__},
+    {"copy_frame_tiles",  py_copy_frame_tiles, METH_VARARGS, copy_frame_tiles__doc__},
+    {"draw_triangle_packed",  py_draw_triangle_packed, METH_VARARGS, draw_triangle_packed__doc__},
+    {"expand_packed",  py_expand_packed, METH_VARARGS, expand_packed__doc__},
+    {"fxaa",  py_fxaa, METH_VARARGS, fxaa__doc__},
+    {"reconstruct_checker",  py_reconstruct_checker, METH_VARARGS, reconstruct_checker__doc__},
+    {"post_chain",  py_post_chain, METH_VARARGS, post_chain__doc__},
+    {"draw_triangle_gbuffer",  py_draw_triangle_gbuffer, METH_VARARGS, draw_triangle_gbuffer__doc__},
+    {"raster_ids",  py_raster_ids, METH_VARARGS, raster_ids__doc__},
+    {"draw_sprite",  py_draw_sprite, METH_VARARGS, draw_sprite__doc__},
+    {"build_hiz",  py_build_hiz, METH_VARARGS, build_hiz__doc__},
+    {"set_transforms",  py_set_transforms, METH_VARARGS, set_transforms__doc__},
+    {"build_bvh",  py_build_bvh, METH_VARARGS, build_bvh__doc__},
+    {"bake_ao",  py_bake_ao, METH_VARARGS, bake_ao__doc__},
+    {"replay_triangles",  py_replay_triangles, METH_VARARGS, replay_triangles__doc__},
+    {"alloc_hooks_install",  py_alloc_hooks_install, METH_NOARGS, alloc_hooks_install__doc__},
+    {"alloc_hooks_remove",  py_alloc_hooks_remove, METH_NOARGS, alloc_hooks_remove__doc__},
+    {"alloc_counts",  py_alloc_counts, METH_VARARGS, alloc_counts__doc__},
+    {"perf_open",  py_perf_open, METH_VARARGS, perf_open__doc__},
+    {"perf_read",  py_perf_read, METH_VARARGS, perf_read__doc__},
+    {"perf_close",  py_perf_close, METH_VARARGS, perf_close__doc__},
 	{NULL, NULL}
 };
 
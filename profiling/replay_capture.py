@@ -0,0 +1,20 @@
+import sys
+import py3dgame as p3g
+from py3dgame.capture import KERNELS
+
+
+def replay_kernels(path: str, repeat: int = 20):
+    """
+    Time each raster kernel on the triangles of a frame capture.
+    """
+
+    capture = p3g.FrameCapture.load(path)
+    print(f"{len(capture.triangles)} triangles on {capture.w}x{capture.h}")
+
+    for kernel in KERNELS:
+        times = p3g.replay(capture, kernel, repeat)
+        print(f"{kernel:12} best {min(times) * 1000:8.3f} ms  "
+              f"mean {sum(times) / len(times) * 1000:8.3f} ms")
+
+if __name__ == "__main__":
+    replay_kernels(sys.argv[1])
@@ -6,3 +6,14 @@ from .color import Color
 from .rendering import Camera, Renderer
 from .scene import Body, Scene
 from .math3d import Vec3, Quat, Mat
+from .visibility import Cell, Portal, CellGraph, PVS
+from .post import FXAA, PostChain, Fog, Tonemap, ColorGrade
+from .gbuffer import GBuffer
+from .poster import Poster, PNGWriter
+from .pacing import FramePacer
+from .stats import Stats, Histogram, BodyCosts
+from .counters import PerfCounters, AllocationCounters
+from .capture import FrameCapture, replay
+from .backends import ScalarBackend, SimdBackend, NumpyBackend, ThreadedBackend, select_backend
+from .commands import CommandBuffer
+from .shading import FaceShading, SpanShading, FACE_SHADER, SPAN_SHADER
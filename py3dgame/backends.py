@@ -0,0 +1,309 @@
+"""
+Rasterizers drawing the faces on the color and depth buffers of a renderer.
+"""
+
+import time
+from types import SimpleNamespace
+import numpy as np
+from ext_rendering import draw_triangle, draw_triangle_simd, draw_triangles, fill_bg
+from .post import RowPass
+
+
+class ScalarBackend:
+    """
+    Native rasterizer testing one pixel at a time, the default one.
+    """
+
+    __slots__ = []
+
+    name = "scalar"
+
+    def fill(self, renderer) -> None:
+        """
+        Fill the color buffer of a renderer with the background of the scene.
+
+        :param renderer: renderer to clear
+        :type renderer: Renderer
+        """
+
+        fill_bg(
+            renderer.buffer_ptr,
+            *renderer.buffer.strides,
+            *renderer.scene.bgc, renderer.camera.w, renderer.camera.h
+        )
+
+    def draw(self,
+        renderer,
+        point1: tuple[float, float, float],
+        point2: tuple[float, float, float],
+        point3: tuple[float, float, float],
+        color: tuple[int, int, int]) -> int:
+        """
+        Draw a triangle in screen space on the buffers of a renderer, only the
+        pixels of ``renderer.parity`` on a checkerboard frame.
+
+        :param renderer: renderer drawing the face
+        :type renderer: Renderer
+        :param point1: first vertex as x, y and depth
+        :type point1: tuple[float, float, float]
+        :param point2: second vertex as x, y and depth
+        :type point2: tuple[float, float, float]
+        :param point3: third vertex as x, y and depth
+        :type point3: tuple[float, float, float]
+        :param color: RGB color of the triangle
+        :type color: tuple[int, int, int]
+        :return: number of pixels written
+        :rtype: int
+        """
+
+        return draw_triangle(
+            renderer.buffer_ptr, *renderer.buffer.strides,
+            renderer.depth_ptr, *renderer.depth.strides,
+            *point1, *point2, *point3, *color,
+            renderer.camera.w, renderer.camera.h, renderer.parity
+        )
+
+    def flush(self, renderer) -> int:  # pylint: disable=unused-argument
+        """
+        Draw the triangles kept by :meth:`draw`, for the backends that defer them.
+
+        :param renderer: renderer drawing the faces
+        :type renderer: Renderer
+        :return: number of pixels written
+        :rtype: int
+        """
+
+        return 0
+
+
+class SimdBackend(ScalarBackend):
+    """
+    Native rasterizer computing the edge functions and the depth of 4 pixels
+    of a row at once with the vector extensions of the compiler, the scalar
+    one when they are not available. On the pygame layout the depth of the 4
+    pixels is tested and written as a vector, and their colors with a single
+    store when they all pass, which pays off on faces of more than a few
+    pixels. It writes the same pixels as the scalar one.
+    """
+
+    __slots__ = []
+
+    name = "simd"
+
+    def draw(self,
+        renderer,
+        point1: tuple[float, float, float],
+        point2: tuple[float, float, float],
+        point3: tuple[float, float, float],
+        color: tuple[int, int, int]) -> int:
+
+        return draw_triangle_simd(
+            renderer.buffer_ptr, *renderer.buffer.strides,
+            renderer.depth_ptr, *renderer.depth.strides,
+            *point1, *point2, *point3, *color,
+            renderer.camera.w, renderer.camera.h, renderer.parity
+        )
+
+
+class NumpyBackend(ScalarBackend):
+    """
+    Rasterizer written with NumPy, testing the bounding box of a triangle as
+    a whole. It writes the same pixels as the native ones, whose rounding it
+    follows, and serves as reference and fallback.
+    """
+
+    __slots__ = []
+
+    name = "numpy"
+
+    def fill(self, renderer) -> None:
+        renderer.buffer[:renderer.camera.w, :renderer.camera.h] = tuple(renderer.scene.bgc)
+
+    def draw(self,
+        renderer,
+        point1: tuple[float, float, float],
+        point2: tuple[float, float, float],
+        point3: tuple[float, float, float],
+        color: tuple[int, int, int]) -> int:
+
+        # the native rasterizers receive the coordinates as float32
+        (p1x, p1y, p1z), (p2x, p2y, p2z), (p3x, p3y, p3z) = (
+            np.array((point1, point2, point3), dtype=np.float32))
+        p1x, p1y, p2x, p2y, p3x, p3y = (int(p) for p in (p1x, p1y, p2x, p2y, p3x, p3y))
+
+        min_x = max(min(p1x, p2x, p3x), 0)
+        max_x = min(max(p1x, p2x, p3x), renderer.camera.w - 1)
+        min_y = max(min(p1y, p2y, p3y), 0)
+        max_y = min(max(p1y, p2y, p3y), renderer.camera.h - 1)
+        area = (p3y - p1y) * (p2x - p3x) - (p3x - p1x) * (p2y - p3y)
+
+        if min_x > max_x or min_y > max_y or area == 0:
+            return 0
+
+        x = np.arange(min_x, max_x + 1)[:, None]
+        y = np.arange(min_y, max_y + 1)[None, :]
+        s1 = (p1y - p2y) * x - (p1x - p2x) * y + (p1x - p2x) * p2y - (p1y - p2y) * p2x
+        s2 = (p2y - p3y) * x - (p2x - p3x) * y + (p2x - p3x) * p3y - (p2y - p3y) * p3x
+        s3 = (p3y - p1y) * x - (p3x - p1x) * y + (p3x - p1x) * p1y - (p3y - p1y) * p1x
+        inside = ((s1 > 0) & (s2 > 0) & (s3 > 0)) | ((s1 <= 0) & (s2 <= 0) & (s3 <= 0))
+
+        if renderer.parity >= 0:
+            inside &= (x + y) % 2 == renderer.parity
+
+        depth = (p1z * s2.astype(np.float32) + p2z * s3.astype(np.float32) +
+                 p3z * s1.astype(np.float32)) * (np.float32(1) / np.float32(area))
+        depth_rect = renderer.depth[min_x:max_x + 1, min_y:max_y + 1]
+        written = inside & (depth < depth_rect)
+        depth_rect[written] = depth[written]
+        renderer.buffer[min_x:max_x + 1, min_y:max_y + 1][written] = tuple(color)
+
+        return int(np.count_nonzero(written))
+
+
+class ThreadedBackend(RowPass, ScalarBackend):
+    """
+    Native rasterizer keeping the triangles of the frame and drawing them at
+    :meth:`flush`, when the renderer resolves the frame, on bands of rows
+    split among ``workers`` threads. Each band draws the triangles in the
+    order they were submitted, so the pixels are the same as the scalar
+    rasterizer, but the pixels of a body are not known while it is drawn.
+
+    :param workers: number of threads, defaults to the number of cores
+    :type workers: int, optional
+    """
+
+    __slots__ = ["points", "colors"]
+
+    name = "threaded"
+
+    def __init__(self, workers: int = None) -> None:
+        super().__init__(workers)
+        self.points = []
+        self.colors = []
+
+    def draw(self,
+        renderer,
+        point1: tuple[float, float, float],
+        point2: tuple[float, float, float],
+        point3: tuple[float, float, float],
+        color: tuple[int, int, int]) -> int:
+
+        self.points.append((*point1, *point2, *point3))
+        self.colors.append(tuple(color))
+
+        return 0
+
+    def flush(self, renderer) -> int:
+        if not self.points:
+            return 0
+
+        points = np.array(self.points, dtype=np.float32)
+        colors = np.array(self.colors, dtype=np.uint8)
+        self.points = []
+        self.colors = []
+        buffer = renderer.buffer
+        depth = renderer.depth
+        buffer_strides = tuple(buffer.strides)
+        depth_strides = tuple(depth.strides)
+        written = []
+
+        def apply_rows(start: int, stop: int) -> None:
+            written.append(draw_triangles(
+                points.ctypes.data, colors.ctypes.data, len(points),
+                buffer.ctypes.data, *buffer_strides,
+                depth.ctypes.data, *depth_strides,
+                renderer.camera.w, renderer.parity, start, stop
+            ))
+
+        self.run(apply_rows, renderer.camera.h)
+
+        return sum(written)
+
+
+BACKENDS = {
+    "numpy": NumpyBackend,
+    "scalar": ScalarBackend,
+    "simd": SimdBackend,
+    "threaded": ThreadedBackend
+}
+
+
+def calibrate(
+    names: list[str] = None,
+    width: int = 320,
+    height: int = 240,
+    triangles: int = 200,
+    repeat: int = 3) -> dict[str, float]:
+    """
+    Time the backends on a fixed set of random triangles, with a stand-in for
+    the renderer holding only the buffers.
+
+    :param names: backends to time, defaults to all of ``BACKENDS``
+    :type names: list[str], optional
+    :param width: width of the buffers, defaults to 320
+    :type width: int, optional
+    :param height: height of the buffers, defaults to 240
+    :type height: int, optional
+    :param triangles: number of triangles drawn, defaults to 200
+    :type triangles: int, optional
+    :param repeat: number of runs, the best one is kept, defaults to 3
+    :type repeat: int, optional
+    :return: seconds taken by each backend
+    :rtype: dict[str, float]
+    """
+
+    buffer = np.zeros((width, height, 3), dtype=np.uint8)
+    depth = np.zeros((width, height), dtype=np.float32)
+    target = SimpleNamespace(buffer=buffer, depth=depth,
+                             buffer_ptr=buffer.ctypes.data, depth_ptr=depth.ctypes.data,
+                             camera=SimpleNamespace(w=width, h=height),
+                             scene=SimpleNamespace(bgc=(0, 0, 0)), parity=-1)
+
+    rng = np.random.default_rng(0)
+    centers = rng.uniform((0, 0, 1), (width, height, 100), (triangles, 1, 3))
+    offsets = rng.uniform(-width / 8, width / 8, (triangles, 3, 3))
+    offsets[:, :, 2] = 0
+    points = (centers + offsets).tolist()
+    colors = rng.integers(0, 256, (triangles, 3)).tolist()
+    times = {}
+
+    for name in names or BACKENDS:
+        backend = BACKENDS[name]()
+        best = None
+
+        for _ in range(repeat):
+            depth.fill(100)
+            start = time.perf_counter()
+            backend.fill(target)
+
+            for (point1, point2, point3), color in zip(points, colors):
+                backend.draw(target, point1, point2, point3, color)
+
+            backend.flush(target)
+            elapsed = time.perf_counter() - start
+            best = elapsed if best is None else min(best, elapsed)
+
+        times[name] = best
+
+    return times
+
+
+def select_backend(name: str = "auto"):
+    """
+    Create a backend by name, or the fastest native one on this machine for
+    ``"auto"`` according to :func:`calibrate`.
+
+    :param name: key of ``BACKENDS`` or ``"auto"``, defaults to "auto"
+    :type name: str, optional
+    :return: the backend, to set in :attr:`py3dgame.rendering.Renderer.backend`
+    :rtype: ScalarBackend
+    """
+
+    if name == "auto":
+        times = calibrate([key for key in BACKENDS if key != "numpy"])
+        name = min(times, key=times.get)
+
+    if name not in BACKENDS:
+        raise ValueError(f"Unknown backend {name}")
+
+    return BACKENDS[name]()
@@ -0,0 +1,210 @@
+"""
+Offline precomputations that are too expensive to be done at runtime.
+"""
+
+import os
+from concurrent.futures import ThreadPoolExecutor
+import numpy as np
+from ext_rendering import build_bvh, bake_ao, raster_ids
+from .math3d import Vec3
+from .visibility import PVS
+
+CUBE_FACES = (
+    ((1, 0, 0), (0, 0, 1)),
+    ((- 1, 0, 0), (0, 0, 1)),
+    ((0, 1, 0), (0, 0, 1)),
+    ((0, - 1, 0), (0, 0, 1)),
+    ((0, 0, 1), (1, 0, 0)),
+    ((0, 0, - 1), (1, 0, 0)),
+)
+
+
+def vertex_normals(vertices: np.ndarray, faces: np.ndarray) -> np.ndarray:
+    """
+    Compute the outward normal of each vertex as the area weighted average
+    of the normals of the faces that share it.
+
+    :param vertices: N x 3 array of vertices
+    :type vertices: np.ndarray
+    :param faces: F x 3 array of indexes of the vertices
+    :type faces: np.ndarray
+    :return: N x 3 array of normalized vertex normals
+    :rtype: np.ndarray
+    """
+
+    v1 = vertices[faces[:, 0]]
+    v2 = vertices[faces[:, 1]]
+    v3 = vertices[faces[:, 2]]
+    # Body normals point inside the mesh, the hemispheres must face outside
+    face_normals = np.cross(v2 - v1, v3 - v1)
+    normals = np.zeros_like(vertices)
+
+    for k in range(3):
+        np.add.at(normals, faces[:, k], face_normals)
+
+    length = np.linalg.norm(normals, axis=1, keepdims=True)
+
+    return normals / np.where(length > 0, length, 1)
+
+
+def ambient_occlusion(
+    vertices: np.ndarray,
+    faces: np.ndarray,
+    samples: int = 64,
+    distance: float = None,
+    workers: int = None) -> np.ndarray:
+    """
+    Bake the ambient occlusion of each vertex casting ``samples`` cosine weighted
+    hemisphere rays against the BVH of the mesh itself. The vertices are split
+    among ``workers`` threads that run the native ray caster in parallel.
+
+    :param vertices: N x 3 array of vertices
+    :type vertices: np.ndarray
+    :param faces: F x 3 array of indexes of the vertices
+    :type faces: np.ndarray
+    :param samples: rays per vertex, defaults to 64
+    :type samples: int, optional
+    :param distance: maximum distance of an occluder, defaults to
+        half of the diagonal of the bounding box
+    :type distance: float, optional
+    :param workers: number of threads, defaults to the number of cores
+    :type workers: int, optional
+    :return: ambient term of each vertex, 1 if not occluded, 0 if fully occluded
+    :rtype: np.ndarray
+    """
+
+    vertices = np.ascontiguousarray(vertices, dtype=np.float32)
+    faces = np.ascontiguousarray(faces, dtype=np.int32)
+    ao = np.ones(len(vertices), dtype=np.float32)
+
+    if len(faces) == 0 or samples <= 0:
+        return ao
+
+    normals = np.ascontiguousarray(vertex_normals(vertices, faces), dtype=np.float32)
+
+    nodes = np.zeros((2 * len(faces), 8), dtype=np.float32)
+    indices = np.zeros(len(faces), dtype=np.int32)
+    build_bvh(vertices.ctypes.data, faces.ctypes.data, len(faces),
+              nodes.ctypes.data, indices.ctypes.data)
+
+    diagonal = float(np.linalg.norm(vertices.max(axis=0) - vertices.min(axis=0)))
+
+    if distance is None:
+        distance = diagonal / 2
+
+    bias = diagonal * 1e-4
+    workers = workers or os.cpu_count() or 1
+    bounds = np.linspace(0, len(vertices), workers + 1, dtype=np.int64).tolist()
+
+    def bake_range(start: int, stop: int) -> None:
+        bake_ao(vertices.ctypes.data, normals.ctypes.data, faces.ctypes.data,
+                nodes.ctypes.data, indices.ctypes.data,
+                samples, distance, bias, start, stop, ao.ctypes.data)
+
+    with ThreadPoolExecutor(max_workers=workers) as executor:
+        list(executor.map(bake_range, bounds[:-1], bounds[1:]))
+
+    return ao
+
+
+def merge_bodies(scene) -> tuple[np.ndarray, np.ndarray, np.ndarray]:
+    """
+    Merge the meshes of all the bodies in a scene, in world coordinates.
+
+    :param scene: scene with the bodies
+    :type scene: Scene
+    :return: vertices, faces and for each face the handle of its body plus one
+    :rtype: tuple[np.ndarray, np.ndarray, np.ndarray]
+    """
+
+    vertices = [np.zeros((0, 3))]
+    faces = [np.zeros((0, 3), dtype=np.int32)]
+    face_ids = [np.zeros(0, dtype=np.int32)]
+    offset = 0
+
+    for handle, body in enumerate(scene.handles):
+        if body is None:
+            continue
+
+        vertices.append(np.array([(v.x, v.y, v.z) for v in body.v]).reshape(-1, 3))
+        faces.append(np.array(body.f, dtype=np.int32).reshape(-1, 3) + offset)
+        face_ids.append(np.full(len(body.f), handle + 1, dtype=np.int32))
+        offset += len(body.v)
+
+    return (np.ascontiguousarray(np.concatenate(vertices), dtype=np.float32),
+            np.ascontiguousarray(np.concatenate(faces), dtype=np.int32),
+            np.ascontiguousarray(np.concatenate(face_ids), dtype=np.int32))
+
+
+def potentially_visible_set(
+    scene,
+    low: Vec3,
+    high: Vec3,
+    resolution: tuple[int, int, int] = (8, 8, 1),
+    samples: int = 4,
+    size: int = 128,
+    workers: int = None) -> PVS:
+    """
+    Bake the potentially visible set of the bodies currently in a static scene.
+    From ``samples`` points inside each cell of the grid the scene is rasterized
+    into an id buffer in the six directions of a cube, every body that leaves at
+    least a pixel is visible from the cell. The cells are split among ``workers``
+    threads that run the native rasterizer in parallel.
+
+    :param scene: scene with the static bodies
+    :type scene: Scene
+    :param low: corner of the grid with the lowest coordinates
+    :type low: Vec3
+    :param high: corner of the grid with the highest coordinates
+    :type high: Vec3
+    :param resolution: number of cells along x, y and z, defaults to (8, 8, 1)
+    :type resolution: tuple[int, int, int], optional
+    :param samples: points of view inside each cell, the first one is the center,
+        defaults to 4
+    :type samples: int, optional
+    :param size: side in pixels of each face of the cube, defaults to 128
+    :type size: int, optional
+    :param workers: number of threads, defaults to the number of cores
+    :type workers: int, optional
+    :return: the baked set
+    :rtype: PVS
+    """
+
+    scene.update()
+    vertices, faces, face_ids = merge_bodies(scene)
+    low_array = np.array((low.x, low.y, low.z))
+    cell_size = (np.array((high.x, high.y, high.z)) - low_array) / resolution
+    n_cells = int(np.prod(resolution))
+    cells = np.stack(np.unravel_index(np.arange(n_cells), resolution), axis=1)
+    offsets = np.random.default_rng(0).random((n_cells, samples, 3))
+    offsets[:, 0] = 0.5
+    points = low_array + (cells[:, None, :] + offsets) * cell_size
+    diagonal = float(np.linalg.norm(vertices.max(axis=0) - vertices.min(axis=0))) \
+        if len(vertices) else 1.0
+    zfar = diagonal + float(np.linalg.norm(cell_size * resolution))
+    visible = np.zeros((n_cells, len(scene.handles)), dtype=bool)
+
+    def bake_cell(cell: int) -> None:
+        ids = np.empty(size * size, dtype=np.int32)
+        depth = np.empty(size * size, dtype=np.float32)
+
+        for point in points[cell].tolist():
+            for direction, up in CUBE_FACES:
+                right = tuple(np.cross(direction, up).tolist())
+                raster_ids(vertices.ctypes.data, faces.ctypes.data, face_ids.ctypes.data,
+                           len(faces), tuple(point), direction, up, right,
+                           1.0, 1e-3, zfar, size, size, ids.ctypes.data, depth.ctypes.data)
+                seen = np.unique(ids)
+                visible[cell, seen[seen > 0] - 1] = True
+
+    workers = workers or os.cpu_count() or 1
+
+    with ThreadPoolExecutor(max_workers=workers) as executor:
+        list(executor.map(bake_cell, range(n_cells)))
+
+    rows, cell_rows = np.unique(np.packbits(visible, axis=1), axis=0, return_inverse=True)
+
+    names = ["" if body is None else body.name for body in scene.handles]
+
+    return PVS(low, high, resolution, len(scene.handles),
+               rows, cell_rows.reshape(-1).astype(np.int32), names)
@@ -0,0 +1,322 @@
+"""
+Capture of the triangles of a frame and replay on the raster kernels.
+"""
+
+import struct
+import time
+from typing import BinaryIO
+import numpy as np
+from ext_rendering import replay_triangles
+from .spans import SpanBuffer
+from .depth import CompressedDepth
+from .framebuffer import TiledFramebuffer, CompactFramebuffer
+
+MAGIC = b"P3GC"
+VERSION = 1
+# magic, version, width, height, zfar, background, parity, color format, triangles
+HEADER = struct.Struct("<4sHIIf3sb8sI")
+# Layout of the CapturedTriangle struct of ext_rendering
+TRIANGLE = np.dtype([("points", "<f4", (9,)), ("color", "u1", (3,)), ("pad", "u1"),
+                     ("value", "<u2"), ("pad2", "<u2")])
+KERNELS = {"triangle": 0, "checker": 0, "spans": 1, "depth_tiles": 2,
+           "frame_tiles": 3, "rgb565": 4, "palette": 4}
+
+
+class FrameCapture:
+    """
+    Every triangle of a frame submitted to the raster stage, after transform
+    and culling, with the screen size and the formats of the buffers. Set it
+    in :attr:`py3dgame.rendering.Renderer.frame_capture` or use :meth:`record`,
+    then :meth:`save` writes a file that :meth:`load` and :func:`replay` read
+    back without a scene. The faces of the command buffers, drawn natively
+    in a single call, are not captured, nor the sprites of the impostors,
+    which :attr:`py3dgame.rendering.Renderer.triangles` counts as two
+    triangles each.
+
+    The file is the header followed by 44 bytes per triangle: the screen
+    coordinates and depth of the three vertices as float32, the RGB color and
+    the packed color when the frame used ``color_format``.
+    """
+
+    __slots__ = ["w", "h", "zfar", "background", "parity", "color_format",
+                 "pending", "triangles"]
+
+    def __init__(self) -> None:
+        self.w = 0
+        self.h = 0
+        self.zfar = 0
+        self.background = (0, 0, 0)
+        self.parity = -1
+        self.color_format = "rgb"
+        self.pending = []
+        self.triangles = np.zeros(0, dtype=TRIANGLE)
+
+    def begin(self, renderer) -> None:
+        """
+        Start a new frame, forgetting the triangles captured before.
+
+        :param renderer: renderer drawing the frame, already cleared
+        :type renderer: Renderer
+        """
+
+        self.w = renderer.camera.w
+        self.h = renderer.camera.h
+        self.zfar = renderer.camera.zfar
+        self.background = tuple(renderer.scene.bgc)
+        self.parity = renderer.parity
+        self.color_format = renderer.color_format if renderer.packed else "rgb"
+        self.pending = []
+        self.triangles = np.zeros(0, dtype=TRIANGLE)
+
+    def add(self,
+        point1: tuple[float, float, float],
+        point2: tuple[float, float, float],
+        point3: tuple[float, float, float],
+        color: tuple[int, int, int] | int) -> None:
+        """
+        Append a triangle in screen space.
+
+        :param point1: first vertex as x, y and depth
+        :type point1: tuple[float, float, float]
+        :param point2: second vertex as x, y and depth
+        :type point2: tuple[float, float, float]
+        :param point3: third vertex as x, y and depth
+        :type point3: tuple[float, float, float]
+        :param color: RGB color of the triangle, or its packed value
+        :type color: tuple[int, int, int] | int
+        """
+
+        self.pending.append((point1, point2, point3, color))
+
+    def end(self) -> None:
+        """
+        Convert the triangles of the frame to the layout of the file.
+        """
+
+        triangles = np.zeros(len(self.pending), dtype=TRIANGLE)
+
+        if self.pending:
+            triangles["points"] = [(*point1, *point2, *point3)
+                                   for point1, point2, point3, _ in self.pending]
+            colors = [color for *_, color in self.pending]
+
+            if self.color_format == "rgb":
+                triangles["color"] = colors
+            else:
+                triangles["value"] = colors
+
+        self.triangles = triangles
+        self.pending = []
+
+    def record(self, renderer) -> 'FrameCapture':
+        """
+        Render a frame capturing its triangles.
+
+        :param renderer: renderer with the scene
+        :type renderer: Renderer
+        :return: the capture itself
+        :rtype: FrameCapture
+        """
+
+        previous = renderer.frame_capture
+        renderer.frame_capture = self
+
+        try:
+            renderer.render()
+        finally:
+            renderer.frame_capture = previous
+
+        return self
+
+    def save(self, file: str | BinaryIO) -> None:
+        """
+        Write the capture.
+
+        :param file: path or binary file
+        :type file: str | BinaryIO
+        """
+
+        header = HEADER.pack(MAGIC, VERSION, self.w, self.h, self.zfar,
+                             bytes(self.background), self.parity,
+                             self.color_format.encode(), len(self.triangles))
+
+        if isinstance(file, str):
+            with open(file, "wb") as stream:
+                stream.write(header)
+                stream.write(self.triangles.tobytes())
+        else:
+            file.write(header)
+            file.write(self.triangles.tobytes())
+
+    @classmethod
+    def load(cls, file: str | BinaryIO) -> 'FrameCapture':
+        """
+        Read a capture written by :meth:`save`.
+
+        :param file: path or binary file
+        :type file: str | BinaryIO
+        :return: the capture
+        :rtype: FrameCapture
+        """
+
+        if isinstance(file, str):
+            with open(file, "rb") as stream:
+                data = stream.read()
+        else:
+            data = file.read()
+
+        magic, version, w, h, zfar, background, parity, color_format, count = \
+            HEADER.unpack_from(data)
+
+        if magic != MAGIC or version != VERSION:
+            raise ValueError("Not a frame capture of this version")
+
+        capture = cls()
+        capture.w = w
+        capture.h = h
+        capture.zfar = zfar
+        capture.background = tuple(background)
+        capture.parity = parity
+        capture.color_format = color_format.rstrip(b"\0").decode()
+        capture.triangles = np.frombuffer(data, dtype=TRIANGLE, count=count,
+                                          offset=HEADER.size).copy()
+
+        return capture
+
+
+def kernel_target(capture: FrameCapture, kernel: str) -> tuple[object, tuple, np.ndarray]:
+    """
+    Structure drawn by a raster kernel besides the color and depth buffers,
+    and the triangles of a capture with their colors packed for it.
+
+    :param capture: triangles to draw
+    :type capture: FrameCapture
+    :param kernel: name of the kernel
+    :type kernel: str
+    :return: the structure or None, the arguments of its ``clear`` and the triangles
+    :rtype: tuple[object, tuple, np.ndarray]
+    """
+
+    w, h = capture.w, capture.h
+    triangles = capture.triangles
+
+    if kernel == "spans":
+        return SpanBuffer(), (w, h), triangles
+
+    if kernel == "depth_tiles":
+        return CompressedDepth(), (w, h, capture.zfar), triangles
+
+    if kernel == "frame_tiles":
+        return TiledFramebuffer(), (w, h, capture.background, capture.zfar), triangles
+
+    if kernel not in ("rgb565", "palette"):
+        return None, (), triangles
+
+    target = CompactFramebuffer(kernel)
+
+    if capture.color_format != kernel:
+        if kernel == "palette":
+            target.build_palette(capture.background, [triangles["color"]])
+
+        triangles = triangles.copy()
+        triangles["value"] = target.pack(triangles["color"])
+
+    return target, (w, h, capture.background), triangles
+
+
+def replay(
+    capture: FrameCapture,
+    kernel: str = "triangle",
+    repeat: int = 10,
+    buffer: np.ndarray = None,
+    depth: np.ndarray = None) -> list[float]:
+    """
+    Draw the triangles of a capture with a raster kernel, in a single native
+    call per repetition, on buffers cleared before each one. The kernels are
+    ``"triangle"``, ``"checker"`` with the parity of the capture or 0,
+    ``"spans"`` including the resolve, ``"depth_tiles"``, ``"frame_tiles"``,
+    ``"rgb565"`` and ``"palette"``, whose palette is built from the colors of
+    the triangles when the capture is not in that format.
+
+    The last repetition is left in ``buffer`` and ``depth``, expanded from the
+    target of the kernel when it has its own, to compare it with the frame
+    of the renderer.
+
+    :param capture: triangles to draw
+    :type capture: FrameCapture
+    :param kernel: name of the kernel, defaults to "triangle"
+    :type kernel: str, optional
+    :param repeat: number of repetitions, defaults to 10
+    :type repeat: int, optional
+    :param buffer: w x h x 3 uint8 color buffer indexed as ``[x, y]``, defaults to a new one
+    :type buffer: np.ndarray, optional
+    :param depth: w x h float32 depth buffer indexed as ``[x, y]``, defaults to a new one
+    :type depth: np.ndarray, optional
+    :raises ValueError: if the kernel is unknown or a buffer does not fit the capture
+    :return: seconds taken by each repetition, clearing excluded
+    :rtype: list[float]
+    """
+
+    if kernel not in KERNELS:
+        raise ValueError(f"Unknown kernel {kernel}")
+
+    w, h = capture.w, capture.h
+
+    buffer = np.zeros((w, h, 3), dtype=np.uint8) if buffer is None else buffer
+    depth = np.zeros((w, h), dtype=np.float32) if depth is None else depth
+
+    if (buffer.shape != (w, h, 3) or buffer.dtype != np.uint8 or
+        depth.shape != (w, h) or depth.dtype != np.float32):
+        raise ValueError(f"The buffers must be {w} x {h} x 3 uint8 and {w} x {h} float32")
+
+    target, clear_args, triangles = kernel_target(capture, kernel)
+
+    def clear() -> None:
+        buffer[...] = capture.background
+        depth.fill(capture.zfar)
+
+        if target is not None:
+            target.clear(*clear_args)
+
+    # the first clear allocates the structures of the kernel
+    clear()
+    bs_x, bs_y, bs_c = tuple(buffer.strides)
+    ds_x, ds_y = tuple(depth.strides)
+
+    if kernel == "spans":
+        pointers = (target.spans, target.counts, target.scratch, buffer, depth)
+        params = (bs_x, bs_y, bs_c, ds_x, ds_y)
+    elif kernel == "depth_tiles":
+        pointers = (buffer, target.tiles, target.raw)
+        params = (bs_x, bs_y, bs_c, target.tiles_x)
+    elif kernel == "frame_tiles":
+        pointers = (target.tiles,)
+        params = (target.tiles_x,)
+    elif kernel in ("rgb565", "palette"):
+        ts_x, ts_y = target.target.strides
+        pointers = (target.target, depth)
+        params = (ts_x, ts_y, target.target.itemsize, ds_x, ds_y)
+    else:
+        pointers = (buffer, depth)
+        parity = -1 if kernel == "triangle" else max(capture.parity, 0)
+        params = (bs_x, bs_y, bs_c, ds_x, ds_y, parity)
+
+    targets = np.array([array.ctypes.data for array in pointers], dtype=np.uint64)
+    params = np.array(params, dtype=np.int32)
+    times = []
+
+    for _ in range(repeat):
+        clear()
+        start = time.perf_counter()
+        replay_triangles(KERNELS[kernel], triangles.ctypes.data, len(triangles),
+                         targets.ctypes.data, params.ctypes.data, w, h)
+        times.append(time.perf_counter() - start)
+
+    if kernel == "depth_tiles":
+        target.load(depth)
+    elif kernel == "frame_tiles":
+        target.load(buffer, depth)
+    elif kernel in ("rgb565", "palette"):
+        target.load(buffer)
+
+    return times
@@ -0,0 +1,114 @@
+"""
+Checkerboard rendering, drawing half of the pixels each frame.
+"""
+
+import numpy as np
+from ext_rendering import reconstruct_checker
+
+
+class Checkerboard:
+    """
+    State of the checkerboard rendering. Each frame draws only the pixels with
+    ``(x + y) % 2 == parity`` and the parity alternates, the other pixels are
+    reprojected from the previous frame using the depth of their neighbours and
+    the motion of the camera. When the depth found in the previous frame differs
+    more than the fraction ``tolerance`` from the expected one, the pixel is the
+    average of the two neighbours along the edge.
+
+    :param tolerance: maximum relative depth error of a reprojected pixel, defaults to 0.02
+    :type tolerance: float, optional
+    """
+
+    __slots__ = ["parity", "tolerance", "buffer", "depth", "view", "projection"]
+
+    def __init__(self, tolerance: float = 0.02) -> None:
+        self.parity = 1
+        self.tolerance = tolerance
+        self.buffer = None
+        self.depth = None
+        self.view = None
+        self.projection = None
+
+    def next_parity(self) -> int:
+        """
+        Alternate the parity of the pixels to draw.
+
+        :return: parity of the new frame
+        :rtype: int
+        """
+
+        self.parity ^= 1
+
+        return self.parity
+
+    def reset(self) -> None:
+        """
+        Forget the previous frame, the next one is filled only from the neighbours.
+        """
+
+        self.buffer = None
+        self.depth = None
+        self.view = None
+
+    @staticmethod
+    def view_matrix(camera) -> np.ndarray:
+        """
+        Affine transformation from world coordinates to the view space of a camera.
+
+        :param camera: camera with updated view space
+        :type camera: Camera
+        :return: 4 x 4 matrix
+        :rtype: np.ndarray
+        """
+
+        return np.array((
+            (camera.right.x, camera.right.y, camera.right.z, - camera.tright),
+            (camera.up.x, camera.up.y, camera.up.z, - camera.tup),
+            (camera.dir.x, camera.dir.y, camera.dir.z, - camera.tdir),
+            (0, 0, 0, 1)
+        ))
+
+    def reconstruct(self, buffer: np.ndarray, depth: np.ndarray, camera) -> None:
+        """
+        Fill the pixels not drawn in this frame and keep the result for the next one.
+
+        :param buffer: w x h x 3 color buffer with the drawn pixels
+        :type buffer: np.ndarray
+        :param depth: w x h depth buffer with the drawn pixels
+        :type depth: np.ndarray
+        :param camera: camera of the frame
+        :type camera: Camera
+        """
+
+        view = self.view_matrix(camera)
+        projection = (buffer.shape, camera.af, camera.f, camera.q, camera.znear)
+
+        if self.buffer is None or projection != self.projection:
+            self.buffer = np.empty_like(buffer)
+            self.depth = np.empty_like(depth)
+            self.view = None
+            self.projection = projection
+
+        prev_buffer = self.buffer
+        prev_depth = self.depth
+
+        if self.view is None:
+            reproject = np.zeros(12, dtype=np.float32)
+            prev_ptr = prev_depth_ptr = 0
+        else:
+            reproject = np.ascontiguousarray((self.view @ np.linalg.inv(view))[:3],
+                                             dtype=np.float32)
+            prev_ptr = prev_buffer.ctypes.data
+            prev_depth_ptr = prev_depth.ctypes.data
+
+        reconstruct_checker(buffer.ctypes.data, *buffer.strides,
+                            depth.ctypes.data, *depth.strides,
+                            prev_ptr, *tuple(prev_buffer.strides),
+                            prev_depth_ptr, *tuple(prev_depth.strides),
+                            reproject.ctypes.data,
+                            camera.af, camera.f, camera.q, camera.znear, camera.zfar,
+                            self.tolerance, self.parity, camera.w, camera.h)
+
+        np.copyto(prev_buffer, buffer)
+        np.copyto(prev_depth, depth)
+        self.view = view
@@ -0,0 +1,348 @@
+"""
+Render commands recorded in a buffer and executed natively in a single call.
+"""
+
+import numpy as np
+from ext_rendering import execute_commands
+from .color import Color
+from .math3d import Vec3
+from .scene import Body
+from .shading import shader_address
+
+CMD_CLEAR = 1
+CMD_CAMERA = 2
+CMD_LIGHT = 3
+CMD_DRAW = 4
+CMD_SHADER = 5
+# op and three arguments
+COMMAND_SIZE = 4
+CAMERA_PARAMS = 22
+TRANSFORM_PARAMS = 7
+# camera, light direction and background color
+STATE_SIZE = CAMERA_PARAMS + 6
+# Layout of the CommandMesh struct of ext_rendering
+MESH = np.dtype([("vertices", "<u8"), ("faces", "<u8"), ("colors", "<u8"),
+                 ("occlusion", "<u8"), ("n_vertices", "<i8"), ("n_faces", "<i8")])
+
+
+class CommandBuffer:
+    """
+    Commands recorded by the game and executed on a renderer with one native
+    call, without going through the interpreter for each body and face. A
+    command is 4 int32, its parameters are copied in a table of float64 when
+    recorded, so a buffer holding the static part of a scene is recorded once
+    and executed every frame with the camera of the renderer.
+
+    The geometry of the bodies is uploaded the first time they are drawn, in
+    model space, and each draw only carries the position and the rotation of
+    the instances. The faces are shaded and culled as by
+    :meth:`py3dgame.rendering.Renderer.draw_body`, and drawn by the scalar
+    rasterizer, not by :attr:`py3dgame.rendering.Renderer.backend`; impostors,
+    occlusion culling, the costs per body and the frame capture are not
+    available to them.
+
+    The colors can be computed by native shaders set with :meth:`shader`.
+
+    Set the buffers in :attr:`py3dgame.rendering.Renderer.command_buffers` to
+    execute them after the bodies of the scene, or call :meth:`execute`.
+
+    :param capacity: number of commands reserved, defaults to 64
+    :type capacity: int, optional
+    """
+
+    __slots__ = ["commands", "count", "constants", "size", "meshes", "table",
+                 "mesh_ids", "batches", "state", "scratch", "totals",
+                 "shaders", "shader_objects", "span_colors"]
+
+    def __init__(self, capacity: int = 64) -> None:
+        self.commands = np.zeros((capacity, COMMAND_SIZE), dtype=np.int32)
+        self.count = 0
+        self.constants = np.zeros(capacity * TRANSFORM_PARAMS, dtype=np.float64)
+        self.size = 0
+        # arrays of the uploaded meshes, kept alive for the pointers of the table
+        self.meshes = []
+        self.table = np.zeros(0, dtype=MESH)
+        self.mesh_ids = {}
+        self.batches = []
+        self.state = np.zeros(STATE_SIZE, dtype=np.float64)
+        self.scratch = np.zeros(0, dtype=np.float64)
+        self.totals = np.zeros(2, dtype=np.int64)
+        # face shader, span shader and user pointer of each shader command
+        self.shaders = np.zeros((0, 3), dtype=np.uint64)
+        # kept alive while their addresses are recorded
+        self.shader_objects = []
+        self.span_colors = np.zeros(0, dtype=np.uint8)
+
+    def _command(self, op: int, a: int = 0, b: int = 0, c: int = 0) -> None:
+        if self.count == len(self.commands):
+            commands = np.zeros((2 * len(self.commands), COMMAND_SIZE), dtype=np.int32)
+            commands[:self.count] = self.commands
+            self.commands = commands
+
+        self.commands[self.count] = (op, a, b, c)
+        self.count += 1
+
+    def _constants(self, values: list[float] | np.ndarray) -> int:
+        values = np.asarray(values, dtype=np.float64).reshape(-1)
+        offset = self.size
+
+        if offset + len(values) > len(self.constants):
+            constants = np.zeros(max(2 * len(self.constants), offset + len(values)),
+                                 dtype=np.float64)
+            constants[:offset] = self.constants[:offset]
+            self.constants = constants
+
+        self.constants[offset:offset + len(values)] = values
+        self.size += len(values)
+
+        return offset
+
+    def reset(self) -> None:
+        """
+        Forget the recorded commands to record them again, the uploaded
+        meshes are kept.
+        """
+
+        self.count = 0
+        self.size = 0
+        self.batches = []
+        self.shaders = np.zeros((0, 3), dtype=np.uint64)
+        self.shader_objects = []
+
+    def mesh(self, body: Body) -> int:
+        """
+        Upload the geometry, the colors and the baked occlusion of a body,
+        if not already done.
+
+        :param body: body to upload
+        :type body: Body
+        :return: index of the mesh
+        :rtype: int
+        """
+
+        entry = self.mesh_ids.get(body.name)
+
+        if entry is not None and entry[0] is body:
+            return entry[1]
+
+        vertices = np.array([(v.x, v.y, v.z) for v in body.vertices],
+                            dtype=np.float64).reshape(-1, 3)
+        faces = np.array(body.f, dtype=np.int32).reshape(-1, 3)
+        colors = np.zeros((len(faces), 3), dtype=np.uint8)
+        colors[:] = body.color
+        occlusion = None
+
+        if body.ao is not None:
+            occlusion = np.asarray(body.ao, dtype=np.float64)[faces].mean(axis=1)
+
+        index = len(self.meshes)
+        self.meshes.append((vertices, faces, colors, occlusion))
+        self.mesh_ids[body.name] = (body, index)
+        self.table = np.array([
+            (v.ctypes.data, f.ctypes.data, c.ctypes.data,
+             0 if o is None else o.ctypes.data, len(v), len(f))
+            for v, f, c, o in self.meshes], dtype=MESH)
+        needed = 6 * max(len(v) for v, *_ in self.meshes)
+
+        if len(self.scratch) < needed:
+            self.scratch = np.zeros(needed, dtype=np.float64)
+
+        return index
+
+    def clear(self, color: Color = None) -> None:
+        """
+        Record the clear of the color and depth buffers.
+
+        :param color: background color, defaults to the one of the scene
+        :type color: Color, optional
+        """
+
+        self._command(CMD_CLEAR, -1 if color is None else self._constants(color))
+
+    def camera(self, camera) -> None:
+        """
+        Record a camera to use for the next draws, with the view and the
+        projection it had at the last update.
+
+        :param camera: camera to copy
+        :type camera: Camera
+        """
+
+        self._command(CMD_CAMERA, self._constants(camera_params(camera)))
+
+    def light(self, direction: Vec3) -> None:
+        """
+        Record the direction of the light for the next draws.
+
+        :param direction: direction of the light
+        :type direction: Vec3
+        """
+
+        self._command(CMD_LIGHT, self._constants((direction.x, direction.y, direction.z)))
+
+    def shader(self, face=None, span=None, user: int = 0) -> None:
+        """
+        Record the native shaders of the next draws, or the default shading
+        when called without shaders. They are C functions, for example a
+        Numba ``cfunc``, a cffi function or a ctypes callback, with the
+        prototypes of :mod:`py3dgame.shading`:
+
+        - ``void face(const FaceShading* face, uint8_t* color, void* user)`` is
+          called for each face drawn and can change its RGB color
+        - ``void span(const SpanShading* span, uint8_t* colors, void* user)`` is
+          called for each run of covered pixels of a row of a face and writes
+          the RGB color of each one, the pixels are then depth tested
+
+        The shaders run while the GIL is released, ctypes callbacks take it
+        back at each call and are only fit for testing.
+
+        :param face: face shader, defaults to None
+        :type face: int | ctypes._CFuncPtr | object, optional
+        :param span: span shader, defaults to None
+        :type span: int | ctypes._CFuncPtr | object, optional
+        :param user: address passed to the shaders, defaults to 0
+        :type user: int, optional
+        """
+
+        if face is None and span is None:
+            self._command(CMD_SHADER, -1)
+            return
+
+        self.shader_objects.append((face, span))
+        entry = np.array([(shader_address(face), shader_address(span), user)], dtype=np.uint64)
+        self.shaders = np.concatenate((self.shaders, entry))
+        self._command(CMD_SHADER, len(self.shaders) - 1)
+
+    def draw_body(self, body: Body) -> None:
+        """
+        Record the draw of a body with its current position and rotation,
+        applied as by :meth:`py3dgame.scene.Body.move` rotating first.
+
+        :param body: body to draw
+        :type body: Body
+        """
+
+        rot = body.rot
+        self.draw_instances(body, [(body.pos.x, body.pos.y, body.pos.z)],
+                            [(rot.angle, rot.axis.x, rot.axis.y, rot.axis.z)])
+
+    def draw_instances(self,
+        body: Body,
+        positions: np.ndarray,
+        rotations: np.ndarray = None) -> int:
+        """
+        Record the draw of many copies of the geometry of a body.
+
+        :param body: body giving the geometry and the colors
+        :type body: Body
+        :param positions: N x 3 array of positions
+        :type positions: np.ndarray
+        :param rotations: N x 4 array of rotations as ``angle, axis_x, axis_y, axis_z``,
+            defaults to no rotation
+        :type rotations: np.ndarray, optional
+        :return: index of the batch for :meth:`set_instances`
+        :rtype: int
+        """
+
+        transforms = self._transforms(positions, rotations)
+        offset = self._constants(transforms)
+        self._command(CMD_DRAW, self.mesh(body), offset, len(transforms))
+        self.batches.append((offset, len(transforms)))
+
+        return len(self.batches) - 1
+
+    def set_instances(self,
+        batch: int,
+        positions: np.ndarray,
+        rotations: np.ndarray = None) -> None:
+        """
+        Move the instances of a recorded batch without recording again.
+
+        :param batch: index returned by :meth:`draw_instances`
+        :type batch: int
+        :param positions: N x 3 array of positions, as many as recorded
+        :type positions: np.ndarray
+        :param rotations: N x 4 array of rotations, defaults to no rotation
+        :type rotations: np.ndarray, optional
+        :raises ValueError: if the number of instances changed
+        """
+
+        offset, count = self.batches[batch]
+        transforms = self._transforms(positions, rotations)
+
+        if len(transforms) != count:
+            raise ValueError(f"The batch has {count} instances")
+
+        self.constants[offset:offset + transforms.size] = transforms.reshape(-1)
+
+    @staticmethod
+    def _transforms(positions: np.ndarray, rotations: np.ndarray) -> np.ndarray:
+        positions = np.asarray(positions, dtype=np.float64).reshape(-1, 3)
+        transforms = np.zeros((len(positions), TRANSFORM_PARAMS), dtype=np.float64)
+        transforms[:, :3] = positions
+        transforms[:, 6] = 1
+
+        if rotations is not None:
+            transforms[:, 3:] = np.asarray(rotations, dtype=np.float64).reshape(-1, 4)
+
+        return transforms
+
+    def execute(self, renderer) -> None:
+        """
+        Execute the commands on the buffers of a renderer, starting from its
+        camera, the light and the background of its scene.
+
+        :param renderer: renderer already cleared for the frame
+        :type renderer: Renderer
+        :raises ValueError: if the renderer does not draw on ``buffer`` and ``depth``
+        """
+
+        if (renderer.span_buffer or renderer.compressed_depth or
+            renderer.tiled_framebuffer or renderer.packed or renderer.gbuffer is not None):
+            raise ValueError("Command buffers can only be drawn by the default rasterizer")
+
+        if self.count == 0:
+            return
+
+        scene = renderer.scene
+        self.state[:CAMERA_PARAMS] = camera_params(renderer.camera)
+        self.state[CAMERA_PARAMS:] = (scene.light.x, scene.light.y, scene.light.z, *scene.bgc)
+        self.totals.fill(0)
+        buffer = renderer.buffer
+        depth = renderer.depth
+
+        if len(self.span_colors) < 3 * renderer.camera.w:
+            self.span_colors = np.zeros(3 * renderer.camera.w, dtype=np.uint8)
+
+        execute_commands(
+            self.commands.ctypes.data, self.count,
+            self.constants.ctypes.data, self.table.ctypes.data, self.shaders.ctypes.data,
+            self.state.ctypes.data, self.scratch.ctypes.data, self.span_colors.ctypes.data,
+            renderer.buffer_ptr, *buffer.strides,
+            renderer.depth_ptr, *depth.strides,
+            renderer.camera.w, renderer.camera.h, renderer.parity,
+            self.totals.ctypes.data
+        )
+
+        totals = self.totals.tolist()
+        renderer.triangles += totals[0]
+        renderer.pixels += totals[1]
+
+
+def camera_params(camera) -> list[float]:
+    """
+    View and projection of a camera in the layout of the command buffers.
+
+    :param camera: camera updated for the frame
+    :type camera: Camera
+    :return: position, right, up, dir, tright, tup, tdir, af, f, q, znear, zfar, cx and cy
+    :rtype: list[float]
+    """
+
+    return [camera.pos.x, camera.pos.y, camera.pos.z,
+            camera.right.x, camera.right.y, camera.right.z,
+            camera.up.x, camera.up.y, camera.up.z,
+            camera.dir.x, camera.dir.y, camera.dir.z,
+            camera.tright, camera.tup, camera.tdir,
+            camera.af, camera.f, camera.q, camera.znear, camera.zfar,
+            camera.cx, camera.cy]
@@ -0,0 +1,131 @@
+"""
+Counters sampled around the stages of a frame: hardware performance counters
+of the CPU, read through ``perf_event_open`` on Linux, and memory allocations.
+"""
+
+import numpy as np
+from ext_rendering import (perf_open, perf_read, perf_close,
+                           alloc_hooks_install, alloc_hooks_remove, alloc_counts)
+
+COUNTERS = ("cycles", "instructions", "llc_misses", "branch_misses")
+ALLOCATIONS = ("objects", "memory", "raw", "bytes", "heap")
+# Fields corrected for the allocations made by read, the heap is not counted by calls
+CORRECTED = 4
+
+
+class PerfCounters:
+    """
+    Cycles, instructions, last level cache misses and branch misses of the
+    thread that creates the object, counted in user space. Counters that the
+    system does not provide, because of the platform, a virtual machine or
+    ``perf_event_paranoid``, read as None and the others keep working.
+
+    Work done by other threads, like the workers of the post effects, is not counted.
+    """
+
+    __slots__ = ["fds", "values"]
+
+    def __init__(self) -> None:
+        self.fds = np.full(len(COUNTERS), -1, dtype=np.int32)
+        self.values = np.zeros(len(COUNTERS), dtype=np.int64)
+        perf_open(self.fds.ctypes.data)
+
+    @property
+    def available(self) -> dict[str, bool]:
+        """
+        Counters that could be opened.
+
+        :return: availability by name of the counter
+        :rtype: dict[str, bool]
+        """
+
+        return dict(zip(COUNTERS, (self.fds >= 0).tolist()))
+
+    def read(self) -> list[int | None]:
+        """
+        Current values of the counters.
+
+        :return: value of each counter in ``COUNTERS``, None if unavailable
+        :rtype: list[int | None]
+        """
+
+        perf_read(self.fds.ctypes.data, self.values.ctypes.data)
+
+        return [None if value < 0 else value for value in self.values.tolist()]
+
+    def close(self) -> None:
+        """
+        Release the counters, then they all read as None.
+        """
+
+        perf_close(self.fds.ctypes.data)
+
+
+class AllocationCounters:
+    """
+    Allocations of the Python memory domains, counted by hooks wrapping their
+    allocators: ``objects`` for the Python objects, ``memory`` for ``PyMem``,
+    ``raw`` for ``PyMem_Raw``, the ``bytes`` requested by all of them and the
+    bytes in use on the native ``heap``, which includes the data of NumPy arrays
+    and is None outside glibc. Allocations and reallocations of every thread
+    are counted, frees are not.
+
+    The objects that :meth:`read` allocates itself are measured when it is
+    created and removed from the counts, so two consecutive readings differ
+    by 0 and an allocation free stage reads as such. Other tools hooking the
+    allocators, like :mod:`tracemalloc`, must be started before and stopped after.
+
+    The hooks are process-wide and shared by all the instances: they are
+    installed by the first one and removed when the last one is closed, each
+    instance counting from its creation. Use it as a context manager or call
+    :meth:`close`.
+    """
+
+    __slots__ = ["values", "offset", "overhead", "ptr", "installed"]
+
+    def __init__(self) -> None:
+        self.values = np.zeros(len(ALLOCATIONS), dtype=np.int64)
+        self.offset = np.zeros(len(ALLOCATIONS), dtype=np.int64)
+        self.overhead = np.zeros(len(ALLOCATIONS), dtype=np.int64)
+        self.ptr = self.values.ctypes.data
+        alloc_hooks_install()
+        self.installed = True
+        alloc_counts(self.ptr)
+        self.offset[:CORRECTED] = self.values[:CORRECTED]
+
+        # the first readings warm up the caches of NumPy
+        for _ in range(3):
+            before = self.read()
+
+        after = self.read()
+        self.overhead[:CORRECTED] = np.subtract(after, before)[:CORRECTED]
+
+    def read(self) -> list[int | None]:
+        """
+        Allocations counted since the creation of the counters.
+
+        :return: value of each field in ``ALLOCATIONS``, None if unavailable
+        :rtype: list[int | None]
+        """
+
+        alloc_counts(self.ptr)
+        np.add(self.offset, self.overhead, out=self.offset)
+        values = (self.values - self.offset).tolist()
+
+        return values[:CORRECTED] + [None if values[CORRECTED] < 0 else values[CORRECTED]]
+
+    def close(self) -> None:
+        """
+        Release the hooks, the allocations are no longer counted once every
+        instance is closed. Closing again does nothing.
+        """
+
+        if self.installed:
+            alloc_hooks_remove()
+            self.installed = False
+
+    def __enter__(self) -> 'AllocationCounters':
+        return self
+
+    def __exit__(self, *args) -> None:
+        self.close()
@@ -0,0 +1,129 @@
+"""
+Compressed depth buffer made of tiles described by plane equations.
+"""
+
+import numpy as np
+from ext_rendering import clear_depth_tiles, draw_triangle_tiles, copy_depth_tiles
+
+TILE = 8
+# 2 planes of 3 floats, the 64 bits mask of the second plane, the mode and a pad
+TILE_WORDS = 10
+MODE_WORD = 8
+PLANE = 1
+TWO_PLANES = 2
+RAW = 3
+
+
+class CompressedDepth:
+    """
+    Depth buffer split in 8x8 tiles. A tile covered by one or two triangles is
+    stored as one or two plane equations plus a mask telling which pixels use
+    which plane, only the other tiles keep the 64 raw depths. Depth tests and
+    writes read the planes, so large triangles touch a few bytes per tile, and
+    the flat buffer indexed as ``[x, y]`` is written only by :meth:`load`.
+    """
+
+    __slots__ = ["tiles", "raw", "tiles_x", "tiles_y", "w", "h"]
+
+    def __init__(self) -> None:
+        self.w = 0
+        self.h = 0
+        self.tiles_x = 0
+        self.tiles_y = 0
+        self.tiles = np.empty((0, TILE_WORDS), dtype=np.uint32)
+        self.raw = np.empty(0, dtype=np.float32)
+
+    def clear(self, w: int, h: int, zfar: float) -> None:
+        """
+        Set every tile to the plane at ``zfar``, resizing the buffer if the screen changed.
+
+        :param w: width of the screen
+        :type w: int
+        :param h: height of the screen
+        :type h: int
+        :param zfar: depth of the empty buffer
+        :type zfar: float
+        """
+
+        if (w, h) != (self.w, self.h):
+            self.w = w
+            self.h = h
+            self.tiles_x = (w + TILE - 1) // TILE
+            self.tiles_y = (h + TILE - 1) // TILE
+            n_tiles = self.tiles_x * self.tiles_y
+            self.tiles = np.empty((n_tiles, TILE_WORDS), dtype=np.uint32)
+            self.raw = np.empty(n_tiles * TILE * TILE, dtype=np.float32)
+
+        clear_depth_tiles(self.tiles.ctypes.data, len(self.tiles), zfar)
+
+    def draw(self,
+        buffer: np.ndarray,
+        point1: tuple[float, float, float],
+        point2: tuple[float, float, float],
+        point3: tuple[float, float, float],
+        color: tuple[int, int, int]) -> None:
+        """
+        Draw a triangle in screen space on a color buffer indexed as ``[x, y]``,
+        testing and writing its depth on the tiles.
+
+        :param buffer: w x h x 3 color buffer
+        :type buffer: np.ndarray
+        :param point1: first vertex as x, y and depth
+        :type point1: tuple[float, float, float]
+        :param point2: second vertex as x, y and depth
+        :type point2: tuple[float, float, float]
+        :param point3: third vertex as x, y and depth
+        :type point3: tuple[float, float, float]
+        :param color: RGB color of the triangle
+        :type color: tuple[int, int, int]
+        """
+
+        draw_triangle_tiles(buffer.ctypes.data, *buffer.strides,
+                            self.tiles.ctypes.data, self.raw.ctypes.data, self.tiles_x,
+                            *point1, *point2, *point3, *color, self.w, self.h)
+
+    def load(self, depth: np.ndarray, rect: tuple[int, int, int, int] = None) -> None:
+        """
+        Write the depth of the tiles overlapping a rectangle on a flat buffer.
+
+        :param depth: w x h depth buffer
+        :type depth: np.ndarray
+        :param rect: x0, y0, x1, y1 inclusive, defaults to the whole screen
+        :type rect: tuple[int, int, int, int], optional
+        """
+
+        rect = rect or (0, 0, self.w - 1, self.h - 1)
+        copy_depth_tiles(self.tiles.ctypes.data, self.raw.ctypes.data, self.tiles_x,
+                         depth.ctypes.data, *depth.strides,
+                         *rect, self.w, self.h, False)
+
+    def store(self, depth: np.ndarray, rect: tuple[int, int, int, int] = None) -> None:
+        """
+        Replace the tiles overlapping a rectangle with the raw values of a flat
+        buffer, after something has been drawn on it directly. The tiles must
+        have been loaded before.
+
+        :param depth: w x h depth buffer
+        :type depth: np.ndarray
+        :param rect: x0, y0, x1, y1 inclusive, defaults to the whole screen
+        :type rect: tuple[int, int, int, int], optional
+        """
+
+        rect = rect or (0, 0, self.w - 1, self.h - 1)
+        copy_depth_tiles(self.tiles.ctypes.data, self.raw.ctypes.data, self.tiles_x,
+                         depth.ctypes.data, *depth.strides,
+                         *rect, self.w, self.h, True)
+
+    def modes(self) -> dict[str, int]:
+        """
+        Count the tiles stored in each form.
+
+        :return: number of tiles with one plane, two planes and raw values
+        :rtype: dict[str, int]
+        """
+
+        counts = np.bincount(self.tiles[:, MODE_WORD], minlength=RAW + 1)
+
+        return {"plane": int(counts[PLANE]),
+                "two_planes": int(counts[TWO_PLANES]),
+                "raw": int(counts[RAW])}
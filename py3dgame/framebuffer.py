@@ -0,0 +1,421 @@
+"""
+Framebuffers with layouts cheaper to draw on than the pygame buffer,
+expanded to it only when presenting.
+"""
+
+import numpy as np
+from ext_rendering import (clear_frame_tiles, draw_triangle_frame, copy_frame_tiles,
+                           draw_triangle_packed, expand_packed)
+
+TILE = 4
+# 16 RGBX pixels followed by their 16 depths, two cache lines
+TILE_BYTES = 128
+PALETTE_SIZE = 256
+# passes moving the palette entries to the mean of their nearest colors
+REFINE_STEPS = 2
+
+
+class TiledFramebuffer:
+    """
+    Color and depth buffer split in 4x4 tiles, each one made of the 16 colors
+    followed by the 16 depths, so drawing a triangle touches the two cache lines
+    of each covered tile instead of a column of the pygame buffer every pixel.
+    :meth:`load` converts it to the linear layout of the presentation surface.
+    """
+
+    __slots__ = ["tiles", "tiles_x", "tiles_y", "w", "h"]
+
+    def __init__(self) -> None:
+        self.w = 0
+        self.h = 0
+        self.tiles_x = 0
+        self.tiles_y = 0
+        self.tiles = np.empty((0, TILE_BYTES), dtype=np.uint8)
+
+    def clear(self, w: int, h: int, color: tuple[int, int, int], zfar: float) -> None:
+        """
+        Fill every tile with a color and ``zfar``, resizing the buffer if the screen changed.
+
+        :param w: width of the screen
+        :type w: int
+        :param h: height of the screen
+        :type h: int
+        :param color: RGB background color
+        :type color: tuple[int, int, int]
+        :param zfar: depth of the empty buffer
+        :type zfar: float
+        """
+
+        if (w, h) != (self.w, self.h):
+            self.w = w
+            self.h = h
+            self.tiles_x = (w + TILE - 1) // TILE
+            self.tiles_y = (h + TILE - 1) // TILE
+            self.tiles = np.empty((self.tiles_x * self.tiles_y, TILE_BYTES), dtype=np.uint8)
+
+        clear_frame_tiles(self.tiles.ctypes.data, len(self.tiles), *color, zfar)
+
+    def draw(self,
+        point1: tuple[float, float, float],
+        point2: tuple[float, float, float],
+        point3: tuple[float, float, float],
+        color: tuple[int, int, int]) -> None:
+        """
+        Draw a depth tested triangle in screen space.
+
+        :param point1: first vertex as x, y and depth
+        :type point1: tuple[float, float, float]
+        :param point2: second vertex as x, y and depth
+        :type point2: tuple[float, float, float]
+        :param point3: third vertex as x, y and depth
+        :type point3: tuple[float, float, float]
+        :param color: RGB color of the triangle
+        :type color: tuple[int, int, int]
+        """
+
+        draw_triangle_frame(self.tiles.ctypes.data, self.tiles_x,
+                            *point1, *point2, *point3, *color, self.w, self.h)
+
+    def load(self,
+        buffer: np.ndarray,
+        depth: np.ndarray,
+        rect: tuple[int, int, int, int] = None) -> None:
+        """
+        Resolve a rectangle of the tiles on linear buffers indexed as ``[x, y]``.
+
+        :param buffer: w x h x 3 color buffer
+        :type buffer: np.ndarray
+        :param depth: w x h depth buffer
+        :type depth: np.ndarray
+        :param rect: x0, y0, x1, y1 inclusive, defaults to the whole screen
+        :type rect: tuple[int, int, int, int], optional
+        """
+
+        rect = rect or (0, 0, self.w - 1, self.h - 1)
+        copy_frame_tiles(self.tiles.ctypes.data, self.tiles_x,
+                         buffer.ctypes.data, *buffer.strides,
+                         depth.ctypes.data, *depth.strides,
+                         *rect, self.w, self.h, False)
+
+    def store(self,
+        buffer: np.ndarray,
+        depth: np.ndarray,
+        rect: tuple[int, int, int, int] = None) -> None:
+        """
+        Copy back a rectangle of linear buffers after something has been drawn on
+        them directly. The rectangle must have been loaded before.
+
+        :param buffer: w x h x 3 color buffer
+        :type buffer: np.ndarray
+        :param depth: w x h depth buffer
+        :type depth: np.ndarray
+        :param rect: x0, y0, x1, y1 inclusive, defaults to the whole screen
+        :type rect: tuple[int, int, int, int], optional
+        """
+
+        rect = rect or (0, 0, self.w - 1, self.h - 1)
+        copy_frame_tiles(self.tiles.ctypes.data, self.tiles_x,
+                         buffer.ctypes.data, *buffer.strides,
+                         depth.ctypes.data, *depth.strides,
+                         *rect, self.w, self.h, True)
+
+
+class CompactFramebuffer:
+    """
+    Color buffer of 16 bits RGB565 values or 8 bits indices in a palette of
+    256 colors, indexed as ``[x, y]`` like the pygame buffer. Flat shading only
+    produces a few colors per body, so they are packed once when the shading
+    changes and the rasterizer stores 1 or 2 bytes per pixel instead of 3.
+    :meth:`load` expands it to RGB for presentation.
+
+    The palette is built again for each frame by :meth:`build_palette` from the
+    shaded colors of the faces, the colors drawn outside of it take the nearest entry.
+
+    :param color_format: ``"rgb565"`` or ``"palette"``
+    :type color_format: str
+    """
+
+    __slots__ = ["color_format", "target", "palette", "keys", "indices", "size", "packed",
+                 "w", "h"]
+
+    def __init__(self, color_format: str = "rgb565") -> None:
+        if color_format not in ("rgb565", "palette"):
+            raise ValueError(f"Unknown color format {color_format}")
+
+        self.color_format = color_format
+        self.w = 0
+        self.h = 0
+        self.target = np.empty((0, 0), dtype=self.dtype)
+        self.palette = np.zeros((PALETTE_SIZE, 3), dtype=np.uint8)
+        # sorted colors of the frame as 24 bits keys and their entry in the palette
+        self.keys = np.zeros(0, dtype=np.uint32)
+        self.indices = np.zeros(0, dtype=np.uint8)
+        self.size = 0
+        self.packed = {}
+
+    @property
+    def dtype(self) -> type:
+        """
+        Type of a pixel of the target.
+
+        :return: numpy type
+        :rtype: type
+        """
+
+        return np.uint8 if self.color_format == "palette" else np.uint16
+
+    def pack(self, colors: np.ndarray) -> np.ndarray:
+        """
+        Convert RGB colors to values of the target, the colors missing from the
+        palette take the nearest entry.
+
+        :param colors: N x 3 uint8 array of colors
+        :type colors: np.ndarray
+        :return: N packed values
+        :rtype: np.ndarray
+        """
+
+        colors = np.asarray(colors, dtype=np.uint8).reshape(-1, 3)
+
+        if self.color_format == "rgb565":
+            colors = colors.astype(np.uint16)
+
+            return (colors[:, 0] >> 3) << 11 | (colors[:, 1] >> 2) << 5 | colors[:, 2] >> 3
+
+        keys = color_keys(colors)
+        indices = np.empty(len(keys), dtype=np.uint8)
+        found = np.zeros(len(keys), dtype=bool)
+
+        if len(self.keys):
+            positions = np.minimum(np.searchsorted(self.keys, keys), len(self.keys) - 1)
+            found = self.keys[positions] == keys
+            indices[found] = self.indices[positions[found]]
+
+        if not found.all():
+            unique, inverse = np.unique(colors[~found], axis=0, return_inverse=True)
+            indices[~found] = self.nearest(unique)[inverse.reshape(-1)]
+
+        return indices
+
+    def nearest(self, colors: np.ndarray) -> np.ndarray:
+        """
+        Index of the nearest entry of the palette to each color.
+
+        :param colors: N x 3 uint8 array of colors
+        :type colors: np.ndarray
+        :return: N indices
+        :rtype: np.ndarray
+        """
+
+        # squared distances expanded as |p|^2 - 2 c.p, exact on integers
+        palette = self.palette[:max(self.size, 1)].astype(np.float64)
+        distance = (palette * palette).sum(axis=1) - 2 * colors.astype(np.float64) @ palette.T
+
+        return np.argmin(distance, axis=1).astype(np.uint8)
+
+    def build_palette(self, background: tuple[int, int, int], colors: list[np.ndarray]) -> None:
+        """
+        Replace the palette with the colors of a frame and clear the target with
+        the background. Up to 256 colors are kept exact, more are reduced by a
+        median cut weighted by the number of faces of each color, then refined
+        by moving each entry to the mean of the colors nearest to it. The packed
+        colors of the bodies are forgotten when the palette changes.
+
+        :param background: RGB background color
+        :type background: tuple[int, int, int]
+        :param colors: arrays of N x 3 shaded colors, one for each body
+        :type colors: list[np.ndarray]
+        """
+
+        colors = np.concatenate([np.asarray(background, dtype=np.uint8).reshape(1, 3)] +
+                                [np.asarray(c, dtype=np.uint8).reshape(-1, 3) for c in colors])
+        keys, counts = np.unique(color_keys(colors), return_counts=True)
+
+        if not np.array_equal(keys, self.keys):
+            unique = np.stack(((keys >> 16) & 255, (keys >> 8) & 255, keys & 255),
+                              axis=1).astype(np.uint8)
+            boxes = median_cut(unique, counts, PALETTE_SIZE)
+            self.size = int(boxes.max()) + 1
+            self.keys = keys
+
+            for _ in range(REFINE_STEPS):
+                weights = np.bincount(boxes, weights=counts, minlength=self.size)
+                used = weights > 0
+
+                for channel in range(3):
+                    total = np.bincount(boxes, weights=counts * unique[:, channel],
+                                        minlength=self.size)
+                    self.palette[:self.size, channel][used] = np.round(
+                        total[used] / weights[used]).astype(np.uint8)
+
+                boxes = self.nearest(unique)
+
+            self.indices = boxes.astype(np.uint8)
+            self.packed = {}
+
+        if self.w and self.h:
+            self.target.fill(self.pack(background)[0])
+
+    def shade(self, body, colors: list[list[int]]) -> list[int]:
+        """
+        Packed colors of the faces of a body, cached while ``colors`` is the
+        list returned by :meth:`py3dgame.scene.Body.shade_faces`.
+
+        :param body: body with the shaded faces in ``shade``
+        :type body: Body
+        :param colors: shaded colors of the faces
+        :type colors: list[list[int]]
+        :return: packed value of each face
+        :rtype: list[int]
+        """
+
+        cached = self.packed.get(body.name)
+
+        if cached is None or cached[0] is not colors:
+            cached = (colors, self.pack(body.shade).tolist())
+            self.packed[body.name] = cached
+
+        return cached[1]
+
+    def clear(self, w: int, h: int, color: tuple[int, int, int]) -> None:
+        """
+        Fill the target with a color, resizing it if the screen changed.
+
+        :param w: width of the screen
+        :type w: int
+        :param h: height of the screen
+        :type h: int
+        :param color: RGB background color
+        :type color: tuple[int, int, int]
+        """
+
+        if (w, h) != (self.w, self.h):
+            self.w = w
+            self.h = h
+            self.target = np.empty((w, h), dtype=self.dtype)
+
+        self.target.fill(self.pack(color)[0])
+
+    def draw(self,
+        depth: np.ndarray,
+        point1: tuple[float, float, float],
+        point2: tuple[float, float, float],
+        point3: tuple[float, float, float],
+        value: int) -> None:
+        """
+        Draw a triangle in screen space testing a depth buffer indexed as ``[x, y]``.
+
+        :param depth: w x h depth buffer
+        :type depth: np.ndarray
+        :param point1: first vertex as x, y and depth
+        :type point1: tuple[float, float, float]
+        :param point2: second vertex as x, y and depth
+        :type point2: tuple[float, float, float]
+        :param point3: third vertex as x, y and depth
+        :type point3: tuple[float, float, float]
+        :param value: packed color of the triangle
+        :type value: int
+        """
+
+        ts_x, ts_y = self.target.strides
+        draw_triangle_packed(self.target.ctypes.data, ts_x, ts_y, self.target.itemsize,
+                             depth.ctypes.data, *depth.strides,
+                             *point1, *point2, *point3, value, self.w, self.h)
+
+    def load(self, buffer: np.ndarray, rect: tuple[int, int, int, int] = None) -> None:
+        """
+        Expand a rectangle of the target on a RGB buffer indexed as ``[x, y]``.
+
+        :param buffer: w x h x 3 color buffer
+        :type buffer: np.ndarray
+        :param rect: x0, y0, x1, y1 inclusive, defaults to the whole screen
+        :type rect: tuple[int, int, int, int], optional
+        """
+
+        rect = rect or (0, 0, self.w - 1, self.h - 1)
+        ts_x, ts_y = self.target.strides
+        expand_packed(self.target.ctypes.data, ts_x, ts_y,
+                      self.target.itemsize, self.palette.ctypes.data,
+                      buffer.ctypes.data, *buffer.strides, *rect, self.w, self.h)
+
+    def store(self, buffer: np.ndarray, rect: tuple[int, int, int, int] = None) -> None:
+        """
+        Pack back a rectangle of a RGB buffer after something has been drawn on it directly.
+
+        :param buffer: w x h x 3 color buffer
+        :type buffer: np.ndarray
+        :param rect: x0, y0, x1, y1 inclusive, defaults to the whole screen
+        :type rect: tuple[int, int, int, int], optional
+        """
+
+        x0, y0, x1, y1 = rect or (0, 0, self.w - 1, self.h - 1)
+        x0, y0 = max(x0, 0), max(y0, 0)
+        x1, y1 = min(x1, self.w - 1) + 1, min(y1, self.h - 1) + 1
+
+        if x0 < x1 and y0 < y1:
+            colors = buffer[x0:x1, y0:y1]
+            self.target[x0:x1, y0:y1] = self.pack(colors).reshape(colors.shape[:2])
+
+
+def color_keys(colors: np.ndarray) -> np.ndarray:
+    """
+    RGB colors as 24 bits integers, to sort and search them.
+
+    :param colors: N x 3 uint8 array of colors
+    :type colors: np.ndarray
+    :return: N keys
+    :rtype: np.ndarray
+    """
+
+    colors = colors.astype(np.uint32)
+
+    return colors[:, 0] << 16 | colors[:, 1] << 8 | colors[:, 2]
+
+
+def median_cut(colors: np.ndarray, counts: np.ndarray, size: int) -> np.ndarray:
+    """
+    Split distinct colors in at most ``size`` boxes. At each level every box
+    is cut at the median of its weight along its widest channel, all the
+    boxes of a level at once, so the boxes are at most the power of two
+    below ``size``.
+
+    :param colors: N x 3 uint8 array of distinct colors
+    :type colors: np.ndarray
+    :param counts: weight of each color
+    :type counts: np.ndarray
+    :param size: maximum number of boxes
+    :type size: int
+    :return: box of each color, numbered from 0 without gaps
+    :rtype: np.ndarray
+    """
+
+    if len(colors) <= size:
+        return np.arange(len(colors))
+
+    colors = colors.astype(np.int32)
+    counts = counts.astype(np.float64)
+    labels = np.zeros(len(colors), dtype=np.int64)
+
+    for _ in range(size.bit_length() - 1):
+        # group the colors by box, numbered again without gaps
+        order = np.argsort(labels, kind="stable")
+        changes = np.diff(labels[order], prepend=-1) != 0
+        box = np.cumsum(changes) - 1
+        starts = np.flatnonzero(changes)
+        grouped = colors[order]
+        channel = np.argmax(np.maximum.reduceat(grouped, starts) -
+                            np.minimum.reduceat(grouped, starts), axis=1)
+
+        # sort each box along its widest channel
+        values = np.take_along_axis(grouped, channel[box, None], axis=1)[:, 0]
+        order = order[np.argsort(box * 256 + values, kind="stable")]
+        box = np.cumsum(np.diff(labels[order], prepend=-1) != 0) - 1
+        weights = counts[order]
+        totals = np.bincount(box, weights=weights)
+        before = np.cumsum(weights) - weights - (np.cumsum(totals) - totals)[box]
+        # the first color of a box stays below the cut, the last one of a box
+        # of two colors or more goes above it
+        upper = (2 * before >= totals[box]) | np.append(box[1:] != box[:-1], True)
+        labels[order] = 2 * box + (upper & (before > 0))
+
+    return np.unique(labels, return_inverse=True)[1].reshape(-1)
@@ -0,0 +1,202 @@
+"""
+Export of the rendered frames with extra channels, to generate datasets.
+"""
+
+import numpy as np
+from ext_rendering import draw_triangle_gbuffer
+from .checkerboard import Checkerboard
+
+
+class GBuffer:
+    """
+    Preallocated batch of frames rendered from ``cameras`` cameras, each one with
+    the channels:
+
+    - ``rgb``: h x w x 3 uint8 colors
+    - ``depth``: h x w float32 view depth, interpolated with the perspective,
+      ``zfar`` on the background
+    - ``ids``: h x w int32 handle of the body plus one, 0 on the background
+    - ``normals``: h x w x 3 float32 outward normal of the face in world coordinates
+    - ``motion``: h x w x 2 float32 screen motion in pixels since the previous
+      capture from the same camera, NaN on the faces that had a vertex behind
+      the camera then
+
+    The arrays are indexed as ``[camera, y, x]`` and the rasterizer writes every
+    channel while drawing the color, so a frame costs one pass whatever the
+    number of channels.
+
+    :param cameras: number of cameras of a batch, defaults to 1
+    :type cameras: int, optional
+    """
+
+    __slots__ = ["batch", "cameras", "views", "vertices", "prev_vertices",
+                 "index", "prev_points", "w", "h"]
+
+    def __init__(self, cameras: int = 1) -> None:
+        self.cameras = cameras
+        self.w = 0
+        self.h = 0
+        self.batch = {}
+        self.views = [None] * cameras
+        self.vertices = {}
+        self.prev_vertices = {}
+        self.index = 0
+        self.prev_points = None
+
+    def resize(self, w: int, h: int) -> None:
+        """
+        Allocate the channels for a screen size, if it changed.
+
+        :param w: width of the screen
+        :type w: int
+        :param h: height of the screen
+        :type h: int
+        """
+
+        if (w, h) == (self.w, self.h):
+            return
+
+        self.w = w
+        self.h = h
+        n = self.cameras
+        self.batch = {
+            "rgb": np.zeros((n, h, w, 3), dtype=np.uint8),
+            "depth": np.zeros((n, h, w), dtype=np.float32),
+            "ids": np.zeros((n, h, w), dtype=np.int32),
+            "normals": np.zeros((n, h, w, 3), dtype=np.float32),
+            "motion": np.zeros((n, h, w, 2), dtype=np.float32)
+        }
+
+    def begin_body(self, renderer, body) -> None:
+        """
+        Project the vertices of a body as they were at the previous capture from
+        the current camera, to compute the motion of its faces. The vertices
+        that were behind the camera have no position, NaN.
+
+        :param renderer: renderer drawing the body
+        :type renderer: Renderer
+        :param body: body about to be drawn
+        :type body: Body
+        """
+
+        camera = renderer.camera
+        vertices = np.array([(v.x, v.y, v.z) for v in body.v], dtype=np.float64).reshape(-1, 3)
+        self.vertices[body.name] = vertices
+        prev = self.prev_vertices.get(body.name)
+
+        if prev is None or prev.shape != vertices.shape:
+            prev = vertices
+
+        view = self.views[self.index]
+
+        if view is None:
+            view = Checkerboard.view_matrix(camera)
+
+        points = prev @ view[:3, :3].T + view[:3, 3]
+        z = np.where(points[:, 2] > 0, points[:, 2], np.nan)
+        x = (camera.af * points[:, 0] / z + 1) / 2 * camera.w - camera.cx
+        y = (- camera.f * points[:, 1] / z + 1) / 2 * camera.h - camera.cy
+        self.prev_points = np.stack((x, y), axis=1).tolist()
+
+    def draw(self,
+        renderer,
+        body,
+        face: tuple[int, int, int],
+        points: tuple[tuple[float, float, float], ...],
+        normal,
+        color: tuple[int, int, int]) -> None:
+        """
+        Draw a triangle in screen space on the color and depth buffers of a
+        renderer and on the channels of the current camera.
+
+        :param renderer: renderer drawing the face
+        :type renderer: Renderer
+        :param body: body that contain the face
+        :type body: Body
+        :param face: indices of the vertices of the face
+        :type face: tuple[int, int, int]
+        :param points: the three vertices as x, y and depth
+        :type points: tuple[tuple[float, float, float], ...]
+        :param normal: outward normal of the face
+        :type normal: Vec3
+        :param color: RGB color of the triangle
+        :type color: tuple[int, int, int]
+        """
+
+        camera = renderer.camera
+        buffer = renderer.buffer
+        depth = renderer.depth
+        k = self.index
+        linear = self.batch["depth"][k].T
+        ids = self.batch["ids"][k].T
+        normals = self.batch["normals"][k].transpose(1, 0, 2)
+        motion = self.batch["motion"][k].transpose(1, 0, 2)
+        prev = self.prev_points
+        vertex_motion = []
+
+        for index, point in zip(face, points):
+            vertex_motion.append(point[0] - prev[index][0])
+            vertex_motion.append(point[1] - prev[index][1])
+
+        draw_triangle_gbuffer(
+            buffer.ctypes.data, *buffer.strides,
+            depth.ctypes.data, *depth.strides,
+            ids.ctypes.data, *ids.strides,
+            linear.ctypes.data, *linear.strides,
+            normals.ctypes.data, *normals.strides,
+            motion.ctypes.data, *motion.strides,
+            body.handle + 1, (normal.x, normal.y, normal.z), tuple(vertex_motion),
+            camera.q, camera.znear,
+            *points[0], *points[1], *points[2],
+            *color, camera.w, camera.h
+        )
+
+    def capture(self, renderer, cameras: list = None) -> dict[str, np.ndarray]:
+        """
+        Render the scene of a renderer from each camera and fill the batch. The
+        camera of the renderer is restored at the end.
+
+        :param renderer: headless renderer with the scene
+        :type renderer: Renderer
+        :param cameras: at most ``cameras`` cameras, defaults to the one of the renderer
+        :type cameras: list[Camera], optional
+        :return: channels of the batch by name
+        :rtype: dict[str, np.ndarray]
+        """
+
+        if (renderer.span_buffer or renderer.compressed_depth or
+            renderer.tiled_framebuffer or renderer.packed):
+            raise ValueError("The G-buffer can only be drawn by the default rasterizer")
+
+        cameras = cameras or [renderer.camera]
+
+        if len(cameras) > self.cameras:
+            raise ValueError(f"At most {self.cameras} cameras per batch")
+
+        main_camera = renderer.camera
+        previous = renderer.gbuffer
+        renderer.gbuffer = self
+        self.vertices = {}
+
+        try:
+            for k, camera in enumerate(cameras):
+                renderer.camera = camera
+                self.index = k
+                camera.update_projection_space(renderer.screen)
+                self.resize(camera.w, camera.h)
+                self.batch["depth"][k].fill(camera.zfar)
+                self.batch["ids"][k].fill(0)
+                self.batch["normals"][k].fill(0)
+                self.batch["motion"][k].fill(0)
+
+                renderer.render()
+
+                np.copyto(self.batch["rgb"][k], renderer.buffer.transpose(1, 0, 2))
+                self.views[k] = Checkerboard.view_matrix(camera)
+        finally:
+            renderer.camera = main_camera
+            renderer.gbuffer = previous
+
+        self.prev_vertices.update(self.vertices)
+
+        return self.batch
@@ -0,0 +1,78 @@
+"""
+Occlusion culling against the depth of what has already been drawn.
+"""
+
+import math
+import numpy as np
+from ext_rendering import build_hiz
+
+
+class HiZ:
+    """
+    Hierarchical depth buffer. Level 0 is the depth buffer itself, each following
+    level halves the resolution keeping the farthest depth of each 2x2 block, so
+    any screen rectangle can be tested reading at most 3x3 values.
+    """
+
+    __slots__ = ["levels"]
+
+    def __init__(self) -> None:
+        self.levels = []
+
+    def build(self, depth: np.ndarray) -> None:
+        """
+        Build the pyramid from a depth buffer indexed as ``depth[x, y]``.
+
+        :param depth: depth buffer
+        :type depth: np.ndarray
+        """
+
+        if not self.levels or self.levels[0] is not depth:
+            self.levels = [depth]
+            width, height = depth.shape
+
+            while width > 1 or height > 1:
+                width = (width + 1) // 2
+                height = (height + 1) // 2
+                self.levels.append(np.empty((width, height), dtype=np.float32))
+
+        for src, dst in zip(self.levels[:-1], self.levels[1:]):
+            build_hiz(src.ctypes.data, *src.strides, *src.shape,
+                      dst.ctypes.data, *dst.shape)
+
+    def occluded(self, x0: float, y0: float, x1: float, y1: float, depth: float) -> bool:
+        """
+        Check if a screen rectangle at a given depth is behind everything drawn in it.
+
+        :param x0: left side of the rectangle in pixels
+        :type x0: float
+        :param y0: top side of the rectangle in pixels
+        :type y0: float
+        :param x1: right side of the rectangle in pixels
+        :type x1: float
+        :param y1: bottom side of the rectangle in pixels
+        :type y1: float
+        :param depth: nearest depth of the object inside the rectangle
+        :type depth: float
+        :return: True if the object can not be visible
+        :rtype: bool
+        """
+
+        if not self.levels:
+            return False
+
+        width, height = self.levels[0].shape
+        x0 = max(int(x0), 0)
+        y0 = max(int(y0), 0)
+        x1 = min(int(x1), width - 1)
+        y1 = min(int(y1), height - 1)
+
+        if x0 > x1 or y0 > y1:
+            return False
+
+        level = max(0, math.ceil(math.log2(max(x1 - x0 + 1, y1 - y0 + 1) / 2)))
+        level = min(level, len(self.levels) - 1)
+        farthest = self.levels[level][x0 >> level:(x1 >> level) + 1,
+                                      y0 >> level:(y1 >> level) + 1].max()
+
+        return depth > farthest
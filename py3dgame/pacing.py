@@ -0,0 +1,141 @@
+"""
+Frame pacing with late input sampling and measure of the latency.
+"""
+
+import time
+from collections import deque
+
+
+class FramePacer:
+    """
+    Limit the frame rate to ``fps`` presenting each frame as close as possible to
+    its deadline. :meth:`wait` returns at the latest time that still lets the
+    frame be ready by the deadline, according to the duration of the previous
+    frames, so the input read right after it is as recent as possible. The
+    waits sleep until ``spin`` seconds before the target and then spin, since
+    the sleep of the scheduler can be late by a millisecond or more.
+
+    With a pacer in :attr:`py3dgame.rendering.Renderer.pacer` the renderer calls
+    :meth:`presented` after each frame, and ``latency`` is the time from
+    :meth:`input_sampled` or the end of :meth:`wait` to the presentation.
+
+    :param fps: target frame rate, defaults to 60
+    :type fps: float, optional
+    :param spin: seconds spent spinning before a target, defaults to 0.002
+    :type spin: float, optional
+    :param margin: seconds added to the expected duration of a frame, defaults to 0.001
+    :type margin: float, optional
+    :param history: number of frames kept for the statistics, defaults to 120
+    :type history: int, optional
+    """
+
+    __slots__ = ["period", "spin", "margin", "deadline", "wake", "input_time",
+                 "work", "latency", "latencies", "frame_times", "last_present"]
+
+    def __init__(
+        self,
+        fps: float = 60,
+        spin: float = 0.002,
+        margin: float = 0.001,
+        history: int = 120) -> None:
+
+        self.period = 1 / fps
+        self.spin = spin
+        self.margin = margin
+        self.deadline = None
+        self.wake = None
+        self.input_time = None
+        self.work = 0
+        self.latency = 0
+        self.latencies = deque(maxlen=history)
+        self.frame_times = deque(maxlen=history)
+        self.last_present = None
+
+    def sleep_until(self, target: float) -> None:
+        """
+        Sleep and then spin until a time of :func:`time.perf_counter`.
+
+        :param target: time to reach in seconds
+        :type target: float
+        """
+
+        remaining = target - time.perf_counter()
+
+        if remaining > self.spin:
+            time.sleep(remaining - self.spin)
+
+        while time.perf_counter() < target:
+            pass
+
+    def wait(self) -> None:
+        """
+        Wait for the time to start the next frame. A late frame starts at once
+        and the deadlines are moved after it.
+        """
+
+        now = time.perf_counter()
+        start = None if self.deadline is None else self.deadline - self.work - self.margin
+
+        if start is None or now >= start:
+            self.deadline = now + self.work + self.margin
+        else:
+            self.sleep_until(start)
+
+        self.wake = time.perf_counter()
+        self.input_time = self.wake
+
+    def input_sampled(self) -> None:
+        """
+        Mark the time the input of the frame has been read, if later than :meth:`wait`.
+        """
+
+        self.input_time = time.perf_counter()
+
+    def presented(self) -> None:
+        """
+        Mark the presentation of the frame, measure its latency and its duration
+        and set the deadline of the next one.
+        """
+
+        now = time.perf_counter()
+
+        if self.wake is not None:
+            # the expected duration follows increases at once and decreases slowly
+            self.work = max(now - self.wake, 0.9 * self.work)
+            self.latency = now - self.input_time
+            self.latencies.append(self.latency)
+
+        if self.last_present is not None:
+            self.frame_times.append(now - self.last_present)
+
+        self.last_present = now
+        self.wake = None
+
+        if self.deadline is not None:
+            self.deadline += self.period
+
+    def fps(self) -> float:
+        """
+        Frame rate measured on the last frames.
+
+        :return: frames per second, 0 before two frames
+        :rtype: float
+        """
+
+        if not self.frame_times:
+            return 0
+
+        return len(self.frame_times) / sum(self.frame_times)
+
+    def mean_latency(self) -> float:
+        """
+        Input to present latency averaged on the last frames.
+
+        :return: latency in seconds, 0 before the first frame
+        :rtype: float
+        """
+
+        if not self.latencies:
+            return 0
+
+        return sum(self.latencies) / len(self.latencies)
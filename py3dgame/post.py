@@ -0,0 +1,262 @@
+"""
+Post processing effects applied to the final color buffer of a frame.
+"""
+
+import os
+from concurrent.futures import ThreadPoolExecutor
+from typing import Callable
+import numpy as np
+from ext_rendering import fxaa, post_chain
+from .color import Color
+
+FOG_MODES = {"linear": 1, "exp": 2}
+TONEMAP_MODES = {"clamp": 1, "reinhard": 2, "aces": 3}
+# Fields of the PostParams struct of ext_rendering
+POST_PARAMS = 14
+
+
+class RowPass:
+    """
+    Base of the effects running a native pass on bands of rows of the buffer,
+    split among ``workers`` threads.
+
+    :param workers: number of threads, defaults to the number of cores
+    :type workers: int, optional
+    """
+
+    __slots__ = ["workers", "executor"]
+
+    def __init__(self, workers: int = None) -> None:
+        self.workers = workers or os.cpu_count() or 1
+        self.executor = None
+
+    def run(self, apply_rows: Callable[[int, int], None], height: int) -> None:
+        """
+        Call ``apply_rows(start, stop)`` on bands of rows covering the whole height.
+
+        :param apply_rows: function processing the rows from start to stop excluded
+        :type apply_rows: Callable[[int, int], None]
+        :param height: number of rows
+        :type height: int
+        """
+
+        if self.workers == 1:
+            apply_rows(0, height)
+            return
+
+        if self.executor is None:
+            self.executor = ThreadPoolExecutor(max_workers=self.workers)
+
+        bounds = np.linspace(0, height, self.workers + 1, dtype=np.int64).tolist()
+        list(self.executor.map(apply_rows, bounds[:-1], bounds[1:]))
+
+
+class FXAA(RowPass):
+    """
+    Fast approximate antialiasing. Pixels where the luma contrast with the
+    neighbours is above the thresholds are blended with the neighbour across
+    the edge, by an amount that depends on their position along the edge.
+
+    :param threshold: minimum contrast relative to the brightest neighbour, defaults to 0.125
+    :type threshold: float, optional
+    :param threshold_min: minimum absolute contrast, to skip dark areas, defaults to 0.0312
+    :type threshold_min: float, optional
+    :param subpixel: amount of blending of single pixel details, defaults to 0.75
+    :type subpixel: float, optional
+    :param workers: number of threads, defaults to the number of cores
+    :type workers: int, optional
+    """
+
+    __slots__ = ["threshold", "threshold_min", "subpixel", "source"]
+
+    def __init__(
+        self,
+        threshold: float = 0.125,
+        threshold_min: float = 0.0312,
+        subpixel: float = 0.75,
+        workers: int = None) -> None:
+
+        super().__init__(workers)
+        self.threshold = threshold
+        self.threshold_min = threshold_min
+        self.subpixel = subpixel
+        self.source = None
+
+    def apply(self, renderer) -> None:
+        """
+        Antialias the color buffer of a renderer in place.
+
+        :param renderer: renderer with the frame in ``buffer``
+        :type renderer: Renderer
+        """
+
+        buffer = renderer.buffer
+
+        if self.source is None or self.source.shape != buffer.shape:
+            self.source = np.empty_like(buffer)
+
+        source = self.source
+        np.copyto(source, buffer)
+        source_strides = tuple(source.strides)
+        width, height = buffer.shape[:2]
+
+        def apply_rows(start: int, stop: int) -> None:
+            fxaa(source.ctypes.data, *source_strides,
+                 buffer.ctypes.data, *buffer.strides,
+                 self.threshold, self.threshold_min, self.subpixel,
+                 width, height, start, stop)
+
+        self.run(apply_rows, height)
+
+
+class Fog:
+    """
+    Blend the pixels with a color by their view depth, linearly from ``start``
+    to ``end`` or, if ``density`` is given, exponentially after ``start``.
+    With a black color it is a depth cueing.
+
+    :param color: RGB color of the fog
+    :type color: Color
+    :param start: depth where the fog begins, defaults to 0
+    :type start: float, optional
+    :param end: depth where the fog hides everything, defaults to 100
+    :type end: float, optional
+    :param density: density of the exponential fog, defaults to None
+    :type density: float, optional
+    """
+
+    __slots__ = ["color", "start", "end", "density"]
+
+    def __init__(
+        self,
+        color: Color,
+        start: float = 0,
+        end: float = 100,
+        density: float = None) -> None:
+
+        self.color = color
+        self.start = start
+        self.end = end
+        self.density = density
+
+
+class Tonemap:
+    """
+    Multiply the colors by ``exposure`` and map them back to the displayable
+    range with the operator ``"clamp"``, ``"reinhard"`` or ``"aces"``.
+
+    :param exposure: scale of the colors, defaults to 1
+    :type exposure: float, optional
+    :param operator: tonemapping curve, defaults to "reinhard"
+    :type operator: str, optional
+    :param white: smallest exposed value mapped to white by reinhard, defaults to 2
+    :type white: float, optional
+    """
+
+    __slots__ = ["exposure", "operator", "white"]
+
+    def __init__(self, exposure: float = 1, operator: str = "reinhard", white: float = 2) -> None:
+        if operator not in TONEMAP_MODES:
+            raise ValueError(f"Unknown tonemap operator {operator}")
+
+        self.exposure = exposure
+        self.operator = operator
+        self.white = white
+
+
+class ColorGrade:
+    """
+    Replace the colors through a n x n x n lookup table indexed as ``[r, g, b]``,
+    interpolated trilinearly.
+
+    :param lut: n x n x n x 3 uint8 table
+    :type lut: np.ndarray
+    """
+
+    __slots__ = ["lut"]
+
+    def __init__(self, lut: np.ndarray) -> None:
+        lut = np.ascontiguousarray(lut, dtype=np.uint8)
+
+        if lut.ndim != 4 or lut.shape[3] != 3 or len(set(lut.shape[:3])) != 1 or lut.shape[0] < 2:
+            raise ValueError("The lookup table must be n x n x n x 3")
+
+        self.lut = lut
+
+    @staticmethod
+    def identity(size: int = 17) -> np.ndarray:
+        """
+        Lookup table that leaves the colors unchanged, to be edited.
+
+        :param size: entries per channel, defaults to 17
+        :type size: int, optional
+        :return: size x size x size x 3 uint8 table
+        :rtype: np.ndarray
+        """
+
+        levels = np.round(np.linspace(0, 255, size)).astype(np.uint8)
+
+        return np.stack(np.meshgrid(levels, levels, levels, indexing="ij"), axis=-1)
+
+
+class PostChain(RowPass):
+    """
+    :class:`Fog`, :class:`Tonemap` and :class:`ColorGrade` fused in a single
+    native pass, so each pixel is read and written once whatever the number of
+    stages. The stages are applied in this order, at most one of each kind.
+
+    :param stages: stages of the chain
+    :type stages: list
+    :param workers: number of threads, defaults to the number of cores
+    :type workers: int, optional
+    """
+
+    __slots__ = ["stages", "params"]
+
+    def __init__(self, stages: list, workers: int = None) -> None:
+        super().__init__(workers)
+
+        for stage in stages:
+            if not isinstance(stage, (Fog, Tonemap, ColorGrade)):
+                raise ValueError(f"Unknown post processing stage {stage}")
+
+        self.stages = stages
+        self.params = np.zeros(POST_PARAMS, dtype=np.float32)
+
+    def apply(self, renderer) -> None:
+        """
+        Apply the stages to the color buffer of a renderer in place.
+
+        :param renderer: renderer with the frame in ``buffer`` and ``depth``
+        :type renderer: Renderer
+        """
+
+        camera = renderer.camera
+        params = self.params
+        params.fill(0)
+        params[7:9] = (camera.q, camera.znear)
+        lut = None
+
+        for stage in self.stages:
+            if isinstance(stage, Fog):
+                params[0] = FOG_MODES["linear" if stage.density is None else "exp"]
+                params[1:4] = (stage.start, stage.end, stage.density or 0)
+                params[4:7] = stage.color
+            elif isinstance(stage, Tonemap):
+                params[9:12] = (TONEMAP_MODES[stage.operator], stage.exposure, stage.white)
+            else:
+                lut = stage.lut
+
+        buffer = renderer.buffer
+        depth = renderer.depth
+        width, height = buffer.shape[:2]
+
+        def apply_rows(start: int, stop: int) -> None:
+            post_chain(buffer.ctypes.data, *buffer.strides,
+                       depth.ctypes.data, *depth.strides,
+                       params.ctypes.data,
+                       0 if lut is None else lut.ctypes.data,
+                       0 if lut is None else len(lut),
+                       width, height, start, stop)
+
+        self.run(apply_rows, height)
@@ -0,0 +1,160 @@
+"""
+Rendering of images larger than the screen, one tile at a time.
+"""
+
+import struct
+import zlib
+from typing import BinaryIO, Callable
+import numpy as np
+
+PNG_SIGNATURE = b"\x89PNG\r\n\x1a\n"
+
+
+class PNGWriter:
+    """
+    PNG encoder receiving the image in bands of rows, so only the compressed
+    data and the band being written are kept in memory.
+
+    :param file: path or binary file to write
+    :type file: str | BinaryIO
+    :param width: width of the image
+    :type width: int
+    :param height: height of the image
+    :type height: int
+    :param level: zlib compression level, defaults to 6
+    :type level: int, optional
+    """
+
+    __slots__ = ["file", "owned", "width", "height", "rows", "compressor"]
+
+    def __init__(self, file: str | BinaryIO, width: int, height: int, level: int = 6) -> None:
+        self.owned = isinstance(file, str)
+        self.file = open(file, "wb") if self.owned else file  # pylint: disable=consider-using-with
+        self.width = width
+        self.height = height
+        self.rows = 0
+        self.compressor = zlib.compressobj(level)
+        self.file.write(PNG_SIGNATURE)
+        # 8 bits RGB, not interlaced
+        self.chunk(b"IHDR", struct.pack(">IIBBBBB", width, height, 8, 2, 0, 0, 0))
+
+    def chunk(self, kind: bytes, data: bytes) -> None:
+        """
+        Write a chunk of the PNG stream.
+
+        :param kind: four letters type of the chunk
+        :type kind: bytes
+        :param data: content of the chunk
+        :type data: bytes
+        """
+
+        self.file.write(struct.pack(">I", len(data)))
+        self.file.write(kind)
+        self.file.write(data)
+        self.file.write(struct.pack(">I", zlib.crc32(kind + data)))
+
+    def write_rows(self, rows: np.ndarray) -> None:
+        """
+        Append rows to the image.
+
+        :param rows: n x width x 3 uint8 colors
+        :type rows: np.ndarray
+        """
+
+        if rows.shape[1:] != (self.width, 3) or self.rows + len(rows) > self.height:
+            raise ValueError("The rows do not fit in the image")
+
+        # each row starts with the filter type, 0 is none
+        lines = np.zeros((len(rows), 1 + 3 * self.width), dtype=np.uint8)
+        lines[:, 1:] = rows.reshape(len(rows), -1)
+        self.rows += len(rows)
+        data = self.compressor.compress(lines.tobytes())
+
+        if data:
+            self.chunk(b"IDAT", data)
+
+    def close(self) -> None:
+        """
+        Terminate the image and close the file if it was opened by the writer.
+        """
+
+        if self.rows != self.height:
+            raise ValueError(f"Written {self.rows} rows of {self.height}")
+
+        self.chunk(b"IDAT", self.compressor.flush())
+        self.chunk(b"IEND", b"")
+
+        if self.owned:
+            self.file.close()
+
+
+class Poster:
+    """
+    Render a ``width`` x ``height`` image with the camera of a headless renderer,
+    whose screen is used as tile. Each tile shows a window of the image through
+    :attr:`py3dgame.rendering.Camera.window`, and the tiles of a band are
+    assembled in rows and passed on, so the memory needed is a band of tiles
+    whatever the size of the image.
+
+    Post effects reading the neighbours of a pixel, like FXAA, see only the tile
+    and may leave seams at its borders.
+
+    :param width: width of the image
+    :type width: int
+    :param height: height of the image
+    :type height: int
+    """
+
+    __slots__ = ["width", "height"]
+
+    def __init__(self, width: int, height: int) -> None:
+        self.width = width
+        self.height = height
+
+    def render(self, renderer, write_rows: Callable[[np.ndarray], None]) -> None:
+        """
+        Render the image band by band.
+
+        :param renderer: headless renderer, its screen sets the size of a tile
+        :type renderer: Renderer
+        :param write_rows: function receiving each band as a n x width x 3 uint8 array
+        :type write_rows: Callable[[np.ndarray], None]
+        """
+
+        if renderer.checkerboard:
+            raise ValueError("Checkerboard rendering needs whole frames")
+
+        camera = renderer.camera
+        tile_w = renderer.screen.get_width()
+        tile_h = renderer.screen.get_height()
+        band = np.empty((tile_h, self.width, 3), dtype=np.uint8)
+        window = camera.window
+
+        try:
+            for y0 in range(0, self.height, tile_h):
+                rows = min(tile_h, self.height - y0)
+
+                for x0 in range(0, self.width, tile_w):
+                    columns = min(tile_w, self.width - x0)
+                    camera.window = (x0, y0, self.width, self.height)
+                    renderer.render()
+                    band[:rows, x0:x0 + columns] = \
+                        renderer.buffer[:columns, :rows].transpose(1, 0, 2)
+
+                write_rows(band[:rows])
+        finally:
+            camera.window = window
+
+    def save(self, renderer, file: str | BinaryIO) -> None:
+        """
+        Render the image on a PNG file.
+
+        :param renderer: headless renderer, its screen sets the size of a tile
+        :type renderer: Renderer
+        :param file: path or binary file to write
+        :type file: str | BinaryIO
+        """
+
+        writer = PNGWriter(file, self.width, self.height)
+        self.render(renderer, writer.write_rows)
+        writer.close()
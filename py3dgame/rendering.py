@@ -3,13 +3,22 @@ Module for handling the rendering pipeline.
 """
 
 import math
+import time
 from collections import defaultdict
 import pygame
 import numpy as np
-from ext_rendering import draw_triangle, fill_bg
+from ext_rendering import draw_sprite
 from .math3d import Vec3, Quat, rotate
-from .color import WHITE, darken_color, Color
+from .color import WHITE, Color
 from .scene import Scene, Body
+from .visibility import Plane
+from .occlusion import HiZ
+from .spans import SpanBuffer
+from .depth import CompressedDepth
+from .framebuffer import TiledFramebuffer, CompactFramebuffer
+from .checkerboard import Checkerboard
+from .stats import Laps
+from .backends import ScalarBackend
 
 
 class Camera:
@@ -20,12 +29,18 @@ class Camera:
     :type pos: Vec3, optional
     :param direction: initial direction of the camera, defaults to Vec3(1, 0, 0)
     :type direction: Vec3, optional
+
+    When ``window`` is set to ``(x0, y0, width, height)`` the screen shows only
+    the rectangle at ``x0, y0`` of a ``width`` x ``height`` image seen by the
+    camera, ``af`` and ``f`` are scaled to that image and ``cx, cy`` is the shift
+    in pixels of the projected points.
     """
 
     __slots__ = ["pos", "dir", "mouse_pos",
                  "theta", "zfar", "znear",
                  "w", "h", "a", "f", "q", "af",
-                 "up", "right", "tup", "tright", "tdir"]
+                 "up", "right", "tup", "tright", "tdir",
+                 "window", "cx", "cy"]
 
     def __init__(
             self,
@@ -46,6 +61,9 @@ class Camera:
         self.f = 0
         self.q = 0
         self.af = 0
+        self.window = None
+        self.cx = 0
+        self.cy = 0
 
         self.up = Vec3(0, 0, 0)
         self.right = Vec3(0, 0, 0)
@@ -105,6 +123,16 @@ class Camera:
         self.f = 1 / math.tan(self.theta / 2)
         self.q = self.zfar / (self.zfar - self.znear)
         self.af = self.a * self.f
+        self.cx = 0
+        self.cy = 0
+
+        if self.window is not None:
+            x0, y0, width, height = self.window
+            self.a = height / width
+            self.af = self.a * self.f * width / self.w
+            self.f = self.f * height / self.h
+            self.cx = x0 + (self.w - width) / 2
+            self.cy = y0 + (self.h - height) / 2
 
     def update_view_space(self) -> None:
         """
@@ -121,6 +149,49 @@ class Camera:
         self.tdir = target * self.dir
         self.tright = target * self.right
 
+    def eye(self) -> Vec3:
+        """
+        Get the center of the projection, the view space is measured from ``pos + dir``.
+
+        :return: center of the projection in world coordinates
+        :rtype: Vec3
+        """
+
+        return self.pos + self.dir
+
+    def frustum(self) -> list[Plane]:
+        """
+        Compute the planes of the view frustum in world coordinates, the projection
+        and view space parameters must be up to date.
+
+        :return: planes of the frustum
+        :rtype: list[Plane]
+        """
+
+        eye = self.eye()
+        scale = abs(self.dir)
+        direction = self.dir / scale
+        right = self.right / scale
+        # slopes of the sides of the screen, shifted when it shows a window,
+        # the view y is not scaled by the length of dir while z and x are
+        shift_x = 2 * self.cx / self.w
+        shift_y = 2 * self.cy / self.h
+        planes = []
+
+        for normal in (direction * ((1 + shift_x) / self.af) - right,
+                       direction * ((1 - shift_x) / self.af) + right,
+                       direction * ((1 - shift_y) * scale / self.f) - self.up,
+                       direction * ((1 + shift_y) * scale / self.f) + self.up):
+            normal = normal.normalize()
+            planes.append((normal, - (normal * eye)))
+
+        near = self.znear * (1 + 1 / self.q) / scale
+        far = (self.zfar / self.q + self.znear) / scale
+        planes.append((direction, - (direction * eye) - near))
+        planes.append((- direction, direction * eye + far))
+
+        return planes
+
 
 class Renderer:
     """
@@ -136,10 +207,79 @@ class Renderer:
     :type clock: pygame.time.Clock
     :param caption: caption of the window, defaults to "Py3dGame"
     :type caption: str, optional
+    :param headless: render only into ``buffer`` and ``depth`` without touching
+        the display, ``screen`` can be any pygame.Surface, defaults to False
+    :type headless: bool, optional
+
+    Bodies with at least ``impostor_faces`` faces whose projection is smaller than
+    ``impostor_size`` pixels are drawn as impostors, see :class:`Impostor`.
+    Impostors are disabled while ``impostor_size`` is 0.
+
+    With ``occlusion`` the bodies visible in the previous frame are drawn first,
+    then the others are drawn only if they are not hidden behind them according
+    to a :class:`py3dgame.occlusion.HiZ` built from ``depth``.
+
+    With ``span_buffer`` the faces are inserted in a
+    :class:`py3dgame.spans.SpanBuffer` and each pixel is written once when the
+    spans are flushed, instead of testing the depth of every covered pixel.
+
+    With ``compressed_depth`` the depth test runs on a
+    :class:`py3dgame.depth.CompressedDepth` and ``depth`` is up to date
+    only after :meth:`load_buffers`.
+
+    With ``tiled_framebuffer`` color and depth are drawn on a
+    :class:`py3dgame.framebuffer.TiledFramebuffer`, resolved on ``buffer`` and
+    ``depth`` by :meth:`load_buffers` before presenting. ``compressed_depth``
+    takes precedence over it.
+
+    With ``color_format`` set to ``"rgb565"`` or ``"palette"`` faces are drawn on
+    a :class:`py3dgame.framebuffer.CompactFramebuffer` of 2 or 1 bytes per pixel,
+    when none of the modes above is on.
+
+    With ``checkerboard``, when none of the modes above is on, each frame draws
+    half of the pixels and :class:`py3dgame.checkerboard.Checkerboard` fills the
+    others from the previous frame.
+
+    With a :class:`py3dgame.gbuffer.GBuffer` in ``gbuffer``, when none of the
+    modes above is on, the faces are also drawn on its channels and impostors
+    are not used. It is set by :meth:`py3dgame.gbuffer.GBuffer.capture`.
+
+    The effects in ``post_effects``, like :class:`py3dgame.post.FXAA` or a
+    :class:`py3dgame.post.PostChain`, are applied in order before presenting.
+
+    A :class:`py3dgame.pacing.FramePacer` in ``pacer`` is told when each frame
+    is presented and its frame rate and latency are shown instead of the ones
+    of ``clock``.
+
+    With a :class:`py3dgame.stats.Stats` in ``stats`` the duration of each stage
+    of the frames is recorded in its histograms, with a
+    :class:`py3dgame.stats.BodyCosts` in ``costs`` the work done for each body.
+    With :class:`py3dgame.counters.PerfCounters` in ``counters`` the stages
+    also record the hardware counters in ``stats``, and with
+    :class:`py3dgame.counters.AllocationCounters` in ``allocations`` the
+    allocations made by each stage.
+
+    The faces are drawn by ``backend``, see :mod:`py3dgame.backends`, when no
+    other buffer is on. The :class:`py3dgame.commands.CommandBuffer` in
+    ``command_buffers`` are executed after the bodies of the scene, once the
+    backend has drawn them. Their faces are drawn by the native scalar
+    rasterizer whatever the backend.
+
+    A :class:`py3dgame.capture.FrameCapture` in ``frame_capture`` receives the
+    triangles of the frame as they are submitted to the raster stage, except
+    the ones of the command buffers, drawn in a single native call.
     """
 
     __slots__ = ["screen", "camera", "scene", "clock", "triangles", "computed",
-                 "lib", "buffer", "depth", "buffer_ptr", "depth_ptr"]
+                 "lib", "buffer", "depth", "buffer_ptr", "depth_ptr", "headless",
+                 "impostors", "impostor_size", "impostor_faces",
+                 "impostor_angle", "impostor_distance",
+                 "occlusion", "hiz", "last_visible", "span_buffer", "spans",
+                 "compressed_depth", "depth_tiles", "tiled_framebuffer", "framebuffer",
+                 "color_format", "compact", "post_effects",
+                 "checkerboard", "checker", "parity", "gbuffer", "pacer", "stats",
+                 "pixels", "costs", "counters", "allocations", "frame_capture",
+                 "backend", "command_buffers"]
 
     pygame.init()
     font = pygame.font.SysFont('arial', 18, True)
@@ -150,7 +290,8 @@ class Renderer:
         camera: Camera,
         scene: Scene,
         clock: pygame.time.Clock,
-        caption: str = "Py3dGame") -> None:
+        caption: str = "Py3dGame",
+        headless: bool = False) -> None:
 
         self.screen = screen
         self.camera = camera
@@ -158,6 +299,7 @@ class Renderer:
         self.screen.fill(self.scene.bgc)
         self.clock = clock
         self.triangles = 0
+        self.pixels = 0
         self.computed = defaultdict(self._default_value)
         self.buffer = pygame.surfarray.array3d(self.screen)
         self.depth = np.ones((self.buffer.shape[0],
@@ -167,63 +309,437 @@ class Renderer:
         self.depth.flags.writeable = True
         self.buffer_ptr = self.buffer.__array_interface__['data'][0]
         self.depth_ptr = self.depth.__array_interface__['data'][0]
-
-        pygame.display.set_caption(caption)
+        self.headless = headless
+        self.impostors = {}
+        self.impostor_size = 0
+        self.impostor_faces = 256
+        self.impostor_angle = 0.05
+        self.impostor_distance = 0.1
+        self.occlusion = False
+        self.hiz = HiZ()
+        self.last_visible = set()
+        self.span_buffer = False
+        self.spans = SpanBuffer()
+        self.compressed_depth = False
+        self.depth_tiles = CompressedDepth()
+        self.tiled_framebuffer = False
+        self.framebuffer = TiledFramebuffer()
+        self.color_format = "rgb"
+        self.compact = None
+        self.post_effects = []
+        self.checkerboard = False
+        self.checker = Checkerboard()
+        self.parity = -1
+        self.gbuffer = None
+        self.pacer = None
+        self.stats = None
+        self.costs = None
+        self.counters = None
+        self.allocations = None
+        self.frame_capture = None
+        self.backend = ScalarBackend()
+        self.command_buffers = []
+
+        if not headless:
+            pygame.display.set_caption(caption)
 
     @staticmethod
     def _default_value() -> None:
         return None
 
-    def render(self) -> None:
+    def clear(self) -> None:
         """
-        Render all the object in scene.
+        Update the camera and clear color and depth buffers for a new frame.
         """
 
         self.triangles = 0
+        self.pixels = 0
         self.camera.update_projection_space(self.screen)
         self.camera.update_view_space()
-        self.computed = defaultdict(self._default_value)
-        fill_bg(
-            self.buffer_ptr,
-            *self.buffer.strides,
-            *self.scene.bgc, self.camera.w, self.camera.h
-        )
-        self.depth.fill(self.camera.zfar)
 
-        for body in self.scene.bodies.values():
-            self.render_body(body)
+        if self.compressed_depth:
+            self.backend.fill(self)
+            self.depth_tiles.clear(self.camera.w, self.camera.h, self.camera.zfar)
+        elif self.tiled_framebuffer:
+            self.framebuffer.clear(self.camera.w, self.camera.h,
+                                   self.scene.bgc, self.camera.zfar)
+        elif self.packed:
+            if self.compact is None or self.compact.color_format != self.color_format:
+                self.compact = CompactFramebuffer(self.color_format)
+
+            self.compact.clear(self.camera.w, self.camera.h, self.scene.bgc)
+            self.depth.fill(self.camera.zfar)
+        else:
+            self.backend.fill(self)
+            self.depth.fill(self.camera.zfar)
+
+        if self.span_buffer:
+            self.spans.clear(self.camera.w, self.camera.h)
+
+        self.parity = -1
+
+        if self.checkerboard and self.gbuffer is None and not (
+            self.span_buffer or self.compressed_depth or self.tiled_framebuffer or self.packed):
+            self.parity = self.checker.next_parity()
+
+    @property
+    def packed(self) -> bool:
+        """
+        True when the faces are drawn on the compact framebuffer.
+
+        :return: whether ``color_format`` is in use
+        :rtype: bool
+        """
+
+        return self.color_format != "rgb" and not (
+            self.span_buffer or self.compressed_depth or self.tiled_framebuffer)
+
+    def flush(self) -> None:
+        """
+        Write the pending spans on color and depth buffer when ``span_buffer`` is on,
+        and the triangles kept by the backend.
+        """
+
+        self.pixels += self.backend.flush(self)
+
+        if self.span_buffer:
+            self.load_buffers()
+            self.spans.resolve(self.buffer, self.depth)
+            self.store_buffers()
+
+    def load_buffers(self, rect: tuple[int, int, int, int] = None) -> None:
+        """
+        Bring ``depth`` up to date with the compressed depth, or ``buffer`` and
+        ``depth`` with the tiled framebuffer, when one of them is on.
+
+        :param rect: x0, y0, x1, y1 inclusive, defaults to the whole screen
+        :type rect: tuple[int, int, int, int], optional
+        """
+
+        if self.compressed_depth:
+            self.depth_tiles.load(self.depth, rect)
+        elif self.tiled_framebuffer:
+            self.framebuffer.load(self.buffer, self.depth, rect)
+        elif self.packed:
+            self.compact.load(self.buffer, rect)
+
+    def store_buffers(self, rect: tuple[int, int, int, int] = None) -> None:
+        """
+        Copy back to the compressed depth or to the tiled framebuffer what has been
+        drawn directly on ``buffer`` and ``depth`` after :meth:`load_buffers`.
+
+        :param rect: x0, y0, x1, y1 inclusive, defaults to the whole screen
+        :type rect: tuple[int, int, int, int], optional
+        """
+
+        if self.compressed_depth:
+            self.depth_tiles.store(self.depth, rect)
+        elif self.tiled_framebuffer:
+            self.framebuffer.store(self.buffer, self.depth, rect)
+        elif self.packed:
+            self.compact.store(self.buffer, rect)
+
+    def render(self) -> None:
+        """
+        Render all the object in scene.
+        """
+
+        laps = Laps(self.stats, self.counters, self.allocations)
+        self.clear()
+
+        if self.costs is not None:
+            self.costs.frames += 1
+
+        if self.frame_capture is not None:
+            self.frame_capture.begin(self)
+
+        self.scene.update()
+
+        if self.impostors:
+            self.drop_impostors()
+
+        laps.lap("clear")
+        bodies = self.visible_bodies()
+
+        if self.packed and self.color_format == "palette":
+            for body in bodies:
+                body.shade_faces(self.scene.light)
+
+            self.compact.build_palette(self.scene.bgc, [body.shade for body in bodies])
+
+        if self.occlusion:
+            self.render_occlusion(bodies)
+        else:
+            for body in bodies:
+                self.render_body(body)
+
+        if self.command_buffers:
+            # the commands draw on the buffers, after the faces kept by the backend
+            self.pixels += self.backend.flush(self)
+
+        for commands in self.command_buffers:
+            commands.execute(self)
+
+        laps.lap("draw")
+
+        if self.frame_capture is not None:
+            self.frame_capture.end()
+
+        self.flush()
+
+        if self.packed or (self.tiled_framebuffer and not self.compressed_depth):
+            self.load_buffers()
+
+        if self.parity >= 0:
+            self.checker.reconstruct(self.buffer, self.depth, self.camera)
+
+        if self.post_effects and self.compressed_depth:
+            self.load_buffers()
+
+        laps.lap("resolve")
+
+        for effect in self.post_effects:
+            effect.apply(self)
+
+        laps.lap("post")
+
+        if not self.headless:
+            self.present()
+            laps.lap("present")
+
+        laps.finish("frame")
+
+        if self.pacer is not None:
+            self.pacer.presented()
+
+            if self.stats is not None:
+                self.stats.record("latency", self.pacer.latency)
+
+    def present(self) -> None:
+        """
+        Show ``buffer`` on the window with the frame rate and the number of triangles.
+        """
 
         self.screen.blit(pygame.surfarray.make_surface(self.buffer), (0, 0))
 
-        fps = self.clock.get_fps()
+        fps = self.clock.get_fps() if self.pacer is None else self.pacer.fps()
         fps_text = self.font.render(f"FPS: {fps:.2f}", True, WHITE)
         tri_text = self.font.render(f"Triangles: {self.triangles}", True, WHITE)
         self.screen.blit(fps_text, (10, 10))
         self.screen.blit(tri_text, (10, 30))
 
+        if self.pacer is not None:
+            latency = self.pacer.mean_latency() * 1000
+            latency_text = self.font.render(f"Latency: {latency:.1f} ms", True, WHITE)
+            self.screen.blit(latency_text, (10, 50))
+
         pygame.display.flip()
 
 
+    def visible_bodies(self) -> list[Body]:
+        """
+        Select the bodies to render using the potentially visible set or the
+        portals of the scene, if any.
+
+        :return: bodies that may be visible
+        :rtype: list[Body]
+        """
+
+        if self.scene.pvs is not None:
+            return self.scene.pvs.visible_bodies(self.camera.eye(),
+                                                 self.camera.frustum(),
+                                                 self.scene)
+
+        if self.scene.cells is not None:
+            return self.scene.cells.visible_bodies(self.camera.eye(),
+                                                   self.camera.frustum(),
+                                                   self.scene.bodies)
+
+        if self.scene.bodies is None:
+            return []
+
+        return list(self.scene.bodies.values())
+
+    def render_occlusion(self, bodies: list[Body]) -> None:
+        """
+        Render the bodies in two phases: first the ones visible in the previous
+        frame, then the remaining ones that are not occluded by them.
+
+        :param bodies: bodies to render
+        :type bodies: list[Body]
+        """
+
+        first = [body for body in bodies if body.name in self.last_visible]
+        second = []
+
+        for body in first:
+            self.render_body(body)
+
+        self.flush()
+        self.load_buffers()
+        self.hiz.build(self.depth)
+
+        for body in bodies:
+            if body.name not in self.last_visible and not self.occluded(body):
+                self.render_body(body)
+                second.append(body)
+
+        if second:
+            self.flush()
+            self.load_buffers()
+            self.hiz.build(self.depth)
+
+        self.last_visible = {body.name for body in first if not self.occluded(body)}
+        self.last_visible.update(body.name for body in second)
+
+    def occluded(self, body: Body) -> bool:
+        """
+        Check if the bounding sphere of a body is behind the depth pyramid ``hiz``.
+
+        :param body: body to test
+        :type body: Body
+        :return: True if the body can not be visible
+        :rtype: bool
+        """
+
+        center = self.to_view_space(body.center)
+        # x and z of the view space are scaled by the length of dir
+        radius = body.radius * abs(self.camera.dir)
+        near = center.z - radius
+        far = center.z + radius
+
+        if near <= self.camera.znear:
+            return False
+
+        xs = ((center.x - radius) / near, (center.x - radius) / far,
+              (center.x + radius) / near, (center.x + radius) / far)
+        ys = ((center.y - body.radius) / near, (center.y - body.radius) / far,
+              (center.y + body.radius) / near, (center.y + body.radius) / far)
+
+        return self.hiz.occluded(
+            (self.camera.af * min(xs) + 1) / 2 * self.camera.w - self.camera.cx - 1,
+            (- self.camera.f * max(ys) + 1) / 2 * self.camera.h - self.camera.cy - 1,
+            (self.camera.af * max(xs) + 1) / 2 * self.camera.w - self.camera.cx + 1,
+            (- self.camera.f * min(ys) + 1) / 2 * self.camera.h - self.camera.cy + 1,
+            self.camera.q * (near - self.camera.znear)
+        )
+
     def render_body(self, body: Body):
         """
-        Render a specific body.
+        Render a specific body, recording its cost in ``costs`` if set.
 
         :param body: body to render
         :type body: Body
         """
 
+        if self.costs is None:
+            self.draw_body(body)
+            return
+
+        start = time.perf_counter()
+        triangles = self.triangles
+        pixels = self.pixels
+        self.draw_body(body)
+        triangles = self.triangles - triangles
+
+        self.costs.record(body.name, len(self.computed), max(len(body.f) - triangles, 0),
+                          triangles, self.pixels - pixels, time.perf_counter() - start)
+
+    def draw_body(self, body: Body):
+        """
+        Draw the faces of a body facing the camera, or its impostor.
+
+        :param body: body to draw
+        :type body: Body
+        """
+
+        self.computed = defaultdict(self._default_value)
+
+        if (self.impostor_size and
+            self.gbuffer is None and
+            len(body.f) >= self.impostor_faces and
+            self.render_impostor(body)):
+            return
+
+        colors = body.shade_faces(self.scene.light)
+
+        if self.packed:
+            colors = self.compact.shade(body, colors)
+
+        if self.gbuffer is not None:
+            self.gbuffer.begin_body(self, body)
+
         for i, normal in enumerate(body.n):
             face = body.f[i]
             cam_to_vertex = body.v[face[0]] - self.camera.pos
 
             if cam_to_vertex * normal > 0:
+                self.render_face(body, face, colors[i], normal)
+
+    def drop_impostors(self) -> None:
+        """
+        Forget the impostors of the bodies no longer in the scene.
+        """
+
+        bodies = self.scene.bodies or {}
+
+        for name in [name for name, impostor in self.impostors.items()
+                     if bodies.get(name) is not impostor.body]:
+            del self.impostors[name]
+
+    def render_impostor(self, body: Body) -> bool:
+        """
+        Draw the impostor of a body if it is far enough to be smaller
+        than ``impostor_size`` pixels on screen.
+
+        :param body: body to render
+        :type body: Body
+        :return: True if the impostor has been drawn
+        :rtype: bool
+        """
+
+        center = self.to_view_space(body.center)
+
+        if center.z <= self.camera.znear + body.radius:
+            return False
 
-                if body.single_color:
-                    color = body.color
-                else:
-                    color = body.color[i]
+        # the silhouette of the bounding sphere, wider than its radius at the center
+        size = self.camera.f * body.radius / math.sqrt(
+            center.z * center.z - body.radius * body.radius) * self.camera.h
+
+        if size > self.impostor_size:
+            return False
+
+        impostor = self.impostors.get(body.name)
+
+        if impostor is None or impostor.body is not body:
+            impostor = Impostor(body, self.impostor_size)
+            self.impostors[body.name] = impostor
+
+        impostor.update(self.camera, self.scene.light,
+                        self.impostor_angle, self.impostor_distance)
+
+        sprite = impostor.renderer
+        x, y, z = self.project_point(center)
+        rect = (int(x - size / 2), int(y - size / 2),
+                int(x + size / 2) + 1, int(y + size / 2) + 1)
+        self.load_buffers(rect)
+
+        draw_sprite(
+            self.buffer_ptr, *self.buffer.strides,
+            self.depth_ptr, *self.depth.strides,
+            sprite.buffer_ptr, *sprite.buffer.strides,
+            sprite.depth_ptr, *sprite.depth.strides,
+            sprite.camera.w, sprite.camera.h, sprite.camera.zfar,
+            x - size / 2, y - size / 2, size, z - impostor.depth,
+            self.camera.w, self.camera.h
+        )
 
-                self.render_face(body, face, normal, color)
+        self.store_buffers(rect)
+
+        self.triangles += 2
+
+        return True
 
     def to_view_space(self, point: Vec3) -> Vec3:
         """
@@ -259,16 +775,16 @@ class Renderer:
             x = x / point.z
             y = y / point.z
 
-        x = (x + 1) / 2 * self.camera.w
-        y = (- y + 1) / 2 * self.camera.h
+        x = (x + 1) / 2 * self.camera.w - self.camera.cx
+        y = (- y + 1) / 2 * self.camera.h - self.camera.cy
 
         return (x, y, z)
 
     def render_face(self,
         body: Body,
         face: tuple[int, int, int],
-        normal: Vec3,
-        color: Color) -> None:
+        color: Color | int,
+        normal: Vec3 = None) -> None:
         """
         Render a specific face.
 
@@ -276,10 +792,10 @@ class Renderer:
         :type body: Body
         :param face: face to render
         :type face: tuple[int, int, int]
-        :param normal: normal of the face
-        :type normal: Vec3
-        :param color: RGB color of the face
-        :type color: Color
+        :param color: shaded RGB color of the face, packed if ``packed``
+        :type color: Color | int
+        :param normal: normal of the face in ``body.n``, needed with ``gbuffer``
+        :type normal: Vec3, optional
         """
 
         if (point1 := self.computed[face[0]]) is None:
@@ -331,17 +847,22 @@ class Renderer:
             p3z > self.camera.zfar):
             return
 
-        light_intensity = (normal * self.scene.light) / 2 + 0.5
-
-        draw_triangle(
-            self.buffer_ptr, *self.buffer.strides,
-            self.depth_ptr, *self.depth.strides,
-            p1x, p1y, p1z,
-            p2x, p2y, p2z,
-            p3x, p3y, p3z,
-            *darken_color(color, light_intensity),
-            self.camera.w, self.camera.h
-        )
+        if self.frame_capture is not None:
+            self.frame_capture.add(point1, point2, point3, color)
+
+        if self.span_buffer:
+            self.spans.insert(point1, point2, point3, color)
+        elif self.compressed_depth:
+            self.depth_tiles.draw(self.buffer, point1, point2, point3, color)
+        elif self.tiled_framebuffer:
+            self.framebuffer.draw(point1, point2, point3, color)
+        elif self.packed:
+            self.compact.draw(self.depth, point1, point2, point3, color)
+        elif self.gbuffer is not None:
+            # body.n points inward
+            self.gbuffer.draw(self, body, face, (point1, point2, point3), - normal, color)
+        else:
+            self.pixels += self.backend.draw(self, point1, point2, point3, color)
 
         self.triangles += 1
 
@@ -359,3 +880,76 @@ class Renderer:
         self.depth.flags.writeable = True
         self.buffer_ptr = self.buffer.__array_interface__['data'][0]
         self.depth_ptr = self.depth.__array_interface__['data'][0]
+
+
+class Impostor:
+    """
+    Sprite of a distant body rendered offscreen by a headless :class:`Renderer`
+    and drawn as a depth tested billboard. The sprite is rendered again only when
+    the direction of view in the reference system of the body changes more than
+    ``angle`` or the distance changes more than the fraction ``distance``.
+
+    :param body: body represented by the impostor
+    :type body: Body
+    :param size: side of the sprite in pixels
+    :type size: int
+    """
+
+    __slots__ = ["body", "renderer", "view", "up", "distance", "light", "depth"]
+
+    def __init__(self, body: Body, size: int) -> None:
+        self.body = body
+        self.renderer = Renderer(pygame.Surface((size, size)), Camera(),
+                                 Scene(), None, headless=True)
+        self.view = None
+        self.up = None
+        self.distance = 0
+        self.light = None
+        self.depth = 0
+
+    def update(self, camera: Camera, light: Vec3, angle: float, distance: float) -> None:
+        """
+        Render again the sprite if the point of view changed too much.
+
+        :param camera: camera of the main renderer
+        :type camera: Camera
+        :param light: direction of the light of the scene
+        :type light: Vec3
+        :param angle: maximum change of direction of view in rad
+        :type angle: float
+        :param distance: maximum relative change of distance
+        :type distance: float
+        """
+
+        offset = self.body.center - camera.pos
+        dist = abs(offset)
+        inverse = self.body.rot.inverse()
+        view = rotate(offset / dist, inverse)
+        up = rotate(camera.up, inverse)
+        light_key = (light.x, light.y, light.z)
+        cos = math.cos(angle)
+
+        if (self.view is not None and
+            view * self.view >= cos and
+            up * self.up >= cos and
+            abs(dist - self.distance) <= distance * self.distance and
+            light_key == self.light):
+            return
+
+        self.view = view
+        self.up = up
+        self.distance = dist
+        self.light = light_key
+
+        sprite_camera = self.renderer.camera
+        sprite_camera.pos = camera.pos
+        sprite_camera.dir = offset / dist
+        sprite_camera.zfar = camera.zfar
+        sprite_camera.znear = camera.znear
+        # the view space starts one unit ahead of the position of the camera
+        center_z = dist - 1
+        sprite_camera.theta = 2 * math.asin(min(self.body.radius / center_z, 1))
+        self.renderer.scene.light = light
+        self.renderer.clear()
+        self.renderer.render_body(self.body)
+        self.depth = sprite_camera.q * (center_z - sprite_camera.znear)
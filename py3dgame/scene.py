@@ -3,7 +3,11 @@ Implementations of the scene and objects that can contain.
 """
 
 import math
+import os
 from typing import Union
+import numpy as np
+from ext_rendering import set_transforms
+from .bake import ambient_occlusion
 from .color import WHITE, BLACK, Color, RED, BLUE, GREEN
 from .math3d import Vec3, Quat, rotate
 
@@ -25,9 +29,13 @@ class Body:
     :param color: color of the body, can be a single color or a tuple
         with one color for each face, defaults to color.WHITE
     :type color: Color, tuple[Color], optional
+
+    The vertices in world coordinates are always contained in the sphere
+    of radius ``radius`` around ``center``.
     """
 
-    __slots__ = ["name", "vertices", "f", "pos", "rot", "color", "n", "v", "single_color"]
+    __slots__ = ["name", "vertices", "f", "pos", "rot", "color", "n", "v", "single_color",
+                 "handle", "shade", "shade_key", "ao", "center", "radius"]
 
     def __init__(
         self,
@@ -45,6 +53,12 @@ class Body:
         self.rot = rot
         self.color = color
         self.single_color = True
+        self.handle = -1
+        self.shade = None
+        self.shade_key = None
+        self.ao = None
+        self.center = pos
+        self.radius = max((abs(vertex) for vertex in vertices), default=0)
         self.n = []
         self.v = []
         self.move()
@@ -60,6 +74,44 @@ class Body:
         self.n = [((self.v[face[2]] - self.v[face[0]]) @
                     (self.v[face[1]] - self.v[face[0]])).normalize() for face in self.f]
 
+    def shade_faces(self, light: Vec3) -> list[list[int]]:
+        """
+        Get the color of each face lit by ``light``. The colors are cached in
+        ``shade`` as an F x 3 uint8 array and recomputed only when the body
+        rotates, its color is changed, also in place, or the light changes.
+
+        :param light: direction of the light
+        :type light: Vec3
+        :return: shaded RGB color of each face
+        :rtype: list[list[int]]
+        """
+
+        key = self.shade_key
+        # a copy of the colors, so that an edit of a single face is seen too
+        color = list(self.color)
+
+        if (key is not None and key[0] is self.rot and
+            key[1] == light.x and key[2] == light.y and key[3] == light.z and
+            key[5] == color):
+            return key[4]
+
+        normals = np.array([(normal.x, normal.y, normal.z) for normal in self.n],
+                           dtype=np.float64).reshape(-1, 3)
+        intensity = normals @ np.array((light.x, light.y, light.z)) / 2 + 0.5
+
+        if self.ao is not None:
+            intensity = intensity * self.ao[np.array(self.f, dtype=np.int64)].mean(axis=1)
+        colors = np.array(self.color, dtype=np.float64)
+
+        if colors.ndim == 1:
+            colors = np.broadcast_to(colors, normals.shape)
+
+        self.shade = np.clip(colors * intensity[:, None], 0, 255).astype(np.uint8)
+        colors = self.shade.tolist()
+        self.shade_key = (self.rot, light.x, light.y, light.z, colors, color)
+
+        return colors
+
 
     def move(self, pos: Vec3 = None, rot: Quat = None, first_rotate: bool = True) -> None:
         """
@@ -81,8 +133,10 @@ class Body:
 
         if first_rotate:
             self.v = [rotate(vertex, self.rot) + self.pos for vertex in self.vertices]
+            self.center = self.pos
         else:
             self.v = [rotate(vertex + self.pos, self.rot) for vertex in self.vertices]
+            self.center = rotate(self.pos, self.rot)
 
         self.compute_normals()
 
@@ -136,34 +190,30 @@ class Body:
 
         if first_rotate:
             self.v = [rotate(vertex, rot) + pos for vertex in self.v]
+            self.center = rotate(self.center, rot) + pos
         else:
             self.v = [rotate(vertex + pos, rot) for vertex in self.v]
+            self.center = rotate(self.center + pos, rot)
 
+        self.shade_key = None
         self.compute_normals()
 
-    @classmethod
-    def from_obj(
-        cls,
-        obj_file: str,
-        name: str = None,
-        pos: Vec3 = Vec3(0, 0, 0),
-        rot: Quat = Quat(0, Vec3(0, 0, 1))) -> 'Body':
+    @staticmethod
+    def read_obj(obj_file: str) -> tuple[list[Vec3], list[tuple[int, int, int]]]:
         """
-        Generate a :class:`Body` from a .obj file.
+        Read vertices and triangulated faces from a .obj file,
+        degenerate faces are discarded.
 
         :param obj_file: path to the .obj file
         :type obj_file: str
-        :return: instance of the class
-        :rtype: Body
+        :return: vertices and faces
+        :rtype: tuple[list[Vec3], list[tuple[int, int, int]]]
         """
 
-        if name is None:
-            name = obj_file
-
         vertices = []
         faces = []
 
-        with open(obj_file, "r") as file:
+        with open(obj_file, "r", encoding="utf-8") as file:
             for line in file:
                 words = line.split(" ")
 
@@ -202,7 +252,68 @@ class Body:
         for face in degenerate_faces:
             faces.remove(face)
 
-        return cls(name, vertices, faces, pos, rot, WHITE)
+        return vertices, faces
+
+    @classmethod
+    def from_obj(
+        cls,
+        obj_file: str,
+        name: str = None,
+        pos: Vec3 = Vec3(0, 0, 0),
+        rot: Quat = Quat(0, Vec3(0, 0, 1)),
+        ao_samples: int = 0,
+        cache: bool = False) -> 'Body':
+        """
+        Generate a :class:`Body` from a .obj file.
+        With ``ao_samples > 0`` the ambient occlusion of each vertex is baked
+        at import and used to darken the faces.
+        With ``cache`` the parsed mesh and its ambient occlusion are stored in a
+        binary ``<obj_file>.npz`` file that is reused while the .obj is unchanged.
+
+        :param obj_file: path to the .obj file
+        :type obj_file: str
+        :param ao_samples: rays per vertex for the ambient occlusion bake,
+            defaults to 0 (no ambient occlusion)
+        :type ao_samples: int, optional
+        :param cache: read and write the binary mesh cache, defaults to False
+        :type cache: bool, optional
+        :return: instance of the class
+        :rtype: Body
+        """
+
+        if name is None:
+            name = obj_file
+
+        cache_file = obj_file + ".npz"
+        mtime = os.path.getmtime(obj_file)
+        mesh = None
+
+        if cache and os.path.exists(cache_file):
+            with np.load(cache_file) as data:
+                if (float(data["mtime"]) == mtime and
+                    int(data["ao_samples"]) == ao_samples):
+                    mesh = (data["vertices"], data["faces"], data["ao"])
+
+        if mesh is None:
+            vertices, faces = cls.read_obj(obj_file)
+            vertices = np.array([(v.x, v.y, v.z) for v in vertices],
+                                dtype=np.float64).reshape(-1, 3)
+            faces = np.array(faces, dtype=np.int32).reshape(-1, 3)
+            ao = ambient_occlusion(vertices, faces, ao_samples)
+            mesh = (vertices, faces, ao)
+
+            if cache:
+                np.savez(cache_file, vertices=vertices, faces=faces, ao=ao,
+                         mtime=mtime, ao_samples=ao_samples)
+
+        vertices, faces, ao = mesh
+        body = cls(name, [Vec3(*vertex) for vertex in vertices.tolist()],
+                   [tuple(face) for face in faces.tolist()], pos, rot, WHITE)
+
+        if ao_samples > 0:
+            body.ao = ao
+
+        return body
 
     @classmethod
     def logo(
@@ -568,16 +679,30 @@ class Body:
         return cls(name, tuple(vertices), tuple(faces), pos, rot, color)
 
 
+DIRTY_POS = 1
+DIRTY_ROT = 2
+
+
 class Scene:
     """
     Class that contains the entities that will be rendered.
 
+    Each body added to the scene receives an integer handle that indexes the
+    ``positions`` (N x 3) and ``rotations`` (N x 4, as ``angle, axis_x, axis_y, axis_z``)
+    arrays of the scene, so that many bodies can be moved with a single call to
+    :meth:`set_transforms`.
+
     :param bgc: background color, defaults to BLACK
     :type bgc: Color, optional
-    :param bodies: dictionary of bodies that the scene has, defaults to None
+    :param bodies: dictionary of bodies that the scene has, kept by reference and
+        updated by :meth:`add_body` and :meth:`remove_body`, defaults to None
     :type bodies: dict[str, Body], optional
     :param light: direction of the light
     :type light: Vec3
+
+    When ``pvs`` is a :class:`py3dgame.visibility.PVS` only the bodies in the set of the
+    cell of the camera are rendered, otherwise when ``cells`` is a
+    :class:`py3dgame.visibility.CellGraph` only the bodies visible through its portals.
     """
 
     def __init__(self,
@@ -588,20 +713,176 @@ class Scene:
         self.bgc = bgc
         self.bodies = bodies
         self.light = light
-
-    def add_body(self, body: Body) -> None:
+        self.cells = None
+        self.pvs = None
+        self.handles = []
+        self.free_handles = []
+        self.positions = np.zeros((0, 3), dtype=np.float64)
+        self.rotations = np.zeros((0, 4), dtype=np.float64)
+        self.dirty = np.zeros(0, dtype=np.uint8)
+        # 1 for the handles of the bodies in the scene, 0 for the free ones
+        self.live = np.zeros(0, dtype=np.uint8)
+        # counts the bodies added and removed, to refresh what depends on the handles
+        self.changes = 0
+
+        if bodies is not None:
+            for body in bodies.values():
+                self._add_handle(body)
+
+    def _reserve(self, size: int) -> None:
+        capacity = len(self.dirty)
+
+        if size <= capacity:
+            return
+
+        capacity = max(size, 2 * capacity, 16)
+        positions = np.zeros((capacity, 3), dtype=np.float64)
+        rotations = np.zeros((capacity, 4), dtype=np.float64)
+        dirty = np.zeros(capacity, dtype=np.uint8)
+        live = np.zeros(capacity, dtype=np.uint8)
+        positions[:len(self.positions)] = self.positions
+        rotations[:len(self.rotations)] = self.rotations
+        dirty[:len(self.dirty)] = self.dirty
+        live[:len(self.live)] = self.live
+        self.positions = positions
+        self.rotations = rotations
+        self.dirty = dirty
+        self.live = live
+
+    def add_body(self, body: Body) -> int:
         """
         Add a body to the scene.
 
         :param body: body
         :type body: Body
+        :return: handle of the body inside the scene
+        :rtype: int
         """
 
         if self.bodies is None:
             self.bodies = {body.name: body}
         else:
+            if body.name in self.bodies:
+                self.remove_body(body.name)
             self.bodies[body.name] = body
 
+        return self._add_handle(body)
+
+    def _add_handle(self, body: Body) -> int:
+        if self.free_handles:
+            handle = self.free_handles.pop()
+            self.handles[handle] = body
+        else:
+            handle = len(self.handles)
+            self._reserve(handle + 1)
+            self.handles.append(body)
+
+        body.handle = handle
+        self.changes += 1
+        self.positions[handle] = (body.pos.x, body.pos.y, body.pos.z)
+        self.rotations[handle] = (body.rot.angle, body.rot.axis.x,
+                                  body.rot.axis.y, body.rot.axis.z)
+        self.dirty[handle] = 0
+        self.live[handle] = 1
+
+        return handle
+
+    def add_bodies(
+        self,
+        bodies: list[Body],
+        positions: np.ndarray = None,
+        rotations: np.ndarray = None) -> np.ndarray:
+        """
+        Add many bodies to the scene at once and optionally set their transforms.
+        The vertices of the bodies are updated lazily at the next :meth:`update`.
+
+        :param bodies: bodies to add
+        :type bodies: list[Body]
+        :param positions: N x 3 array of positions, defaults to None
+        :type positions: np.ndarray, optional
+        :param rotations: N x 4 array of rotations as ``angle, axis_x, axis_y, axis_z``,
+            defaults to None
+        :type rotations: np.ndarray, optional
+        :return: handles of the added bodies
+        :rtype: np.ndarray
+        """
+
+        handles = np.array([self.add_body(body) for body in bodies], dtype=np.int64)
+        self.set_transforms(handles, positions, rotations)
+
+        return handles
+
+    def set_transforms(
+        self,
+        handles: np.ndarray,
+        positions: np.ndarray = None,
+        rotations: np.ndarray = None) -> None:
+        """
+        Set position and rotation of many bodies with a single native call.
+        The bodies are only marked as dirty, their vertices are updated lazily
+        at the next :meth:`update`.
+
+        :param handles: handles of the bodies to move
+        :type handles: np.ndarray
+        :param positions: N x 3 array of positions, defaults to None
+        :type positions: np.ndarray, optional
+        :param rotations: N x 4 array of rotations as ``angle, axis_x, axis_y, axis_z``,
+            defaults to None
+        :type rotations: np.ndarray, optional
+        :raises IndexError: if a handle does not belong to a body of the scene
+        :raises ValueError: if the arrays have wrong shapes
+        """
+
+        handles = np.ascontiguousarray(handles, dtype=np.int64).reshape(-1)
+        size = len(handles)
+
+        if size == 0:
+            return
+
+        if handles.min() < 0 or handles.max() >= len(self.handles):
+            raise IndexError("Handle out of the range of the scene bodies")
+
+        if not self.live[handles].all():
+            raise IndexError("Handle of a body removed from the scene")
+
+        if positions is not None:
+            positions = np.ascontiguousarray(positions, dtype=np.float64)
+            if positions.shape != (size, 3):
+                raise ValueError(f"Positions must have shape ({size}, 3)")
+
+        if rotations is not None:
+            rotations = np.ascontiguousarray(rotations, dtype=np.float64)
+            if rotations.shape != (size, 4):
+                raise ValueError(f"Rotations must have shape ({size}, 4)")
+
+        set_transforms(
+            handles.ctypes.data, size,
+            0 if positions is None else positions.ctypes.data,
+            0 if rotations is None else rotations.ctypes.data,
+            self.positions.ctypes.data, self.rotations.ctypes.data,
+            self.dirty.ctypes.data
+        )
+
+    def update(self) -> None:
+        """
+        Recompute the vertices of the bodies marked dirty by :meth:`set_transforms`.
+        """
+
+        for handle in np.flatnonzero(self.dirty).tolist():
+            body = self.handles[handle]
+            flags = self.dirty[handle]
+
+            if flags & DIRTY_POS:
+                body.pos = Vec3(*self.positions[handle].tolist())
+
+            if flags & DIRTY_ROT:
+                angle, x, y, z = self.rotations[handle].tolist()
+                body.rot = Quat(angle, Vec3(x, y, z))
+
+            body.move()
+
+        self.dirty.fill(0)
+
     def remove_body(self, name: str) -> None:
         """
         Remove a body from the scene.
@@ -610,4 +891,12 @@ class Scene:
         :type name: str
         """
 
-        self.bodies.pop(name)
+        body = self.bodies.pop(name)
+
+        if body.handle >= 0:
+            self.handles[body.handle] = None
+            self.dirty[body.handle] = 0
+            self.live[body.handle] = 0
+            self.free_handles.append(body.handle)
+            self.changes += 1
+            body.handle = -1
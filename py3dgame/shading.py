@@ -0,0 +1,90 @@
+"""
+Native shaders called by the command buffers, as C function pointers.
+"""
+
+import ctypes
+
+
+class FaceShading(ctypes.Structure):
+    """
+    Layout of the ``FaceShading`` struct of ext_rendering given to the face shaders:
+
+    - ``normal``: outward unit normal of the face in world coordinates
+    - ``center``: centroid of the face in world coordinates
+    - ``light``: direction of the light
+    - ``intensity``: default lighting, baked occlusion included
+    - ``face``, ``mesh``, ``instance``: indices of the face, of the mesh in the
+      command buffer and of the instance in its batch
+    - ``base``: color of the mesh for the face
+    """
+
+    _fields_ = [("normal", ctypes.c_double * 3),
+                ("center", ctypes.c_double * 3),
+                ("light", ctypes.c_double * 3),
+                ("intensity", ctypes.c_double),
+                ("face", ctypes.c_int32),
+                ("mesh", ctypes.c_int32),
+                ("instance", ctypes.c_int32),
+                ("base", ctypes.c_uint8 * 3),
+                ("pad", ctypes.c_uint8)]
+
+
+class SpanShading(ctypes.Structure):
+    """
+    Layout of the ``SpanShading`` struct of ext_rendering given to the span
+    shaders, for a run of covered pixels of a row:
+
+    - ``positions``: world coordinates of the three vertices
+    - ``weights``: barycentric weights of the vertices at the first pixel,
+      linear in screen space
+    - ``steps``: increment of the weights from a pixel to the next one
+    - ``depths``: view depth of the vertices, to correct the perspective
+    - ``x``, ``y``, ``count``: first pixel and number of pixels
+    - ``face``, ``mesh``, ``instance``: as in :class:`FaceShading`
+    - ``color``: color of the face, after the face shader
+    """
+
+    _fields_ = [("positions", ctypes.c_double * 9),
+                ("weights", ctypes.c_float * 3),
+                ("steps", ctypes.c_float * 3),
+                ("depths", ctypes.c_float * 3),
+                ("x", ctypes.c_int32),
+                ("y", ctypes.c_int32),
+                ("count", ctypes.c_int32),
+                ("face", ctypes.c_int32),
+                ("mesh", ctypes.c_int32),
+                ("instance", ctypes.c_int32),
+                ("color", ctypes.c_uint8 * 3),
+                ("pad", ctypes.c_uint8)]
+
+
+# void face_shader(const FaceShading* face, uint8_t* color, void* user)
+FACE_SHADER = ctypes.CFUNCTYPE(None, ctypes.POINTER(FaceShading),
+                               ctypes.POINTER(ctypes.c_uint8), ctypes.c_void_p)
+# void span_shader(const SpanShading* span, uint8_t* colors, void* user)
+SPAN_SHADER = ctypes.CFUNCTYPE(None, ctypes.POINTER(SpanShading),
+                               ctypes.POINTER(ctypes.c_uint8), ctypes.c_void_p)
+
+
+def shader_address(shader) -> int:
+    """
+    Address of a native function: an int, a ctypes function pointer, or an
+    object with an ``address`` like a Numba ``cfunc``. A cffi function gives
+    its address with ``int(ffi.cast("uintptr_t", function))``.
+
+    :param shader: the function or its address, None for no function
+    :type shader: int | ctypes._CFuncPtr | object
+    :return: address of the function, 0 for None
+    :rtype: int
+    """
+
+    if shader is None:
+        return 0
+
+    if isinstance(shader, int):
+        return shader
+
+    if hasattr(shader, "address"):
+        return shader.address
+
+    return ctypes.cast(shader, ctypes.c_void_p).value
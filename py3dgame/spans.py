@@ -0,0 +1,90 @@
+"""
+Hidden surface removal with a span buffer instead of a per pixel depth test.
+"""
+
+import numpy as np
+from ext_rendering import span_triangle, resolve_spans
+
+# x0, x1, depth plane a + b * x and packed RGB of a span, 20 bytes
+SPAN_WORDS = 5
+
+
+class SpanBuffer:
+    """
+    For each row of the screen a sorted list of disjoint spans, each one with the
+    color and the depth plane of the triangle it comes from. Inserting a triangle
+    only compares its spans with the overlapping ones, so the cost depends on the
+    number of spans and not on the pixels covered. At the end of the frame
+    :meth:`resolve` writes every covered pixel once.
+
+    A row can never hold more spans than pixels, so each row reserves ``w`` spans;
+    the memory is not touched until a row actually grows.
+    """
+
+    __slots__ = ["spans", "counts", "scratch", "w", "h"]
+
+    def __init__(self) -> None:
+        self.w = 0
+        self.h = 0
+        self.spans = np.empty(0, dtype=np.int32)
+        self.counts = np.zeros(0, dtype=np.int32)
+        self.scratch = np.empty(0, dtype=np.int32)
+
+    def clear(self, w: int, h: int) -> None:
+        """
+        Empty all the rows, resizing the buffer if the screen changed.
+
+        :param w: width of the screen
+        :type w: int
+        :param h: height of the screen
+        :type h: int
+        """
+
+        if (w, h) != (self.w, self.h):
+            self.w = w
+            self.h = h
+            self.spans = np.empty((h, w, SPAN_WORDS), dtype=np.int32)
+            self.counts = np.zeros(h, dtype=np.int32)
+            self.scratch = np.empty((w, SPAN_WORDS), dtype=np.int32)
+        else:
+            self.counts.fill(0)
+
+    def insert(self,
+        point1: tuple[float, float, float],
+        point2: tuple[float, float, float],
+        point3: tuple[float, float, float],
+        color: tuple[int, int, int]) -> None:
+        """
+        Insert a triangle in screen space, keeping only its parts that are nearer
+        than the spans already in the buffer.
+
+        :param point1: first vertex as x, y and depth
+        :type point1: tuple[float, float, float]
+        :param point2: second vertex as x, y and depth
+        :type point2: tuple[float, float, float]
+        :param point3: third vertex as x, y and depth
+        :type point3: tuple[float, float, float]
+        :param color: RGB color of the triangle
+        :type color: tuple[int, int, int]
+        """
+
+        span_triangle(self.spans.ctypes.data, self.counts.ctypes.data,
+                      self.scratch.ctypes.data,
+                      *point1, *point2, *point3, *color, self.w, self.h)
+
+    def resolve(self, buffer: np.ndarray, depth: np.ndarray) -> None:
+        """
+        Write the spans on a color buffer and a depth buffer indexed as ``[x, y]``
+        and empty the rows. Pixels already nearer in ``depth`` are kept, so the
+        spans can be resolved more times in a frame and mixed with other drawing.
+
+        :param buffer: w x h x 3 color buffer
+        :type buffer: np.ndarray
+        :param depth: w x h depth buffer
+        :type depth: np.ndarray
+        """
+
+        resolve_spans(self.spans.ctypes.data, self.counts.ctypes.data,
+                      buffer.ctypes.data, *buffer.strides,
+                      depth.ctypes.data, *depth.strides,
+                      self.w, self.h)
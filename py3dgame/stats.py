@@ -0,0 +1,515 @@
+"""
+Statistics of the rendering: frame times in histograms of fixed size and cost of the bodies.
+"""
+
+import copy
+import math
+import time
+import numpy as np
+from .counters import ALLOCATIONS
+
+
+def add_counts(table: dict[str, list], name: str, deltas: list[int | None]) -> None:
+    """
+    Add the increments of some counters during a run of a measure to the runs,
+    the sums and the maxima of a table. A counter stays None once it has been missing.
+
+    :param table: runs, sums and maxima by name of the measure
+    :type table: dict[str, list]
+    :param name: name of the measure
+    :type name: str
+    :param deltas: increments of the counters, None if unavailable
+    :type deltas: list[int | None]
+    """
+
+    entry = table.get(name)
+
+    if entry is None:
+        entry = [0, [0] * len(deltas), [0] * len(deltas)]
+        table[name] = entry
+
+    runs, sums, maxima = entry
+    entry[0] = runs + 1
+
+    for i, delta in enumerate(deltas):
+        if delta is None or sums[i] is None:
+            sums[i] = maxima[i] = None
+        else:
+            sums[i] += delta
+            maxima[i] = delta if runs == 0 else max(maxima[i], delta)
+
+
+class Histogram:
+    """
+    Histogram of durations with buckets of bounded relative width, like an
+    HdrHistogram. Values are counted in ``unit`` seconds; each power of two has
+    the same number of buckets, enough to keep ``digits`` significant digits,
+    so the memory is fixed and recording a value only computes its bucket from
+    the bit length. Values above ``highest`` are counted in the last bucket,
+    ``max`` keeps the exact largest value.
+
+    :param highest: largest value tracked precisely in seconds, defaults to 60
+    :type highest: float, optional
+    :param digits: significant decimal digits, defaults to 2
+    :type digits: int, optional
+    :param unit: resolution in seconds, defaults to 1e-6
+    :type unit: float, optional
+    """
+
+    __slots__ = ["unit", "sub_bits", "highest", "counts", "count", "total", "min", "max"]
+
+    def __init__(self, highest: float = 60, digits: int = 2, unit: float = 1e-6) -> None:
+        self.unit = unit
+        self.sub_bits = math.ceil(math.log2(2 * 10 ** digits))
+        self.highest = int(highest / unit)
+        buckets = max(self.highest.bit_length() - self.sub_bits, 0) + 1
+        self.counts = np.zeros((buckets + 1) << (self.sub_bits - 1), dtype=np.int64)
+        self.count = 0
+        self.total = 0.0
+        self.min = math.inf
+        self.max = 0.0
+
+    def index(self, value: int) -> int:
+        """
+        Bucket of a value in units.
+
+        :param value: non negative value in units
+        :type value: int
+        :return: index in ``counts``
+        :rtype: int
+        """
+
+        bucket = max(value.bit_length() - self.sub_bits, 0)
+
+        return (bucket << (self.sub_bits - 1)) + (value >> bucket)
+
+    def upper(self, index: int) -> float:
+        """
+        Largest value counted in a bucket.
+
+        :param index: index in ``counts``
+        :type index: int
+        :return: value in seconds
+        :rtype: float
+        """
+
+        bucket = max((index >> (self.sub_bits - 1)) - 1, 0)
+        sub = index - (bucket << (self.sub_bits - 1))
+
+        return (((sub + 1) << bucket) - 1) * self.unit
+
+    def record(self, seconds: float) -> None:
+        """
+        Count a duration.
+
+        :param seconds: duration in seconds
+        :type seconds: float
+        """
+
+        value = min(max(int(seconds / self.unit), 0), self.highest)
+        self.counts[self.index(value)] += 1
+        self.count += 1
+        self.total += seconds
+        self.min = min(self.min, seconds)
+        self.max = max(self.max, seconds)
+
+    def percentile(self, percent: float) -> float:
+        """
+        Value below which fall ``percent`` percent of the recorded values, rounded
+        up to the bucket and never above the largest value.
+
+        :param percent: percentile between 0 and 100
+        :type percent: float
+        :return: value in seconds, 0 if nothing has been recorded
+        :rtype: float
+        """
+
+        if self.count == 0:
+            return 0
+
+        rank = max(math.ceil(percent / 100 * self.count), 1)
+        index = int(np.searchsorted(np.cumsum(self.counts), rank))
+
+        return min(self.upper(index), self.max)
+
+    def summary(self) -> dict[str, float]:
+        """
+        Main figures of the histogram.
+
+        :return: count, mean, min, p50, p95, p99 and max, durations in seconds
+        :rtype: dict[str, float]
+        """
+
+        return {
+            "count": self.count,
+            "mean": self.total / self.count if self.count else 0,
+            "min": self.min if self.count else 0,
+            "p50": self.percentile(50),
+            "p95": self.percentile(95),
+            "p99": self.percentile(99),
+            "max": self.max
+        }
+
+    def dump(self) -> list[tuple[float, int]]:
+        """
+        Non empty buckets.
+
+        :return: largest value of each bucket in seconds and its count
+        :rtype: list[tuple[float, int]]
+        """
+
+        return [(self.upper(index), int(self.counts[index]))
+                for index in np.flatnonzero(self.counts).tolist()]
+
+    def reset(self) -> None:
+        """
+        Forget all the values.
+        """
+
+        self.counts.fill(0)
+        self.count = 0
+        self.total = 0.0
+        self.min = math.inf
+        self.max = 0.0
+
+
+class Stats:
+    """
+    Histograms of durations by name, created at the first record. With
+    :attr:`py3dgame.rendering.Renderer.stats` the renderer records the stages of
+    each frame (``"clear"``, ``"draw"``, ``"resolve"``, ``"post"``,
+    ``"present"``), the whole ``"frame"`` and, with a pacer, the ``"latency"``.
+    With :class:`py3dgame.counters.PerfCounters` the same stages also sum the
+    hardware counters, see :meth:`counter_summary`, and with
+    :class:`py3dgame.counters.AllocationCounters` the allocations, see
+    :meth:`allocation_summary`.
+
+    :param highest: largest value tracked precisely in seconds, defaults to 60
+    :type highest: float, optional
+    :param digits: significant decimal digits, defaults to 2
+    :type digits: int, optional
+    """
+
+    __slots__ = ["histograms", "highest", "digits", "counters", "allocations"]
+
+    def __init__(self, highest: float = 60, digits: int = 2) -> None:
+        self.highest = highest
+        self.digits = digits
+        self.histograms = {}
+        self.counters = {}
+        self.allocations = {}
+
+    def histogram(self, name: str) -> Histogram:
+        """
+        Histogram of a name, created empty if missing.
+
+        :param name: name of the measure
+        :type name: str
+        :return: histogram of the measure
+        :rtype: Histogram
+        """
+
+        histogram = self.histograms.get(name)
+
+        if histogram is None:
+            histogram = Histogram(self.highest, self.digits)
+            self.histograms[name] = histogram
+
+        return histogram
+
+    def record(self, name: str, seconds: float) -> None:
+        """
+        Count a duration of a measure.
+
+        :param name: name of the measure
+        :type name: str
+        :param seconds: duration in seconds
+        :type seconds: float
+        """
+
+        self.histogram(name).record(seconds)
+
+    def record_counters(self, name: str, deltas: list[int | None]) -> None:
+        """
+        Add the hardware counters of a run of a measure. A counter stays None
+        once it has been missing.
+
+        :param name: name of the measure
+        :type name: str
+        :param deltas: increments of the counters in ``COUNTERS``, None if unavailable
+        :type deltas: list[int | None]
+        """
+
+        add_counts(self.counters, name, deltas)
+
+    def record_allocations(self, name: str, deltas: list[int | None]) -> None:
+        """
+        Add the allocations of a run of a measure.
+
+        :param name: name of the measure
+        :type name: str
+        :param deltas: increments of the fields in ``ALLOCATIONS``, None if unavailable
+        :type deltas: list[int | None]
+        """
+
+        add_counts(self.allocations, name, deltas)
+
+    def counter_summary(self) -> dict[str, dict[str, float | None]]:
+        """
+        Hardware counters of every measure: cycles and instructions per run,
+        instructions per cycle, last level cache and branch misses per thousand
+        instructions. Figures depending on unavailable counters are None.
+
+        :return: figures by name of the measure
+        :rtype: dict[str, dict[str, float | None]]
+        """
+
+        def ratio(num, den, scale=1):
+            return None if num is None or not den else scale * num / den
+
+        summary = {}
+
+        for name, (runs, sums, _) in self.counters.items():
+            cycles, instructions, llc_misses, branch_misses = sums
+            summary[name] = {
+                "cycles": ratio(cycles, runs),
+                "instructions": ratio(instructions, runs),
+                "ipc": ratio(instructions, cycles),
+                "llc_mpki": ratio(llc_misses, instructions, 1000),
+                "branch_mpki": ratio(branch_misses, instructions, 1000)
+            }
+
+        return summary
+
+    def allocation_summary(self) -> dict[str, dict[str, dict[str, float | None]]]:
+        """
+        Allocations of every measure, averaged per run and the largest of a
+        run, by field of ``ALLOCATIONS``. A steady state free of allocations
+        has every maximum but the heap at 0.
+
+        :return: ``"mean"`` and ``"max"`` figures by name of the measure
+        :rtype: dict[str, dict[str, dict[str, float | None]]]
+        """
+
+        summary = {}
+
+        for name, (runs, sums, maxima) in self.allocations.items():
+            summary[name] = {
+                "mean": {field: None if value is None else value / runs
+                         for field, value in zip(ALLOCATIONS, sums)},
+                "max": dict(zip(ALLOCATIONS, maxima))
+            }
+
+        return summary
+
+    def summary(self) -> dict[str, dict[str, float]]:
+        """
+        Main figures of every measure, see :meth:`Histogram.summary`.
+
+        :return: figures by name of the measure
+        :rtype: dict[str, dict[str, float]]
+        """
+
+        return {name: histogram.summary() for name, histogram in self.histograms.items()}
+
+    def dump(self) -> dict[str, list[tuple[float, int]]]:
+        """
+        Non empty buckets of every measure, see :meth:`Histogram.dump`.
+
+        :return: buckets by name of the measure
+        :rtype: dict[str, list[tuple[float, int]]]
+        """
+
+        return {name: histogram.dump() for name, histogram in self.histograms.items()}
+
+    def snapshot(self) -> 'Stats':
+        """
+        Independent copy of the current state.
+
+        :return: copy of the statistics
+        :rtype: Stats
+        """
+
+        return copy.deepcopy(self)
+
+    def reset(self) -> None:
+        """
+        Forget the values of every measure, keeping the memory.
+        """
+
+        for histogram in self.histograms.values():
+            histogram.reset()
+
+        self.counters = {}
+        self.allocations = {}
+
+
+class Laps:
+    """
+    Stopwatch recording on a :class:`Stats` the time between consecutive laps,
+    and the hardware counters and the allocations if given, doing nothing when
+    the stats are None. The counters are read as first thing of a lap and read
+    again at its end, so the bookkeeping of the lap is not counted.
+
+    :param stats: where to record the laps
+    :type stats: Stats
+    :param counters: hardware counters to sample, defaults to None
+    :type counters: PerfCounters, optional
+    :param allocations: allocation counters to sample, defaults to None
+    :type allocations: AllocationCounters, optional
+    """
+
+    __slots__ = ["stats", "sources", "start", "last"]
+
+    def __init__(self, stats: Stats, counters=None, allocations=None) -> None:
+        self.stats = stats
+        # source, recording method, reading at the start and at the last lap
+        self.sources = []
+
+        if stats is not None:
+            for source, record in ((counters, stats.record_counters),
+                                   (allocations, stats.record_allocations)):
+                if source is not None:
+                    self.sources.append([source, record, None, None])
+
+            for entry in self.sources:
+                entry[2] = entry[3] = entry[0].read()
+
+        self.start = self.last = time.perf_counter() if stats is not None else 0
+
+    @staticmethod
+    def deltas(after: list[int | None], before: list[int | None]) -> list[int | None]:
+        """
+        Increments of the counters between two readings.
+
+        :param after: later reading
+        :type after: list[int | None]
+        :param before: earlier reading
+        :type before: list[int | None]
+        :return: difference of each counter, None if unavailable
+        :rtype: list[int | None]
+        """
+
+        return [None if a is None or b is None else a - b for a, b in zip(after, before)]
+
+    def lap(self, name: str) -> None:
+        """
+        Record the time and the counters since the previous lap.
+
+        :param name: name of the measure
+        :type name: str
+        """
+
+        if self.stats is None:
+            return
+
+        counts = [entry[0].read() for entry in self.sources]
+        now = time.perf_counter()
+        self.stats.record(name, now - self.last)
+
+        for entry, count in zip(self.sources, counts):
+            entry[1](name, self.deltas(count, entry[3]))
+
+        for entry in self.sources:
+            entry[3] = entry[0].read()
+
+        self.last = time.perf_counter()
+
+    def finish(self, name: str) -> None:
+        """
+        Record the time and the counters since the start.
+
+        :param name: name of the measure
+        :type name: str
+        """
+
+        if self.stats is None:
+            return
+
+        counts = [entry[0].read() for entry in self.sources]
+        self.stats.record(name, time.perf_counter() - self.start)
+
+        for entry, count in zip(self.sources, counts):
+            entry[1](name, self.deltas(count, entry[2]))
+
+
+class BodyCosts:
+    """
+    Work done to render each body, summed over the frames since the last
+    :meth:`reset`. With :attr:`py3dgame.rendering.Renderer.costs` the renderer
+    records for each drawn body the vertices transformed, the faces culled
+    (back facing, out of the screen or replaced by an impostor), the triangles
+    rasterized, the pixels written by the default rasterizer and the time.
+    """
+
+    FIELDS = ("vertices", "culled", "triangles", "pixels", "time")
+
+    __slots__ = ["costs", "frames"]
+
+    def __init__(self) -> None:
+        self.costs = {}
+        self.frames = 0
+
+    def record(self,
+        name: str,
+        vertices: int,
+        culled: int,
+        triangles: int,
+        pixels: int,
+        seconds: float) -> None:
+        """
+        Add the cost of drawing a body once.
+
+        :param name: name of the body
+        :type name: str
+        :param vertices: vertices transformed
+        :type vertices: int
+        :param culled: faces not rasterized
+        :type culled: int
+        :param triangles: triangles rasterized
+        :type triangles: int
+        :param pixels: pixels written
+        :type pixels: int
+        :param seconds: time spent
+        :type seconds: float
+        """
+
+        cost = self.costs.get(name)
+
+        if cost is None:
+            cost = [0, 0, 0, 0, 0.0]
+            self.costs[name] = cost
+
+        cost[0] += vertices
+        cost[1] += culled
+        cost[2] += triangles
+        cost[3] += pixels
+        cost[4] += seconds
+
+    def report(self, key: str = "time") -> list[tuple[str, dict[str, float]]]:
+        """
+        Costs of the bodies from the most expensive, averaged per frame.
+
+        :param key: field to sort by, one of ``FIELDS``, defaults to "time"
+        :type key: str, optional
+        :return: name of each body with its costs by field
+        :rtype: list[tuple[str, dict[str, float]]]
+        """
+
+        if key not in self.FIELDS:
+            raise ValueError(f"Unknown cost {key}")
+
+        frames = max(self.frames, 1)
+        report = [(name, {field: value / frames for field, value in zip(self.FIELDS, cost)})
+                  for name, cost in self.costs.items()]
+        report.sort(key=lambda item: item[1][key], reverse=True)
+
+        return report
+
+    def reset(self) -> None:
+        """
+        Forget the costs recorded.
+        """
+
+        self.costs = {}
+        self.frames = 0
@@ -0,0 +1,528 @@
+"""
+Visibility determination to skip bodies that can not be seen by the camera.
+
+A frustum is a list of planes ``(normal, d)``, a point ``p`` is inside
+the frustum when ``normal * p + d >= 0`` for every plane.
+"""
+
+import math
+from typing import TypeAlias
+import numpy as np
+from .math3d import Vec3
+
+Plane: TypeAlias = tuple[Vec3, float]
+
+
+def sphere_in_frustum(center: Vec3, radius: float, frustum: list[Plane]) -> bool:
+    """
+    Check if a sphere is at least partially inside a frustum.
+
+    :param center: center of the sphere
+    :type center: Vec3
+    :param radius: radius of the sphere
+    :type radius: float
+    :param frustum: planes of the frustum
+    :type frustum: list[Plane]
+    :return: False if the sphere is completely outside
+    :rtype: bool
+    """
+
+    for normal, d in frustum:
+        if normal * center + d < - radius:
+            return False
+
+    return True
+
+
+def clip_polygon(polygon: list[Vec3], plane: Plane) -> list[Vec3]:
+    """
+    Clip a convex polygon keeping the part inside the plane.
+
+    :param polygon: vertices of the polygon
+    :type polygon: list[Vec3]
+    :param plane: clipping plane
+    :type plane: Plane
+    :return: vertices of the clipped polygon
+    :rtype: list[Vec3]
+    """
+
+    normal, d = plane
+    clipped = []
+
+    for i, current in enumerate(polygon):
+        previous = polygon[i - 1]
+        dist_current = normal * current + d
+        dist_previous = normal * previous + d
+
+        if (dist_current >= 0) != (dist_previous >= 0):
+            t = dist_previous / (dist_previous - dist_current)
+            clipped.append(previous + (current - previous) * t)
+
+        if dist_current >= 0:
+            clipped.append(current)
+
+    return clipped
+
+
+def portal_frustum(eye: Vec3, polygon: list[Vec3]) -> list[Plane]:
+    """
+    Compute the frustum that starts from ``eye`` and passes through a convex polygon.
+    The plane of the polygon is included, so only what is beyond it is inside.
+
+    :param eye: position of the camera
+    :type eye: Vec3
+    :param polygon: vertices of the polygon
+    :type polygon: list[Vec3]
+    :return: planes of the frustum
+    :rtype: list[Plane]
+    """
+
+    centroid = polygon[0]
+    for vertex in polygon[1:]:
+        centroid = centroid + vertex
+    centroid = centroid / len(polygon)
+
+    frustum = []
+
+    for i, vertex in enumerate(polygon):
+        normal = (polygon[i - 1] - eye) @ (vertex - eye)
+        length = abs(normal)
+
+        if length < 1e-12:
+            continue
+
+        normal = normal / length
+
+        if normal * (centroid - eye) < 0:
+            normal = - normal
+
+        frustum.append((normal, - (normal * eye)))
+
+    normal = (polygon[1] - polygon[0]) @ (polygon[2] - polygon[0])
+    length = abs(normal)
+
+    if length > 1e-12:
+        normal = normal / length
+
+        if normal * (centroid - eye) < 0:
+            normal = - normal
+
+        frustum.append((normal, - (normal * centroid)))
+
+    return frustum
+
+
+class Cell:
+    """
+    Convex region of space, as an axis aligned box, that contains some bodies.
+
+    :param name: unique name that identifies the cell
+    :type name: str
+    :param low: corner of the box with the lowest coordinates
+    :type low: Vec3
+    :param high: corner of the box with the highest coordinates
+    :type high: Vec3
+    :param bodies: names of the bodies inside the cell, defaults to None
+    :type bodies: set[str], optional
+    """
+
+    __slots__ = ["name", "low", "high", "bodies", "portals"]
+
+    def __init__(self, name: str, low: Vec3, high: Vec3, bodies: set[str] = None) -> None:
+        self.name = name
+        self.low = low
+        self.high = high
+        self.bodies = set() if bodies is None else set(bodies)
+        self.portals = []
+
+    def contains(self, point: Vec3) -> bool:
+        """
+        Check if a point is inside the cell.
+
+        :param point: point in world coordinates
+        :type point: Vec3
+        :return: True if the point is inside
+        :rtype: bool
+        """
+
+        return (self.low.x <= point.x <= self.high.x and
+                self.low.y <= point.y <= self.high.y and
+                self.low.z <= point.z <= self.high.z)
+
+
+class Portal:
+    """
+    Convex polygon, like a door or a window, through which a cell sees another one.
+
+    :param cell1: first cell connected by the portal
+    :type cell1: Cell
+    :param cell2: second cell connected by the portal
+    :type cell2: Cell
+    :param polygon: vertices of the convex polygon in world coordinates
+    :type polygon: list[Vec3]
+    """
+
+    __slots__ = ["cell1", "cell2", "polygon"]
+
+    def __init__(self, cell1: Cell, cell2: Cell, polygon: list[Vec3]) -> None:
+        self.cell1 = cell1
+        self.cell2 = cell2
+        self.polygon = list(polygon)
+
+    def other(self, cell: Cell) -> Cell:
+        """
+        Get the cell on the other side of the portal.
+
+        :param cell: cell on one side of the portal
+        :type cell: Cell
+        :return: cell on the other side
+        :rtype: Cell
+        """
+
+        return self.cell2 if cell is self.cell1 else self.cell1
+
+
+class CellGraph:
+    """
+    Cells connected by portals used to find the bodies visible from a camera.
+    Starting from the cell of the camera the frustum is recursively narrowed
+    through the visible portals, so only reachable cells are processed.
+    Bodies that are not assigned to any cell are always tested against
+    the frustum of the camera.
+
+    :param max_depth: maximum number of portals crossed, defaults to 16
+    :type max_depth: int, optional
+    """
+
+    def __init__(self, max_depth: int = 16) -> None:
+        self.cells = {}
+        self.portals = []
+        self.max_depth = max_depth
+
+    def add_cell(self, cell: Cell) -> Cell:
+        """
+        Add a cell to the graph.
+
+        :param cell: cell to add
+        :type cell: Cell
+        :return: the added cell
+        :rtype: Cell
+        """
+
+        self.cells[cell.name] = cell
+
+        return cell
+
+    def add_portal(self, name1: str, name2: str, polygon: list[Vec3]) -> Portal:
+        """
+        Connect two cells with a portal.
+
+        :param name1: name of the first cell
+        :type name1: str
+        :param name2: name of the second cell
+        :type name2: str
+        :param polygon: vertices of the convex polygon in world coordinates
+        :type polygon: list[Vec3]
+        :return: the new portal
+        :rtype: Portal
+        """
+
+        portal = Portal(self.cells[name1], self.cells[name2], polygon)
+        portal.cell1.portals.append(portal)
+        portal.cell2.portals.append(portal)
+        self.portals.append(portal)
+
+        return portal
+
+    def cell_at(self, point: Vec3) -> Cell:
+        """
+        Find the cell that contains a point.
+
+        :param point: point in world coordinates
+        :type point: Vec3
+        :return: the cell or None if the point is outside every cell
+        :rtype: Cell
+        """
+
+        for cell in self.cells.values():
+            if cell.contains(point):
+                return cell
+
+        return None
+
+    def visible_cells(self, eye: Vec3, frustum: list[Plane]) -> list[tuple[Cell, list[Plane]]]:
+        """
+        Find the cells reachable from ``eye`` through portals, each one with the
+        narrowed frustum it is seen through. A cell seen through many portals
+        appears once for each of them.
+
+        :param eye: position of the camera
+        :type eye: Vec3
+        :param frustum: frustum of the camera
+        :type frustum: list[Plane]
+        :return: visible cells and their frustums, empty if ``eye`` is outside every cell
+        :rtype: list[tuple[Cell, list[Plane]]]
+        """
+
+        start = self.cell_at(eye)
+
+        if start is None:
+            return []
+
+        visible = []
+        stack = [(start, frustum, (start,))]
+
+        while stack:
+            cell, cell_frustum, path = stack.pop()
+            visible.append((cell, cell_frustum))
+
+            if len(path) > self.max_depth:
+                continue
+
+            for portal in cell.portals:
+                other = portal.other(cell)
+
+                if other in path:
+                    continue
+
+                polygon = portal.polygon
+                for plane in cell_frustum:
+                    polygon = clip_polygon(polygon, plane)
+                    if len(polygon) < 3:
+                        break
+                else:
+                    stack.append((other, portal_frustum(eye, polygon) + frustum,
+                                  path + (other,)))
+
+        return visible
+
+    def visible_bodies(self, eye: Vec3, frustum: list[Plane], bodies: dict) -> list:
+        """
+        Select the bodies that may be visible from ``eye``.
+
+        :param eye: position of the camera
+        :type eye: Vec3
+        :param frustum: frustum of the camera
+        :type frustum: list[Plane]
+        :param bodies: all the bodies of the scene by name
+        :type bodies: dict[str, Body]
+        :return: bodies to render
+        :rtype: list[Body]
+        """
+
+        visible = self.visible_cells(eye, frustum)
+
+        if not visible:
+            return [body for body in bodies.values()
+                    if sphere_in_frustum(body.center, body.radius, frustum)]
+
+        assigned = set()
+        for cell in self.cells.values():
+            assigned.update(cell.bodies)
+
+        selected = {}
+
+        for name, body in bodies.items():
+            if name not in assigned and sphere_in_frustum(body.center, body.radius, frustum):
+                selected[name] = body
+
+        for cell, cell_frustum in visible:
+            for name in cell.bodies:
+                body = bodies.get(name)
+
+                if (body is not None and name not in selected and
+                    sphere_in_frustum(body.center, body.radius, cell_frustum)):
+                    selected[name] = body
+
+        return list(selected.values())
+
+
+class PVS:
+    """
+    Potentially visible set of a static level. The space between ``low`` and ``high``
+    is divided in a grid of cells, each cell stores a bitset, indexed by the handles
+    of the bodies in the scene, of the bodies that can be seen from inside it.
+    Identical bitsets are stored once. Bodies added to the scene after the bake are
+    always considered visible, also when they reuse the handle of a removed body:
+    the names of the bodies at bake time tell them apart. Use
+    :func:`py3dgame.bake.potentially_visible_set` to create one.
+
+    :param low: corner of the grid with the lowest coordinates
+    :type low: Vec3
+    :param high: corner of the grid with the highest coordinates
+    :type high: Vec3
+    :param resolution: number of cells along x, y and z
+    :type resolution: tuple[int, int, int]
+    :param size: number of bodies in the bitsets
+    :type size: int
+    :param rows: packed bitsets, one row for each distinct set
+    :type rows: np.ndarray
+    :param cell_rows: index of the row of each cell
+    :type cell_rows: np.ndarray
+    :param names: name of the body of each handle at bake time, empty for the free
+        handles, defaults to None that trusts the handles of the scene
+    :type names: list[str], optional
+    """
+
+    __slots__ = ["low", "high", "resolution", "size", "rows", "cell_rows", "names", "cache",
+                 "added", "added_key"]
+
+    def __init__(
+        self,
+        low: Vec3,
+        high: Vec3,
+        resolution: tuple[int, int, int],
+        size: int,
+        rows: np.ndarray,
+        cell_rows: np.ndarray,
+        names: list[str] = None) -> None:
+
+        self.low = low
+        self.high = high
+        self.resolution = tuple(resolution)
+        self.size = size
+        self.rows = rows
+        self.cell_rows = cell_rows
+        self.names = names
+        self.cache = {}
+        self.added = []
+        self.added_key = None
+
+    def cell_at(self, point: Vec3) -> int:
+        """
+        Find the index of the cell that contains a point.
+
+        :param point: point in world coordinates
+        :type point: Vec3
+        :return: index of the cell or -1 if the point is outside the grid
+        :rtype: int
+        """
+
+        index = 0
+
+        for coord, low, high, res in zip((point.x, point.y, point.z),
+                                         (self.low.x, self.low.y, self.low.z),
+                                         (self.high.x, self.high.y, self.high.z),
+                                         self.resolution):
+            if not low <= coord <= high:
+                return - 1
+
+            index = index * res + min(math.floor((coord - low) / (high - low) * res), res - 1)
+
+        return index
+
+    def visible_handles(self, point: Vec3) -> list[int]:
+        """
+        Get the handles of the bodies that can be seen from a point.
+
+        :param point: point in world coordinates
+        :type point: Vec3
+        :return: handles of the visible bodies, None if the point is outside the grid
+        :rtype: list[int]
+        """
+
+        cell = self.cell_at(point)
+
+        if cell < 0:
+            return None
+
+        row = int(self.cell_rows[cell])
+        handles = self.cache.get(row)
+
+        if handles is None:
+            bits = np.unpackbits(self.rows[row], count=self.size)
+            handles = np.flatnonzero(bits).tolist()
+            self.cache[row] = handles
+
+        return handles
+
+    def added_bodies(self, scene) -> list:
+        """
+        Get the bodies of the scene that are not in the bitsets: the ones with a handle
+        beyond the bake and the ones that took the handle of a body removed after it.
+        The list is rebuilt only when bodies are added to or removed from the scene.
+
+        :param scene: scene the set was baked for
+        :type scene: Scene
+        :return: bodies added after the bake
+        :rtype: list[Body]
+        """
+
+        if self.added_key is None or self.added_key[0] is not scene \
+           or self.added_key[1] != scene.changes:
+            self.added = [body for body in scene.handles[self.size:] if body is not None]
+
+            if self.names is not None:
+                self.added.extend(body for body, name in zip(scene.handles, self.names)
+                                  if body is not None and body.name != name)
+
+            self.added_key = (scene, scene.changes)
+
+        return self.added
+
+    def visible_bodies(self, eye: Vec3, frustum: list[Plane], scene) -> list:
+        """
+        Select the bodies that may be visible from ``eye``.
+
+        :param eye: position of the camera
+        :type eye: Vec3
+        :param frustum: frustum of the camera
+        :type frustum: list[Plane]
+        :param scene: scene the set was baked for
+        :type scene: Scene
+        :return: bodies to render
+        :rtype: list[Body]
+        """
+
+        handles = self.visible_handles(eye)
+
+        if handles is None:
+            candidates = scene.bodies.values()
+        else:
+            candidates = [scene.handles[handle] for handle in handles]
+
+            if self.names is not None:
+                candidates = [body for body, handle in zip(candidates, handles)
+                              if body is not None and body.name == self.names[handle]]
+
+            candidates.extend(self.added_bodies(scene))
+
+        return [body for body in candidates
+                if body is not None and sphere_in_frustum(body.center, body.radius, frustum)]
+
+    def save(self, path: str) -> None:
+        """
+        Save the set in a binary .npz file.
+
+        :param path: path of the file
+        :type path: str
+        """
+
+        arrays = {"rows": self.rows, "cell_rows": self.cell_rows}
+
+        if self.names is not None:
+            arrays["names"] = np.array(self.names, dtype=str)
+
+        np.savez(path, low=(self.low.x, self.low.y, self.low.z),
+                 high=(self.high.x, self.high.y, self.high.z),
+                 resolution=self.resolution, size=self.size, **arrays)
+
+    @classmethod
+    def load(cls, path: str) -> 'PVS':
+        """
+        Load a set saved with :meth:`save`.
+
+        :param path: path of the file
+        :type path: str
+        :return: instance of the class
+        :rtype: PVS
+        """
+
+        with np.load(path) as data:
+            low = np.asarray(data["low"], dtype=np.float64).tolist()
+            high = np.asarray(data["high"], dtype=np.float64).tolist()
+            resolution = np.asarray(data["resolution"], dtype=np.int64).tolist()
+            names = np.asarray(data["names"], dtype=str).tolist() if "names" in data else None
+
+            return cls(Vec3(*low), Vec3(*high), tuple(resolution), int(data["size"]),
+                       data["rows"], data["cell_rows"], names)
@@ -0,0 +1,671 @@
+"""
+Tests for the module rendering
+"""
+
+import io
+import numpy as np
+import pygame
+import py3dgame as p3g
+
+
+def make_renderer(scene: p3g.Scene, width: int = 160, height: int = 120) -> p3g.Renderer:
+    """
+    Create a headless renderer looking along the x axis.
+    """
+
+    camera = p3g.Camera(p3g.Vec3(0, 0, 0), p3g.Vec3(1, 0, 0))
+
+    return p3g.Renderer(pygame.Surface((width, height)), camera, scene, None, headless=True)
+
+
+class TestRenderer:
+    """
+    Class containing tests for the methods of :class:`Renderer`.
+    """
+
+    def test_render_headless(self) -> None:
+        """
+        Test render method of :class:`Renderer` without a display.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("cube", 1, pos=p3g.Vec3(3, 0, 0)))
+        renderer = make_renderer(scene)
+        renderer.render()
+
+        assert renderer.triangles > 0
+        assert renderer.buffer[80, 60].any()
+        assert not renderer.buffer[0, 0].any()
+        assert renderer.depth[80, 60] < renderer.camera.zfar
+
+    def test_render_impostor(self) -> None:
+        """
+        Test that distant bodies are drawn with an impostor similar to the real body.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.sphere("sphere", 1, quality=3, pos=p3g.Vec3(5, 0, 0)))
+        renderer = make_renderer(scene, 320, 240)
+        renderer.render()
+        reference = renderer.buffer.astype(np.int32)
+        reference_depth = renderer.depth.copy()
+        covered = reference.any(axis=2)
+
+        renderer.impostor_size = 64
+        renderer.render()
+        impostor = renderer.impostors["sphere"]
+        difference = np.abs(reference - renderer.buffer).max(axis=2)
+        both = covered & renderer.buffer.any(axis=2)
+        depth_error = np.abs(renderer.depth[both] - reference_depth[both])
+
+        assert renderer.triangles == 2
+        assert np.sum(covered ^ renderer.buffer.any(axis=2)) < 0.04 * np.sum(covered)
+        assert np.sum(difference > 32) < 0.04 * np.sum(covered)
+        # the sphere is one unit deep, the sprite must not move it by as much
+        assert np.median(depth_error) < 0.05
+        assert np.sum(depth_error > 0.2) < 0.04 * np.sum(both)
+
+        renderer.render()
+
+        assert renderer.impostors["sphere"] is impostor
+
+        scene.remove_body("sphere")
+        renderer.render()
+
+        assert not renderer.impostors
+
+    def test_render_occlusion(self) -> None:
+        """
+        Test that occlusion culling skips hidden bodies without changing the image.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("wall", 6, pos=p3g.Vec3(8, 0, 0)))
+        scene.add_body(p3g.Body.sphere("hidden", 0.5, quality=2, pos=p3g.Vec3(14, 0, 0)))
+        scene.add_body(p3g.Body.cube("visible", 1, pos=p3g.Vec3(8, 5, 0)))
+        renderer = make_renderer(scene)
+        renderer.render()
+        reference = renderer.buffer.copy()
+
+        renderer.occlusion = True
+        renderer.render()
+        renderer.render()
+
+        assert renderer.last_visible == {"wall", "visible"}
+        assert renderer.occluded(scene.bodies["hidden"])
+        assert np.array_equal(renderer.buffer, reference)
+
+    def test_render_span_buffer(self) -> None:
+        """
+        Test that the span buffer resolves the same image of the depth buffer.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("back", 4, pos=p3g.Vec3(9, 1, 0)))
+        scene.add_body(p3g.Body.sphere("front", 1, quality=2, pos=p3g.Vec3(5, 0, 0)))
+        scene.add_body(p3g.Body.cube("side", 1, pos=p3g.Vec3(6, -1.5, 0.5)))
+        renderer = make_renderer(scene)
+        renderer.render()
+        reference = renderer.buffer.copy()
+        reference_depth = renderer.depth.copy()
+
+        renderer.span_buffer = True
+        renderer.render()
+        different = np.any(renderer.buffer != reference, axis=2)
+
+        assert not renderer.spans.counts.any()
+        assert np.allclose(renderer.depth, reference_depth, atol=1e-4)
+        # Only pixels on edges shared by adjacent faces can pick the other face
+        assert np.sum(different) < 0.01 * different.size
+
+    def test_render_compressed_depth(self) -> None:
+        """
+        Test that the compressed depth gives the same image and keeps large faces as planes.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("wall", 6, pos=p3g.Vec3(5, 0, 0)))
+        scene.add_body(p3g.Body.sphere("front", 0.5, quality=2, pos=p3g.Vec3(1.5, 0, 0)))
+        renderer = make_renderer(scene)
+        renderer.render()
+        reference = renderer.buffer.copy()
+        reference_depth = renderer.depth.copy()
+
+        renderer.compressed_depth = True
+        renderer.render()
+        renderer.load_buffers()
+        different = np.any(renderer.buffer != reference, axis=2)
+        modes = renderer.depth_tiles.modes()
+
+        assert np.allclose(renderer.depth, reference_depth, atol=1e-4)
+        assert np.sum(different) < 0.01 * different.size
+        assert modes["raw"] < modes["plane"] + modes["two_planes"]
+
+    def test_render_tiled_framebuffer(self) -> None:
+        """
+        Test that the tiled framebuffer resolves exactly the image of the linear one.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("back", 4, pos=p3g.Vec3(9, 1, 0)))
+        scene.add_body(p3g.Body.sphere("front", 1, quality=2, pos=p3g.Vec3(5, 0, 0)))
+        renderer = make_renderer(scene, 157, 118)
+        renderer.render()
+        reference = renderer.buffer.copy()
+        reference_depth = renderer.depth.copy()
+
+        renderer.tiled_framebuffer = True
+        renderer.buffer.fill(0)
+        renderer.render()
+
+        assert np.array_equal(renderer.buffer, reference)
+        assert np.array_equal(renderer.depth, reference_depth)
+
+    def test_render_color_format(self) -> None:
+        """
+        Test the compact color formats against the RGB image.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("back", 4, pos=p3g.Vec3(9, 1, 0)))
+        scene.add_body(p3g.Body.sphere("front", 1, quality=2, pos=p3g.Vec3(5, 0, 0)))
+        renderer = make_renderer(scene)
+        renderer.render()
+        reference = renderer.buffer.astype(np.int32)
+
+        renderer.color_format = "palette"
+        renderer.render()
+
+        assert renderer.compact.target.dtype == np.uint8
+        assert np.array_equal(renderer.buffer, reference)
+
+        renderer.color_format = "rgb565"
+        renderer.render()
+
+        assert renderer.compact.target.dtype == np.uint16
+        assert np.abs(renderer.buffer - reference).max() <= 7
+
+    def test_render_palette(self) -> None:
+        """
+        Test that the palette is built again for each frame with more than 256 colors.
+        """
+
+        scene = p3g.Scene()
+        orange = p3g.Body.sphere("orange", 1, quality=3, pos=p3g.Vec3(5, - 1.2, 0),
+                                 color=(230, 120, 40))
+        blue = p3g.Body.sphere("blue", 1, quality=3, pos=p3g.Vec3(5, 1.2, 0),
+                               color=(60, 140, 220))
+        scene.add_body(orange)
+        scene.add_body(blue)
+        renderer = make_renderer(scene)
+
+        for frame in range(1, 4):
+            renderer.color_format = "rgb"
+            renderer.render()
+            reference = renderer.buffer.astype(np.int32)
+
+            renderer.color_format = "palette"
+            renderer.render()
+
+            assert len(renderer.compact.keys) > 256
+            assert np.abs(renderer.buffer - reference).max() <= 8
+
+            orange.move(rot=p3g.Quat(0.5 * frame, p3g.Vec3(1, 1, 0).normalize()))
+            blue.move(rot=p3g.Quat(0.4 * frame, p3g.Vec3(0, 1, 1).normalize()))
+
+    def test_render_fxaa(self) -> None:
+        """
+        Test that FXAA softens the edges leaving flat areas untouched.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("cube", 2, pos=p3g.Vec3(5, 0, 0),
+                                     rot=p3g.Quat(0.3, p3g.Vec3(1, 1, 0))))
+        renderer = make_renderer(scene)
+        renderer.render()
+        reference = renderer.buffer.copy()
+
+        renderer.post_effects.append(p3g.FXAA(workers=2))
+        renderer.render()
+        changed = np.any(renderer.buffer != reference, axis=2)
+
+        assert changed.any()
+        assert not changed[:20, :20].any()
+        assert not changed[80, 60]
+
+    def test_render_checkerboard(self) -> None:
+        """
+        Test that the checkerboard rendering converges to the full image on a still camera.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("back", 4, pos=p3g.Vec3(9, 1, 0)))
+        scene.add_body(p3g.Body.sphere("front", 1, quality=2, pos=p3g.Vec3(5, 0, 0)))
+        renderer = make_renderer(scene)
+        renderer.render()
+        reference = renderer.buffer.copy()
+
+        renderer.checkerboard = True
+        renderer.render()
+        first = np.any(renderer.buffer != reference, axis=2)
+        renderer.render()
+        second = np.any(renderer.buffer != reference, axis=2)
+
+        assert renderer.parity == 1
+        assert np.sum(second) < np.sum(first)
+        assert np.sum(second) < 0.01 * second.size
+
+    def test_render_post_chain(self) -> None:
+        """
+        Test that the fused post chain applies fog, tonemap and color grading.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("near", 1, pos=p3g.Vec3(3, 0, 0)))
+        scene.add_body(p3g.Body.cube("far", 1, pos=p3g.Vec3(30, 4, 0)))
+        renderer = make_renderer(scene)
+        renderer.render()
+        reference = renderer.buffer.copy()
+        identity = p3g.ColorGrade(p3g.ColorGrade.identity())
+
+        renderer.post_effects.append(p3g.PostChain([identity], workers=2))
+        renderer.render()
+
+        assert np.array_equal(renderer.buffer, reference)
+
+        fog = p3g.Fog((255, 0, 0), start=0, end=renderer.camera.zfar)
+        renderer.post_effects[0] = p3g.PostChain([fog])
+        renderer.render()
+
+        assert np.array_equal(renderer.buffer[0, 0], (255, 0, 0))
+        assert renderer.buffer[80, 60, 0] >= reference[80, 60, 0]
+
+        renderer.post_effects[0] = p3g.PostChain([p3g.Tonemap(exposure=0.5, operator="clamp")])
+        renderer.render()
+
+        assert np.all(np.abs(renderer.buffer.astype(np.int32) - reference // 2) <= 1)
+
+    def test_render_gbuffer(self) -> None:
+        """
+        Test that the G-buffer channels match the rendered frame and follow the motion.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("cube", 1, pos=p3g.Vec3(5, 0, 0)))
+        renderer = make_renderer(scene)
+        renderer.render()
+        reference = renderer.buffer.copy()
+        side = p3g.Camera(p3g.Vec3(5, -5, 0), p3g.Vec3(0, 1, 0))
+        gbuffer = p3g.GBuffer(cameras=2)
+        batch = gbuffer.capture(renderer, [renderer.camera, side])
+
+        assert batch["rgb"].shape == (2, 120, 160, 3)
+        assert np.array_equal(batch["rgb"][0], reference.transpose(1, 0, 2))
+        assert batch["ids"][0, 60, 80] == scene.bodies["cube"].handle + 1
+        assert batch["ids"][0, 0, 0] == 0
+        assert np.array_equal(batch["ids"][0] > 0, batch["ids"][1] > 0)
+        assert abs(batch["depth"][0, 60, 80] - 3.5) < 0.01
+        assert np.allclose(batch["normals"][0, 60, 80], (-1, 0, 0))
+        assert np.allclose(batch["normals"][1, 60, 80], (0, -1, 0))
+        assert not batch["motion"].any()
+        assert renderer.gbuffer is None
+
+        scene.bodies["cube"].move(p3g.Vec3(5, 0.2, 0))
+        batch = gbuffer.capture(renderer, [renderer.camera, side])
+        covered = batch["ids"][0] > 0
+
+        # right of the camera is - y
+        assert np.all(batch["motion"][0, covered, 0] < 0)
+        assert np.allclose(batch["motion"][0, covered, 1], 0, atol=1e-3)
+        # the cube comes towards the side camera and grows from its center
+        side_covered = batch["ids"][1] > 0
+        assert np.abs(batch["motion"][1, side_covered]).max() > 0.1
+        assert np.allclose(batch["motion"][1, side_covered].mean(axis=0), 0, atol=0.05)
+
+    def test_render_gbuffer_perspective(self) -> None:
+        """
+        Test that the G-buffer depth follows the perspective on a receding floor,
+        and that the motion is NaN on the faces that were behind the camera.
+        """
+
+        vertices = [p3g.Vec3(2, -3, -1), p3g.Vec3(30, -3, -1),
+                    p3g.Vec3(30, 3, -1), p3g.Vec3(2, 3, -1)]
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body("floor", vertices, [(0, 1, 2), (0, 2, 3)]))
+        renderer = make_renderer(scene)
+        camera = renderer.camera
+        batch = p3g.GBuffer().capture(renderer)
+        covered = batch["ids"][0] > 0
+        ys = np.nonzero(covered)[0]
+
+        # the floor is one unit below the eye in view space
+        slope = ((ys + camera.cy) / camera.h * 2 - 1) / camera.f
+        error = np.abs(batch["depth"][0][covered] * slope - 1)
+
+        assert covered.sum() > 1000
+        assert np.median(error) < 0.005
+        assert error.max() < 0.05
+
+        scene = p3g.Scene()
+        cube = p3g.Body.cube("cube", 1, pos=p3g.Vec3(0.8, 0, 0))
+        scene.add_body(cube)
+        renderer = make_renderer(scene)
+        gbuffer = p3g.GBuffer()
+        gbuffer.capture(renderer)
+        cube.move(p3g.Vec3(5, 0, 0))
+        batch = gbuffer.capture(renderer)
+        covered = batch["ids"][0] > 0
+
+        assert covered.any()
+        assert np.isnan(batch["motion"][0, covered]).all()
+
+        batch = gbuffer.capture(renderer)
+
+        assert not batch["motion"][0, covered].any()
+
+    def test_render_poster(self) -> None:
+        """
+        Test that a poster rendered in tiles matches the frame rendered at once.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("back", 4, pos=p3g.Vec3(9, 1, 0)))
+        scene.add_body(p3g.Body.sphere("front", 1, quality=2, pos=p3g.Vec3(5, 0, 0)))
+        renderer = make_renderer(scene)
+        renderer.render()
+        reference = renderer.buffer.transpose(1, 0, 2).copy()
+        tiles = make_renderer(scene, 64, 50)
+        poster = p3g.Poster(160, 120)
+        bands = []
+        poster.render(tiles, lambda rows: bands.append(rows.copy()))
+        image = np.concatenate(bands)
+        changed = np.any(image != reference, axis=2)
+
+        assert [len(band) for band in bands] == [50, 50, 20]
+        assert np.sum(changed) < 0.01 * changed.size
+        assert tiles.camera.window is None
+
+        file = io.BytesIO()
+        poster.save(tiles, file)
+        file.seek(0)
+        loaded = pygame.surfarray.array3d(pygame.image.load(file, "poster.png"))
+
+        assert np.array_equal(loaded.transpose(1, 0, 2), image)
+
+    def test_render_pacer(self) -> None:
+        """
+        Test that the frame pacer keeps the target frame time and measures the latency.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("cube", 1, pos=p3g.Vec3(5, 0, 0)))
+        renderer = make_renderer(scene)
+        renderer.pacer = p3g.FramePacer(100)
+
+        for _ in range(10):
+            renderer.pacer.wait()
+            renderer.pacer.input_sampled()
+            renderer.render()
+
+        # late frames on a busy machine can only lower the rate, the frames after
+        # one catch up with the deadlines so only the mean is bounded below
+        assert len(renderer.pacer.frame_times) == 9
+        assert np.mean(renderer.pacer.frame_times) >= 0.9 * renderer.pacer.period
+        assert renderer.pacer.fps() < 110
+        assert len(renderer.pacer.latencies) == 10
+        assert renderer.pacer.latency > 0
+
+    def test_render_stats(self) -> None:
+        """
+        Test that the renderer records the times of the frame and of its stages.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("cube", 1, pos=p3g.Vec3(5, 0, 0)))
+        renderer = make_renderer(scene)
+        renderer.stats = p3g.Stats()
+
+        for _ in range(5):
+            renderer.render()
+
+        summary = renderer.stats.summary()
+
+        assert set(summary) == {"clear", "draw", "resolve", "post", "frame"}
+        assert summary["frame"]["count"] == 5
+        assert summary["frame"]["max"] >= summary["draw"]["max"] > 0
+
+    def test_render_body_costs(self) -> None:
+        """
+        Test that the cost of each body is reported from the most expensive.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("cube", 1, pos=p3g.Vec3(5, 0, 0)))
+        scene.add_body(p3g.Body.sphere("sphere", 1, quality=2, pos=p3g.Vec3(4, 2, 0)))
+        scene.add_body(p3g.Body.cube("behind", 1, pos=p3g.Vec3(-5, 0, 0)))
+        renderer = make_renderer(scene)
+        renderer.costs = p3g.BodyCosts()
+        renderer.render()
+        renderer.render()
+        report = renderer.costs.report("pixels")
+        costs = dict(report)
+
+        assert renderer.costs.frames == 2
+        assert [name for name, _ in report][-1] == "behind"
+        assert costs["behind"]["triangles"] == 0
+        assert costs["behind"]["culled"] == 12
+        assert costs["cube"]["triangles"] + costs["cube"]["culled"] == 12
+        assert sum(cost["pixels"] for cost in costs.values()) == renderer.pixels
+        assert costs["sphere"]["vertices"] > costs["cube"]["vertices"]
+
+    def test_render_counters(self) -> None:
+        """
+        Test that the stages record the hardware counters, when the system provides them.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("cube", 1, pos=p3g.Vec3(5, 0, 0)))
+        renderer = make_renderer(scene)
+        renderer.stats = p3g.Stats()
+        renderer.counters = p3g.PerfCounters()
+        renderer.render()
+        available = renderer.counters.available
+        renderer.counters.close()
+        summary = renderer.stats.counter_summary()
+
+        assert set(summary) == {"clear", "draw", "resolve", "post", "frame"}
+
+        if available["instructions"]:
+            assert summary["frame"]["instructions"] > summary["draw"]["instructions"] > 0
+        else:
+            assert summary["frame"]["ipc"] is None
+
+    def test_render_allocations(self) -> None:
+        """
+        Test that the stages record their allocations and that reading them allocates nothing.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("cube", 1, pos=p3g.Vec3(5, 0, 0)))
+        renderer = make_renderer(scene)
+        renderer.stats = p3g.Stats()
+        renderer.allocations = p3g.AllocationCounters()
+
+        try:
+            first = renderer.allocations.read()
+            second = renderer.allocations.read()
+            renderer.render()
+            renderer.render()
+        finally:
+            renderer.allocations.close()
+
+        summary = renderer.stats.allocation_summary()
+
+        assert second[:4] == first[:4]
+        assert set(summary) == {"clear", "draw", "resolve", "post", "frame"}
+        assert summary["draw"]["max"]["objects"] > 0
+        assert summary["frame"]["mean"]["bytes"] >= summary["draw"]["mean"]["bytes"]
+
+    def test_render_backends(self) -> None:
+        """
+        Test that every backend draws the same frames as the scalar rasterizer.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("back", 4, pos=p3g.Vec3(9, 1, 0)))
+        scene.add_body(p3g.Body.sphere("front", 1, quality=2, pos=p3g.Vec3(5, 0, 0)))
+        frames = {}
+
+        for name in ("scalar", "simd", "numpy", "threaded"):
+            renderer = make_renderer(scene)
+            renderer.backend = p3g.select_backend(name)
+            renderer.render()
+            frame = (renderer.buffer.copy(), renderer.depth.copy(), renderer.pixels)
+            renderer.checkerboard = True
+            renderer.render()
+            renderer.render()
+            frames[name] = frame + (renderer.buffer.copy(), renderer.pixels)
+
+        golden = frames["scalar"]
+
+        assert golden[2] > 0
+
+        for frame in frames.values():
+            assert np.array_equal(frame[0], golden[0])
+            assert np.array_equal(frame[1], golden[1])
+            assert frame[2] == golden[2]
+            assert np.array_equal(frame[3], golden[3])
+            assert frame[4] == golden[4]
+
+        assert p3g.select_backend().name in ("scalar", "simd", "threaded")
+
+    def test_command_buffer(self) -> None:
+        """
+        Test that a command buffer draws the same frame as the scene and replays moved instances.
+        """
+
+        bodies = [p3g.Body.cube("back", 4, pos=p3g.Vec3(9, 1, 0)),
+                  p3g.Body.sphere("front", 1, quality=2, pos=p3g.Vec3(5, 0, 0),
+                                  rot=p3g.Quat(0.7, p3g.Vec3(1, 1, 0)))]
+        scene = p3g.Scene()
+
+        for body in bodies:
+            scene.add_body(body)
+
+        reference = make_renderer(scene)
+        reference.render()
+        commands = p3g.CommandBuffer()
+
+        for body in bodies:
+            commands.draw_body(body)
+
+        renderer = make_renderer(p3g.Scene())
+        renderer.command_buffers = [commands]
+        renderer.render()
+
+        assert np.array_equal(renderer.buffer, reference.buffer)
+        assert np.array_equal(renderer.depth, reference.depth)
+        assert (renderer.triangles, renderer.pixels) == (reference.triangles, reference.pixels)
+
+        commands.reset()
+        commands.clear((0, 0, 255))
+        batch = commands.draw_instances(bodies[0], [(9, 1, 0), (9, 100, 0)])
+        renderer.render()
+        frame = renderer.buffer.copy()
+        commands.set_instances(batch, [(9, 100, 0), (9, 1, 0)])
+        renderer.render()
+
+        assert len(commands.meshes) == 2
+        assert np.all(frame[0, 0] == (0, 0, 255))
+        assert np.array_equal(renderer.buffer, frame)
+
+        # a clear command wipes the faces kept by a deferred backend too
+        renderer = make_renderer(scene)
+        renderer.backend = p3g.select_backend("threaded")
+        renderer.command_buffers = [commands]
+        renderer.render()
+
+        assert np.array_equal(renderer.buffer, frame)
+
+    def test_command_buffer_shaders(self) -> None:
+        """
+        Test that native face and span shaders color the faces without changing the coverage.
+        """
+
+        cube = p3g.Body.cube("cube", 2, pos=p3g.Vec3(5, 0, 0), rot=p3g.Quat(0.5, p3g.Vec3(1, 1, 0)))
+        commands = p3g.CommandBuffer()
+        commands.draw_body(cube)
+        renderer = make_renderer(p3g.Scene())
+        renderer.command_buffers = [commands]
+        renderer.render()
+        reference = (renderer.buffer.copy(), renderer.depth.copy(), renderer.pixels)
+        intensities = []
+
+        @p3g.FACE_SHADER
+        def toon(face, color, _) -> None:
+            intensities.append(face.contents.intensity)
+            level = 255 if face.contents.intensity > 0.5 else 128
+            color[0], color[1], color[2] = level, 0, 0
+
+        @p3g.SPAN_SHADER
+        def gradient(span, colors, _) -> None:
+            span = span.contents
+
+            for i in range(span.count):
+                for k in range(3):
+                    weight = span.weights[k] + i * span.steps[k]
+                    colors[3 * i + k] = min(max(int(255 * weight), 0), 255)
+
+        commands.reset()
+        commands.shader(face=toon)
+        commands.draw_body(cube)
+        renderer.render()
+        toon_frame = renderer.buffer.copy()
+        commands.reset()
+        commands.shader(span=gradient)
+        commands.draw_body(cube)
+        commands.shader()
+        renderer.render()
+        drawn = renderer.depth < renderer.camera.zfar
+
+        assert intensities and renderer.pixels == reference[2]
+        assert np.array_equal(renderer.depth, reference[1])
+        assert set(np.unique(toon_frame[drawn][:, 0]).tolist()) <= {128, 255}
+        assert np.all(toon_frame[drawn][:, 1:] == 0)
+        assert np.all(np.abs(renderer.buffer[drawn].astype(int).sum(axis=1) - 255) <= 3)
+        assert len(np.unique(renderer.buffer[drawn], axis=0)) > 10
+
+    def test_frame_capture_replay(self) -> None:
+        """
+        Test that a frame capture survives the file and replays on every kernel.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("back", 4, pos=p3g.Vec3(9, 1, 0)))
+        scene.add_body(p3g.Body.sphere("front", 1, quality=2, pos=p3g.Vec3(5, 0, 0)))
+        renderer = make_renderer(scene)
+        capture = p3g.FrameCapture().record(renderer)
+        file = io.BytesIO()
+        capture.save(file)
+        file.seek(0)
+        loaded = p3g.FrameCapture.load(file)
+
+        assert renderer.frame_capture is None
+        assert len(capture.triangles) == renderer.triangles
+        assert (loaded.w, loaded.h, loaded.zfar) == (160, 120, renderer.camera.zfar)
+        assert np.array_equal(loaded.triangles, capture.triangles)
+
+        for kernel in p3g.capture.KERNELS:
+            buffer = np.zeros_like(renderer.buffer)
+            depth = np.zeros_like(renderer.depth)
+            times = p3g.replay(loaded, kernel, 2, buffer, depth)
+
+            assert len(times) == 2 and min(times) > 0
+
+            if kernel in ("triangle", "frame_tiles", "palette"):
+                assert np.array_equal(buffer, renderer.buffer)
+            elif kernel == "rgb565":
+                assert np.abs(buffer - renderer.buffer.astype(np.int32)).max() <= 7
+
+            if kernel in ("triangle", "frame_tiles", "rgb565", "palette"):
+                assert np.array_equal(depth, renderer.depth)
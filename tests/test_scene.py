@@ -0,0 +1,214 @@
+"""
+Tests for the module scene
+"""
+
+import math
+import os
+import numpy as np
+import pytest
+import py3dgame as p3g
+from py3dgame.bake import ambient_occlusion
+from py3dgame.framebuffer import CompactFramebuffer
+from ext_rendering import build_bvh, bake_ao
+
+ASSETS = os.path.join(os.path.dirname(__file__), "..", "assets")
+
+
+class TestScene:
+    """
+    Class containing tests for the methods of :class:`Scene`.
+    """
+
+    def test_init_bodies(self) -> None:
+        """
+        Test that :class:`Scene` keeps the dictionary of bodies it is given.
+        """
+
+        bodies = {name: p3g.Body.cube(name, 1) for name in ("cube1", "cube2")}
+        scene = p3g.Scene(bodies=bodies)
+
+        assert scene.bodies is bodies
+        assert [body.handle for body in bodies.values()] == [0, 1]
+
+        scene.add_body(p3g.Body.cube("cube3", 1))
+
+        assert "cube3" in bodies
+
+    def test_add_bodies(self) -> None:
+        """
+        Test add_bodies method of :class:`Scene`.
+        """
+
+        scene = p3g.Scene()
+        bodies = [p3g.Body.cube(f"cube{i}", 1) for i in range(3)]
+        positions = np.array([[0, 0, 0], [1, 2, 3], [4, 5, 6]])
+        handles = scene.add_bodies(bodies, positions)
+
+        assert handles.tolist() == [0, 1, 2]
+        assert bodies[1].handle == 1
+        assert bodies[1].pos == p3g.Vec3(0, 0, 0)
+
+        scene.update()
+
+        assert bodies[1].pos == p3g.Vec3(1, 2, 3)
+        assert bodies[2].v[0] == p3g.Vec3(4.5, 5.5, 6.5)
+        assert not scene.dirty.any()
+
+    def test_set_transforms(self) -> None:
+        """
+        Test set_transforms method of :class:`Scene`.
+        """
+
+        scene = p3g.Scene()
+        cube = p3g.Body.cube("cube", 2)
+        scene.add_body(cube)
+        scene.set_transforms([0], rotations=[[math.pi / 2, 0, 0, 1]])
+
+        assert cube.v[0] == p3g.Vec3(1, 1, 1)
+
+        scene.update()
+
+        assert cube.v[0] == p3g.Vec3(1, - 1, 1)
+
+        with pytest.raises(IndexError):
+            scene.set_transforms([1], [[0, 0, 0]])
+
+        with pytest.raises(ValueError):
+            scene.set_transforms([0], [[0, 0]])
+
+    def test_remove_body(self) -> None:
+        """
+        Test remove_body method of :class:`Scene`.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("cube1", 1))
+        scene.add_body(p3g.Body.cube("cube2", 1))
+        scene.remove_body("cube1")
+
+        with pytest.raises(IndexError):
+            scene.set_transforms([0], [[1, 0, 0]])
+
+        assert scene.add_body(p3g.Body.cube("cube3", 1)) == 0
+
+        scene.set_transforms([0], [[1, 0, 0]])
+        scene.update()
+
+        assert scene.bodies["cube3"].pos == p3g.Vec3(1, 0, 0)
+
+
+class TestBody:
+    """
+    Class containing tests for the methods of :class:`Body`.
+    """
+
+    def test_shade_faces(self) -> None:
+        """
+        Test shade_faces method of :class:`Body`.
+        """
+
+        cube = p3g.Body.cube("cube", 1, color=(200, 100, 50))
+        light = p3g.Vec3(0, 0, - 1)
+        colors = cube.shade_faces(light)
+        intensity = cube.n[0] * light / 2 + 0.5
+
+        assert cube.shade.dtype == np.uint8
+        assert cube.shade.shape == (12, 3)
+        assert colors[0] == list(p3g.color.darken_color((200, 100, 50), intensity))
+        assert cube.shade_faces(light) is colors
+
+        cube.traslate(p3g.Vec3(1, 0, 0))
+
+        assert cube.shade_faces(light) is colors
+
+        cube.rotate(0.1)
+
+        assert cube.shade_faces(light) is not colors
+
+        colors = cube.shade_faces(light)
+
+        assert cube.shade_faces(p3g.Vec3(0, 1, 0)) is not colors
+
+        colors = cube.shade_faces(light)
+        cube.color = (50, 100, 200)
+
+        assert cube.shade_faces(light) is not colors
+        assert cube.shade[0].tolist() == list(p3g.color.darken_color((50, 100, 200), intensity))
+
+        cube.color = [(50, 100, 200)] * 12
+        colors = cube.shade_faces(light)
+        framebuffer = CompactFramebuffer()
+        packed = framebuffer.shade(cube, colors)
+        cube.color[0] = (250, 0, 0)
+        colors = cube.shade_faces(light)
+
+        assert colors[0] == list(p3g.color.darken_color((250, 0, 0), intensity))
+        assert framebuffer.shade(cube, colors)[0] != packed[0]
+
+    def test_from_obj_cache(self, tmp_path) -> None:
+        """
+        Test from_obj class method of :class:`Body` with the ambient occlusion
+        bake and the binary mesh cache.
+        """
+
+        obj_file = str(tmp_path / "box.obj")
+        cube = p3g.Body.cube("cube", 2)
+
+        with open(obj_file, "w", encoding="utf-8") as file:
+            for vertex in cube.vertices:
+                file.write(f"v {vertex.x} {vertex.y} {vertex.z}\n")
+            for face in cube.f:
+                file.write(f"f {face[0] + 1} {face[1] + 1} {face[2] + 1}\n")
+
+        body = p3g.Body.from_obj(obj_file, ao_samples=16, cache=True)
+
+        assert os.path.exists(obj_file + ".npz")
+        assert body.ao.shape == (8,)
+        assert np.allclose(body.ao, 1)
+        assert body.v[0] == cube.v[0]
+        assert body.f == list(cube.f)
+
+        cached = p3g.Body.from_obj(obj_file, ao_samples=16, cache=True)
+
+        assert np.array_equal(cached.ao, body.ao)
+        assert p3g.Body.from_obj(obj_file).ao is None
+
+    def test_from_obj_occlusion(self) -> None:
+        """
+        Test that the ambient occlusion bake darkens the concave parts of a mesh.
+        """
+
+        vertices = np.array([[0, 0, 0], [1, 0, 0], [1, 1, 0], [0, 1, 0],
+                             [0, 0, 0.5], [1, 0, 0.5], [1, 1, 0.5], [0, 1, 0.5]])
+        facing = np.array([[0, 1, 2], [0, 2, 3], [4, 6, 5], [4, 7, 6]])
+        opposite = facing[:, ::-1]
+
+        assert np.all(ambient_occlusion(vertices, facing, samples=64) < 0.95)
+        assert np.allclose(ambient_occlusion(vertices, opposite, samples=64), 1)
+
+        coin = p3g.Body.from_obj(os.path.join(ASSETS, "coin.obj"), ao_samples=64)
+
+        assert coin.ao.min() < 0.7
+        assert coin.ao.max() == 1
+        assert np.all(coin.ao >= 0)
+
+    def test_bake_ao_empty_tree(self) -> None:
+        """
+        Test that the native bake of the ambient occlusion finds no occluder in the
+        hierarchy of a mesh without faces.
+        """
+
+        vertices = np.array([[0, 0, 0], [1, 0, 0]], dtype=np.float32)
+        normals = np.array([[0, 0, 1], [0, 0, 1]], dtype=np.float32)
+        faces = np.zeros((0, 3), dtype=np.int32)
+        nodes = np.zeros((1, 8), dtype=np.float32)
+        indices = np.zeros(1, dtype=np.int32)
+        ao = np.zeros(2, dtype=np.float32)
+
+        assert build_bvh(vertices.ctypes.data, faces.ctypes.data, 0,
+                         nodes.ctypes.data, indices.ctypes.data) == 1
+
+        bake_ao(vertices.ctypes.data, normals.ctypes.data, faces.ctypes.data,
+                nodes.ctypes.data, indices.ctypes.data, 16, 1.0, 1e-4, 0, 2, ao.ctypes.data)
+
+        assert np.array_equal(ao, [1, 1])
@@ -0,0 +1,115 @@
+"""
+Tests for the modules stats and counters
+"""
+
+import numpy as np
+from ext_rendering import alloc_counts
+import py3dgame as p3g
+
+
+class TestHistogram:
+    """
+    Class containing tests for the methods of :class:`Histogram`.
+    """
+
+    def test_percentiles(self) -> None:
+        """
+        Test the percentiles of a uniform distribution against their precision.
+        """
+
+        histogram = p3g.Histogram()
+
+        for i in range(1, 10001):
+            histogram.record(i * 1e-6)
+
+        summary = histogram.summary()
+
+        assert summary["count"] == 10000
+        assert abs(summary["p50"] - 0.005) < 0.005 * 0.01
+        assert abs(summary["p99"] - 0.0099) < 0.0099 * 0.01
+        assert summary["max"] == 0.01
+        assert sum(count for _, count in histogram.dump()) == 10000
+        assert len(histogram.counts) < 5000
+
+
+class TestStats:
+    """
+    Class containing tests for the methods of :class:`Stats`.
+    """
+
+    def test_snapshot_reset(self) -> None:
+        """
+        Test that a snapshot is not changed by the records after it and by a reset.
+        """
+
+        stats = p3g.Stats()
+        stats.record("frame", 0.016)
+        stats.record("frame", 0.033)
+        snapshot = stats.snapshot()
+        stats.reset()
+        stats.record("frame", 0.001)
+
+        assert snapshot.summary()["frame"]["count"] == 2
+        assert abs(snapshot.summary()["frame"]["p50"] - 0.016) < 0.001
+        assert stats.summary()["frame"]["max"] == 0.001
+
+    def test_counter_summary(self) -> None:
+        """
+        Test the ratios of the hardware counters and the unavailable ones.
+        """
+
+        stats = p3g.Stats()
+        stats.record_counters("draw", [1000, 2000, 4, None])
+        stats.record_counters("draw", [1000, 2000, 0, 10])
+        summary = stats.counter_summary()["draw"]
+
+        assert summary["cycles"] == 1000
+        assert summary["ipc"] == 2
+        assert summary["llc_mpki"] == 1
+        assert summary["branch_mpki"] is None
+
+    def test_allocation_summary(self) -> None:
+        """
+        Test the means and maxima of the allocations and the unavailable heap.
+        """
+
+        stats = p3g.Stats()
+        stats.record_allocations("draw", [10, 0, 2, 800, None])
+        stats.record_allocations("draw", [30, 0, 0, 200, 64])
+        summary = stats.allocation_summary()["draw"]
+
+        assert summary["mean"]["objects"] == 20
+        assert summary["max"]["objects"] == 30
+        assert summary["max"]["memory"] == 0
+        assert summary["mean"]["bytes"] == 500
+        assert summary["max"]["heap"] is None
+
+
+class TestAllocationCounters:
+    """
+    Class containing tests for the methods of :class:`AllocationCounters`.
+    """
+
+    def test_shared_hooks(self) -> None:
+        """
+        Test that the hooks stay installed until the last counters are closed.
+        """
+
+        counts = np.zeros(len(p3g.counters.ALLOCATIONS), dtype=np.int64)
+
+        with p3g.AllocationCounters() as outer:
+            inner = p3g.AllocationCounters()
+            inner.close()
+            inner.close()
+            before = outer.read()
+            objects = [str(i) * 50 for i in range(100)]
+            after = outer.read()
+
+            assert after[0] - before[0] >= len(objects)
+
+        alloc_counts(counts.ctypes.data)
+        before = counts.tolist()
+        objects = [str(i) * 50 for i in range(100)]
+        alloc_counts(counts.ctypes.data)
+
+        assert counts.tolist()[:4] == before[:4]
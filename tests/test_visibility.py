@@ -0,0 +1,186 @@
+"""
+Tests for the module visibility
+"""
+
+import py3dgame as p3g
+from py3dgame.visibility import clip_polygon, sphere_in_frustum
+from py3dgame.bake import potentially_visible_set
+
+
+class TestVisibility:
+    """
+    Class containing tests for the functions of the module visibility.
+    """
+
+    def test_clip_polygon(self) -> None:
+        """
+        Test clipping a square with a plane through its center.
+        """
+
+        square = [p3g.Vec3(0, 0, 0), p3g.Vec3(2, 0, 0), p3g.Vec3(2, 2, 0), p3g.Vec3(0, 2, 0)]
+        clipped = clip_polygon(square, (p3g.Vec3(1, 0, 0), - 1))
+
+        assert len(clipped) == 4
+        assert all(vertex.x >= 1 for vertex in clipped)
+        assert not clip_polygon(square, (p3g.Vec3(1, 0, 0), - 3))
+
+    def test_sphere_in_frustum(self) -> None:
+        """
+        Test sphere culling against the frustum of a camera.
+        """
+
+        camera = p3g.Camera(p3g.Vec3(0, 0, 0), p3g.Vec3(1, 0, 0))
+        camera.w, camera.h = 100, 100
+        camera.af = camera.f = 1
+        camera.q = 1
+        camera.update_view_space()
+        frustum = camera.frustum()
+
+        assert sphere_in_frustum(p3g.Vec3(10, 0, 0), 1, frustum)
+        assert sphere_in_frustum(p3g.Vec3(10, 9.5, 0), 1, frustum)
+        assert not sphere_in_frustum(p3g.Vec3(10, 15, 0), 1, frustum)
+        assert not sphere_in_frustum(p3g.Vec3(- 10, 0, 0), 1, frustum)
+
+    def test_sphere_in_frustum_long_dir(self) -> None:
+        """
+        Test sphere culling with a direction of view longer than 1, which
+        stretches the view vertically.
+        """
+
+        camera = p3g.Camera(p3g.Vec3(0, 0, 0), p3g.Vec3(2, 0, 0))
+        camera.w, camera.h = 100, 100
+        camera.af = camera.f = 1
+        camera.q = 1
+        camera.update_view_space()
+        frustum = camera.frustum()
+
+        # projected at 15 / 20 of the half height from the center
+        assert sphere_in_frustum(p3g.Vec3(12, 0, 15), 1, frustum)
+        assert not sphere_in_frustum(p3g.Vec3(12, 0, 25), 1, frustum)
+        assert sphere_in_frustum(p3g.Vec3(12, 9.5, 0), 1, frustum)
+        assert not sphere_in_frustum(p3g.Vec3(12, 15, 0), 1, frustum)
+
+
+class TestCellGraph:
+    """
+    Class containing tests for the methods of :class:`CellGraph`.
+    """
+
+    def test_visible_bodies(self) -> None:
+        """
+        Test that only the bodies seen through the portals are selected.
+        """
+
+        bodies = {
+            "a": p3g.Body.cube("a", 1, pos=p3g.Vec3(5, 0, 0)),
+            "b": p3g.Body.cube("b", 1, pos=p3g.Vec3(15, 0, 0)),
+            "c": p3g.Body.cube("c", 1, pos=p3g.Vec3(15, 8, 0)),
+            "e": p3g.Body.cube("e", 1, pos=p3g.Vec3(6, 0, 7)),
+        }
+        graph = p3g.CellGraph()
+        graph.add_cell(p3g.Cell("A", p3g.Vec3(0, - 5, - 5), p3g.Vec3(10, 5, 10), {"a", "e"}))
+        graph.add_cell(p3g.Cell("B", p3g.Vec3(10, - 5, - 5), p3g.Vec3(20, 5, 5), {"b"}))
+        graph.add_cell(p3g.Cell("C", p3g.Vec3(10, 5, - 5), p3g.Vec3(20, 25, 5), {"c"}))
+        graph.add_portal("A", "B", [p3g.Vec3(10, - 1, - 1), p3g.Vec3(10, 1, - 1),
+                                    p3g.Vec3(10, 1, 1), p3g.Vec3(10, - 1, 1)])
+        graph.add_portal("B", "C", [p3g.Vec3(14, 5, - 1), p3g.Vec3(16, 5, - 1),
+                                    p3g.Vec3(16, 5, 1), p3g.Vec3(14, 5, 1)])
+
+        camera = p3g.Camera(p3g.Vec3(0.5, 0, 0), p3g.Vec3(1, 0, 0))
+        camera.w, camera.h = 100, 100
+        camera.af = camera.f = camera.q = 1
+        camera.update_view_space()
+        frustum = camera.frustum()
+        visible = graph.visible_bodies(camera.eye(), frustum, bodies)
+
+        # c is in the view but behind the wall between A and C
+        assert sphere_in_frustum(bodies["c"].center, bodies["c"].radius, frustum)
+        assert sorted(body.name for body in visible) == ["a", "b"]
+        assert graph.cell_at(p3g.Vec3(15, 10, 0)).name == "C"
+
+        # with the same eye, a longer direction widens the view vertically
+        camera.pos = p3g.Vec3(- 0.5, 0, 0)
+        camera.dir = p3g.Vec3(2, 0, 0)
+        camera.update_view_space()
+        visible = graph.visible_bodies(camera.eye(), camera.frustum(), bodies)
+
+        assert sorted(body.name for body in visible) == ["a", "b", "e"]
+
+
+class TestPVS:
+    """
+    Class containing tests for the methods of :class:`PVS`.
+    """
+
+    def test_bake(self, tmp_path) -> None:
+        """
+        Test that a body behind a wall is not in the set of the cells in front of it.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("wall", 8, pos=p3g.Vec3(10, 0, 0)))
+        scene.add_body(p3g.Body.cube("hidden", 1, pos=p3g.Vec3(16, 0, 0)))
+        scene.add_body(p3g.Body.cube("seen", 1, pos=p3g.Vec3(2, 0, 0)))
+        pvs = potentially_visible_set(scene, p3g.Vec3(0, - 2, - 2), p3g.Vec3(20, 2, 2),
+                                      (4, 1, 1), samples=2, size=32)
+
+        assert pvs.visible_handles(p3g.Vec3(1, 0, 0)) == [0, 2]
+        assert pvs.visible_handles(p3g.Vec3(19, 0, 0)) == [0, 1]
+        assert pvs.visible_handles(p3g.Vec3(30, 0, 0)) is None
+
+        pvs.save(str(tmp_path / "pvs.npz"))
+        loaded = p3g.PVS.load(str(tmp_path / "pvs.npz"))
+
+        assert loaded.visible_handles(p3g.Vec3(1, 0, 0)) == [0, 2]
+        assert loaded.names == ["wall", "hidden", "seen"]
+
+    def test_reused_handle(self) -> None:
+        """
+        Test that a body that takes the handle of a body removed after the bake is
+        not culled by the set of the removed body and that the bodies the set does
+        not know are always visible.
+        """
+
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body.cube("wall", 8, pos=p3g.Vec3(10, 0, 0)))
+        scene.add_body(p3g.Body.cube("hidden", 1, pos=p3g.Vec3(16, 0, 0)))
+        scene.add_body(p3g.Body.cube("seen", 1, pos=p3g.Vec3(2, 0, 0)))
+        pvs = potentially_visible_set(scene, p3g.Vec3(0, - 2, - 2), p3g.Vec3(20, 2, 2),
+                                      (4, 1, 1), samples=2, size=32)
+        camera = p3g.Camera(p3g.Vec3(0.5, 0, 0), p3g.Vec3(1, 0, 0))
+        camera.w, camera.h = 100, 100
+        camera.af = camera.f = camera.q = 1
+        camera.update_view_space()
+        frustum = camera.frustum()
+        visible = pvs.visible_bodies(camera.eye(), frustum, scene)
+
+        assert sorted(body.name for body in visible) == ["seen", "wall"]
+
+        scene.remove_body("seen")
+        scene.add_body(p3g.Body.cube("behind", 1, pos=p3g.Vec3(5, 0, 0)))
+        scene.remove_body("hidden")
+        scene.add_body(p3g.Body.cube("front", 1, pos=p3g.Vec3(4, 0, 0)))
+        visible = pvs.visible_bodies(camera.eye(), frustum, scene)
+
+        assert scene.bodies["behind"].handle == 2
+        assert scene.bodies["front"].handle == 1
+        assert sorted(body.name for body in visible) == ["behind", "front", "wall"]
+
+    def test_bake_near_plane(self) -> None:
+        """
+        Test that a large wall crossing the near plane of every view of a cell
+        is in the set of the cell.
+        """
+
+        normal = p3g.Vec3(1, 1, 1).normalize()
+        u = p3g.Vec3(1, - 1, 0).normalize()
+        v = normal @ u
+        corners = [normal * 0.5 + (u * a + v * b) * 20
+                   for a, b in ((- 1, - 1), (1, - 1), (1, 1), (- 1, 1))]
+        faces = ((0, 1, 2), (0, 2, 3), (0, 2, 1), (0, 3, 2))
+        scene = p3g.Scene()
+        scene.add_body(p3g.Body("wall", corners, faces))
+        pvs = potentially_visible_set(scene, p3g.Vec3(- 2, - 2, - 2), p3g.Vec3(2, 2, 2),
+                                      (1, 1, 1), samples=1, size=32)
+
+        assert pvs.visible_handles(p3g.Vec3(0, 0, 0)) == [0]